@@ -0,0 +1,6 @@
+#ifndef GUARD_PROGRAM_ANALYSE_H_
+#define GUARD_PROGRAM_ANALYSE_H_
+
+int analyseMain(int argc, char *argv[]);
+
+#endif // !GUARD_PROGRAM_ANALYSE_H_
@@ -1,17 +1,24 @@
 #ifndef GUARD_PROGRAM_DECOMPILE_ANALYSER_H_
 #define GUARD_PROGRAM_DECOMPILE_ANALYSER_H_
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
 typedef struct _Vec16 {
 	size_t size;
-	uint16_t list[64];
+	size_t capacity;
+	uint16_t *list;
 } Vec16;
 
+/* Control-flow flags, one byte per byte of code */
+#define ANL_REACHABLE 0x1 /* Start of an instruction that can execute */
+#define ANL_TARGET 0x2 /* Jumped, called or skipped to */
+#define ANL_SKIPPED 0x4 /* Right after a skip, so it might not execute */
+
 typedef struct _Analyser {
 	/* Code to analyse */
-	uint8_t *buffer;
+	const uint8_t *buffer;
 	size_t size;
 
 	/* Stores the addresses of subroutines
@@ -28,10 +35,66 @@ typedef struct _Analyser {
 	 * Not stored in pairs, since we can easily get the target from the origin
 	 */
 	Vec16 skips;
+
+	/* Control-flow graph, built by anlBuildCFG. See ANL_* */
+	uint8_t *cfg;
+	bool indirect; /* Reaches a BNNN, so some targets can't be known */
 } Analyser;
 
-Analyser anlInit(uint8_t *buffer, size_t size);
+/* Static report on a program, built by anlReport. Addresses are absolute */
+typedef struct _AnlReport {
+	/* Subroutines, starting with the program itself (PROGRAM_START_ADDR) */
+	Vec16 functions;
+
+	/* Calls that can execute, in (caller, callee) pairs. The caller is the
+	 * start of the subroutine making the call
+	 */
+	Vec16 calls;
+
+	/* Most return addresses on the stack at once, -1 if it can recurse */
+	int maxDepth;
+
+	/* FX33 and FX55 that write over code, in (origin, address written) pairs */
+	Vec16 codeWrites;
+
+	/* FX33 and FX55 writing wherever I happens to point, which can't be
+	 * worked out statically
+	 */
+	Vec16 unknownWrites;
+
+	size_t unreachable; /* Bytes no path reaches, see anlIsCode */
+} AnlReport;
+
+Analyser anlInit(const uint8_t *buffer, size_t size);
+
+/* Analyses the code
+ *
+ * Returns EXIT_FAILURE if it fails
+ */
+int anlAnalyse(Analyser *anl);
+
+/* Follows every path from the start of the code, flagging what each byte is
+ *
+ * Returns EXIT_FAILURE if it fails
+ */
+int anlBuildCFG(Analyser *anl);
+
+/* Checks if the byte at offset belongs to an instruction that can execute.
+ * Needs anlBuildCFG
+ */
+bool anlIsCode(const Analyser *anl, size_t offset);
+
+/* Builds a static report on the code: its call graph, how deep the stack
+ * gets, writes into code and unreachable bytes. Builds the CFG if needed
+ *
+ * Returns EXIT_FAILURE if it fails
+ */
+int anlReport(Analyser *anl, AnlReport *report);
+
+/* Frees a report */
+void anlReportFree(AnlReport *report);
 
-void anlAnalyse(Analyser *anl);
+/* Frees the data gathered by the analyser */
+void anlFree(Analyser *anl);
 
 #endif // !GUARD_PROGRAM_DECOMPILE_ANALYSER_H_
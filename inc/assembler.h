@@ -0,0 +1,56 @@
+#ifndef GUARD_PROGRAM_COMPILE_ASSEMBLER_H_
+#define GUARD_PROGRAM_COMPILE_ASSEMBLER_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "chip8.h"
+#include "lexer.h"
+#include "symtab.h"
+
+/* What a byte of the output is */
+#define ASM_CODE 0x1 /* First byte of an instruction */
+#define ASM_ADDR 0x2 /* First byte of an instruction with an address operand */
+#define ASM_WORD 0x4 /* First byte of a DW holding a label */
+
+/* Single-pass cc8 assembler
+ *
+ * Accepts the mnemonics printed by the decompiler, plus labels ("name:") and
+ * the DB/DW data directives. Labels used before being defined are backpatched
+ * as soon as their definition shows up.
+ */
+typedef struct _Assembler {
+	uint8_t output[PROGRAM_MAX_SIZE];
+	size_t size;
+	bool full; /* Set once the output overflowed */
+
+	/* Lets the optimiser tell code from data, and move code around. See ASM_*
+	 */
+	uint8_t flags[PROGRAM_MAX_SIZE];
+
+	SymTab symbols;
+
+	Lexer lex;
+	Token token; /* Current token */
+
+	size_t instructions;
+	size_t errors;
+} Assembler;
+
+/* Creates a new assembler
+ *
+ * Returns EXIT_FAILURE if it fails
+ */
+int asmNew(Assembler *as);
+
+/* Assembles a whole source. The source must outlive the assembler
+ *
+ * Every error is reported. Returns EXIT_FAILURE if there were any
+ */
+int asmAssemble(Assembler *as, const char *source, size_t size);
+
+/* Frees the assembler */
+void asmFree(Assembler *as);
+
+#endif // !GUARD_PROGRAM_COMPILE_ASSEMBLER_H_
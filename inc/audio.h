@@ -0,0 +1,71 @@
+#ifndef GUARD_AUDIO_H_
+#define GUARD_AUDIO_H_
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <SDL2/SDL.h>
+
+#include "chip8.h"
+
+#define AUDIO_RATE 44100 /* Samples per second */
+
+/* Samples queued in the ring. Must be a power of 2 */
+#define AUDIO_RING_SIZE 8192
+
+/* Samples the producer stays ahead of the device by */
+#define AUDIO_LATENCY 2048
+
+/* Samples the device asks for at once */
+#define AUDIO_DEVICE_SAMPLES 512
+
+/* Single-producer, single-consumer ring of samples
+ *
+ * The emulator writes, the SDL audio callback reads. Each side only ever
+ * stores its own index, so neither of them takes a lock
+ */
+typedef struct _AudioRing {
+	int16_t samples[AUDIO_RING_SIZE];
+
+	_Atomic uint64_t head; /* Samples written, only stored by the producer */
+	_Atomic uint64_t tail; /* Samples read, only stored by the consumer */
+} AudioRing;
+
+typedef struct _Audio {
+	SDL_AudioDeviceID device; /* 0 without a device, samples are dropped */
+	AudioRing ring;
+
+	double phase; /* Position in the interpreter's pattern, in bits */
+
+	uint64_t start; /* Performance counter when audio started */
+	uint64_t produced; /* Samples produced so far */
+
+	/* Sound timer running, as of the last pump. The emulator stops pumping
+	 * while it's parked on FX0A, and silence running out isn't a problem
+	 */
+	_Atomic bool playing;
+
+	/* The callback found fewer samples than it needed, while playing */
+	_Atomic uint64_t underruns;
+
+	/* The producer found the ring full, and dropped samples while playing */
+	_Atomic uint64_t overruns;
+} Audio;
+
+/* Opens the default audio device and starts playing
+ *
+ * Returns EXIT_FAILURE if there's no device, in which case the emulator can
+ * still pump samples into the audio, they just won't be played
+ */
+int audioNew(Audio *audio);
+
+/* Produces the samples that are due, from the interpreter's sound timer and
+ * audio pattern. Must always be called from the same thread
+ */
+void audioPump(Audio *audio, const Chip8 *C8);
+
+/* Closes the audio device */
+void audioFree(Audio *audio);
+
+#endif // !GUARD_AUDIO_H_
@@ -0,0 +1,54 @@
+#ifndef GUARD_BATCH_H_
+#define GUARD_BATCH_H_
+
+#include "chip8.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Runs many interpreters of the same program in lockstep
+ *
+ * The registers, PC and I of every lane are kept in struct-of-arrays layout.
+ * Lanes that agree on the current instruction execute it together, as a
+ * single loop over all lanes, which the compiler turns into SIMD code. Lanes
+ * that diverged are stepped one at a time through c8Cycle, as are lanes being
+ * traced
+ *
+ * Lanes run fixed timing: vipCycles isn't kept up to date, so c8VipFrame
+ * doesn't apply to them
+ */
+typedef struct _Chip8Batch {
+	size_t count; /* Number of lanes */
+
+	/* Memory, stack, display, timers and keypad of each lane. Registers in
+	 * here are stale, use c8BatchPull and c8BatchPush to access them
+	 */
+	Chip8 *lanes;
+
+	uint16_t *pc; /* Program counters */
+	uint16_t *i; /* Index registers */
+	uint8_t *v[16]; /* General-purpose registers, v[reg][lane] */
+
+	uint8_t *active; /* Lanes stepping in lockstep, scratch space */
+} Chip8Batch;
+
+/* Creates a batch of interpreters, all starting from the same image
+ *
+ * Lane N is seeded with N + 1, so runs are reproducible. The image must
+ * outlive the batch. Returns EXIT_FAILURE if it fails
+ */
+int c8BatchNew(Chip8Batch *batch, const C8Image *IMAGE, size_t count);
+
+/* Executes a number of cycles on every lane */
+void c8BatchStep(Chip8Batch *batch, size_t cycles);
+
+/* Returns a lane, with its registers brought up to date */
+Chip8 *c8BatchPull(Chip8Batch *batch, size_t lane);
+
+/* Writes a lane's registers back into the batch, after changing them */
+void c8BatchPush(Chip8Batch *batch, size_t lane);
+
+/* Frees the batch and all of its lanes */
+void c8BatchFree(Chip8Batch *batch);
+
+#endif // !GUARD_BATCH_H_
@@ -0,0 +1,99 @@
+#ifndef GUARD_CAPTURE_H_
+#define GUARD_CAPTURE_H_
+
+#include "chip8.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <SDL2/SDL.h>
+
+#define CAPTURE_POOL 256 /* Frames waiting to be encoded, power of two */
+
+#define CAPTURE_MAGIC "C8VD"
+#define CAPTURE_VERSION 1
+#define CAPTURE_EXTENSION ".c8v"
+
+typedef enum _CaptureFormat {
+	CAPTURE_PNG, /* One 1-bit PNG per frame */
+	CAPTURE_RLE, /* A single video stream, see CaptureHeader */
+} CaptureFormat;
+
+/* Start of a video stream
+ *
+ * It's followed by a record for every frame that differs from the one before
+ * it: a CaptureRecord, then the display packed (one bit per pixel, row by
+ * row, leftmost pixel in the highest bit) and compressed with PackBits. A
+ * frame lasts until the next record's. The last record is empty, and marks
+ * the end of the stream. Everything is in the host's byte order
+ */
+typedef struct _CaptureHeader {
+	char magic[4]; /* CAPTURE_MAGIC */
+	uint16_t version; /* CAPTURE_VERSION */
+	uint8_t width;
+	uint8_t height;
+	uint16_t fps; /* Frames per second */
+	uint16_t reserved;
+} CaptureHeader;
+
+typedef struct _CaptureRecord {
+	uint32_t frame; /* First frame showing it */
+	uint16_t size; /* Bytes of compressed display that follow */
+	uint16_t reserved;
+} CaptureRecord;
+
+/* A frame waiting to be encoded */
+typedef struct _CaptureFrame {
+	uint64_t display[SCR_HEIGHT];
+	uint32_t frame;
+} CaptureFrame;
+
+/* Records frames, encoding them on a background thread
+ *
+ * Frames are copied into a preallocated pool, which the encoder goes through
+ * as a ring, so capturing never waits for it. When the pool is full, frames
+ * are dropped instead
+ */
+typedef struct _Capture {
+	CaptureFormat format;
+	const char *PATH; /* Video file, or PNG name the frame number goes into */
+	FILE *file; /* Video stream, NULL for PNGs */
+
+	CaptureFrame pool[CAPTURE_POOL];
+	_Atomic uint32_t head; /* Next frame queued, by the capturing thread */
+	_Atomic uint32_t tail; /* Next frame encoded, by the encoder */
+
+	SDL_sem *queued; /* Posted for every frame queued, and on close */
+	SDL_Thread *thread; /* Encoder */
+	_Atomic bool closing;
+
+	/* Capturing thread only */
+	uint64_t last[SCR_HEIGHT]; /* Last frame queued, to skip duplicates */
+	uint32_t frames; /* Frames seen so far */
+	uint32_t duplicates; /* Frames skipped, same as the one before */
+
+	_Atomic uint32_t dropped; /* Frames skipped, the pool was full */
+	_Atomic uint32_t written; /* Frames encoded */
+	_Atomic bool failed; /* Encoding failed, nothing else is written */
+} Capture;
+
+/* Starts capturing
+ *
+ * PATHs ending in CAPTURE_EXTENSION get a video stream, anything else gets a
+ * PNG for each frame, with the frame number added before the extension
+ * ("shot.png" becomes "shot_000120.png"). Returns EXIT_FAILURE if it fails
+ */
+int captureNew(Capture *cap, const char *PATH);
+
+/* Captures the display as the next frame. Never waits for the encoder */
+void captureFrame(Capture *cap, const Chip8 *C8);
+
+/* Finishes encoding every frame queued, stops capturing and prints a summary
+ *
+ * Returns EXIT_FAILURE if any frame couldn't be written
+ */
+int captureFree(Capture *cap);
+
+#endif // !GUARD_CAPTURE_H_
@@ -4,14 +4,71 @@
 #define SCR_WIDTH 64
 #define SCR_HEIGHT 32
 
+#define MEM_SIZE (4 * 1024)
+#define FONT_START_ADDR 0x50
+#define PROGRAM_START_ADDR 0x200
+#define PROGRAM_MAX_SIZE (MEM_SIZE - PROGRAM_START_ADDR)
+
+#define C8_STACK_SIZE 16 /* Return addresses, nested calls go this deep */
+
+/* Memory is split in pages, which are only copied when written to */
+#define PAGE_BITS 8
+#define C8_PAGE_SIZE (1 << PAGE_BITS)
+#define C8_PAGE_COUNT (MEM_SIZE / C8_PAGE_SIZE)
+
+/* XO-CHIP audio: a 128-bit pattern, played back at 4000Hz at the default
+ * pitch
+ */
+#define AUDIO_PATTERN_SIZE 16
+#define AUDIO_DEFAULT_PITCH 64
+
+/* COSMAC VIP timing: a 1.7609MHz CPU taking 8 clocks per machine cycle, with
+ * a 60Hz display. The CPU is busy feeding the display for its 128 visible
+ * lines, 14 machine cycles each, leaving the rest of the frame to programs
+ */
+#define VIP_CYCLES_PER_FRAME 3668
+#define VIP_DISPLAY_CYCLES (128 * 14)
+
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
+#include "util.h"
+
+/* A read-only memory image (font + program), shared by any number of
+ * interpreters
+ */
+typedef struct _C8Image {
+	uint8_t mem[MEM_SIZE];
+} C8Image;
+
+/* Why c8Run stopped */
+typedef enum _C8Status {
+	C8_RUNNING, /* Ran its whole budget */
+	C8_HALTED, /* Jumped to itself, so only the timers will ever change */
+	C8_WAITING, /* Waiting on FX0A for a key, see c8KeyEvent */
+	C8_INVALID_OPCODE, /* Ran an unknown opcode, which did nothing */
+	C8_STACK_OVERFLOW, /* Called with a full stack */
+	C8_STACK_UNDERFLOW, /* Returned with an empty stack */
+	C8_MEMORY_FAULT, /* Reached past the end of memory (checked builds) */
+} C8Status;
+
+typedef struct _C8RunResult {
+	C8Status status;
+	uint32_t cycles; /* Cycles executed, waiting on FX0A included */
+} C8RunResult;
+
 typedef struct _Chip8 {
-	uint8_t mem[4 * 1024]; /* 4KB memory */
+	/* 4KB memory, in pages
+	 *
+	 * Pages start out pointing into a shared image, and are copied into a
+	 * private page the first time they're written to. Go through c8ReadByte
+	 * and c8WriteByte instead of touching them directly
+	 */
+	uint8_t *pages[C8_PAGE_COUNT];
+	uint16_t owned; /* Bitmask of private pages */
 
-	uint16_t stack[16]; /* Address stack */
+	uint16_t stack[C8_STACK_SIZE]; /* Address stack */
 	uint8_t sp; /* Stack pointer */
 
 	uint16_t pc; /* Program counter */
@@ -25,12 +82,50 @@ typedef struct _Chip8 {
 		uint8_t st; /* Sound timer */
 	} timers;
 
-	uint8_t display[SCR_HEIGHT][SCR_WIDTH]; /* VRAM */
+	/* Played in a loop while the sound timer is running. Starts out as a
+	 * plain buzzer, XO-CHIP programs can load their own with F002
+	 */
+	uint8_t pattern[AUDIO_PATTERN_SIZE];
+	uint8_t pitch; /* Playback rate, see FX3A */
+
+	/* VRAM, one bit per pixel. The leftmost pixel is the highest bit */
+	uint64_t display[SCR_HEIGHT];
 	bool dirty; /* Signals that the screen needs to be refreshed */
 
 	uint8_t keypad[16]; /* Keypad data */
+
+	/* FX0A parks the interpreter until a key is pressed and released */
+	bool waiting;
+	uint8_t waitReg; /* Register the key goes into */
+	int8_t waitKey; /* Key pressed while waiting, -1 until then */
+
+	uint32_t rng; /* Random number generator state, for CXNN */
+
+	/* Set when an instruction fails or is unknown, C8_RUNNING otherwise.
+	 * Only cleared by c8Run
+	 */
+	C8Status fault;
+	bool trap; /* Aborts on faults instead of stopping, see c8Run */
+
+	/* Drawing counters, for stats. Whoever reads them resets them */
+	uint32_t draws; /* DXYN executed */
+	uint32_t pixels; /* Sprite pixels drawn by them */
+
+	/* Machine cycles the COSMAC VIP would have spent so far, see c8VipFrame.
+	 * Only the reference core counts them
+	 */
+	uint32_t vipCycles;
+
+	/* Execution trace, NULL if not tracing. Not owned, see tracer.h */
+	struct _C8Trace *trace;
 } Chip8;
 
+/* How many instructions a frame runs */
+typedef enum _C8Timing {
+	C8_TIMING_FIXED, /* The same number every frame */
+	C8_TIMING_VIP, /* As many as a COSMAC VIP would, see c8VipFrame */
+} C8Timing;
+
 /* Represents a Chip-8 instruction */
 typedef struct _Instr {
 	uint8_t op; /* First nibble */
@@ -43,25 +138,144 @@ typedef struct _Instr {
 	uint16_t nnn; /* Second, third and fourth nibbles */
 } Instr;
 
+/* Reasons a program might fail to load */
+typedef enum _C8LoadError {
+	C8_LOAD_OK = 0,
+	C8_LOAD_ERR_OPEN, /* Couldn't open or map the file */
+	C8_LOAD_ERR_EMPTY, /* Program has no bytes */
+	C8_LOAD_ERR_TOO_BIG, /* Program doesn't fit in memory */
+} C8LoadError;
+
+/* A read-only program image, mapped straight from a file
+ *
+ * Opening it once and loading it into many interpreters means the file is
+ * only read once, and no intermediate buffers are allocated
+ */
+typedef struct _C8Rom {
+	UtilMap map;
+} C8Rom;
+
 /* Creates a new Chip-8 interpreter */
 Chip8 c8New(void);
 
-/* Loads an array of bytes into program memory
+/* Creates a new Chip-8 interpreter whose memory starts out as an image
+ *
+ * The image must outlive the interpreter
+ */
+Chip8 c8NewShared(const C8Image *IMAGE);
+
+/* Frees the interpreter's private memory pages
  *
- * Returns EXIT_FAILURE if it fails
+ * Interpreters own memory once written to, so they shouldn't be copied by
+ * value after they start running
  */
-int c8Load(Chip8 *c8, uint8_t *program, size_t size);
+void c8Free(Chip8 *c8);
 
-/* Loads a program into memory from a file
+/* Copies an interpreter, along with its private memory pages
  *
- * Returns EXIT_FAILURE if it fails
+ * Works as a snapshot: the copy can be run, restored from, or thrown away with
+ * c8Free. Returns EXIT_FAILURE if it fails
  */
-int c8LoadFile(Chip8 *c8, const char *PATH);
+int c8Clone(Chip8 *dst, const Chip8 *SRC);
+
+/* Hashes the interpreter's whole state (registers, stack, timers, keypad,
+ * audio, random number generator, display and private memory). Interpreters
+ * sharing an image with the same hash are almost certainly in the same state
+ */
+uint64_t c8StateHash(const Chip8 *c8);
+
+/* Hashes the display alone, as a golden image for tests
+ *
+ * The display is hashed packed, one bit per pixel, row by row, leftmost pixel
+ * in the highest bit. The hash is the same on every host
+ */
+uint64_t c8DisplayHash(const Chip8 *c8);
+
+/* Seeds the interpreter's random number generator, for reproducible runs */
+void c8Seed(Chip8 *c8, uint32_t seed);
+
+/* Builds an image holding the font and a program */
+C8LoadError c8ImageNew(C8Image *image, const uint8_t *program, size_t size);
+
+/* Maps a program file and validates its size */
+C8LoadError c8RomOpen(C8Rom *rom, const char *PATH);
+
+/* Unmaps a program file */
+void c8RomClose(C8Rom *rom);
+
+/* Loads an array of bytes into program memory
+ *
+ * The program is copied, so it's still owned by the caller
+ */
+C8LoadError c8Load(Chip8 *c8, const uint8_t *program, size_t size);
+
+/* Loads a mapped program into memory */
+C8LoadError c8LoadRom(Chip8 *c8, const C8Rom *ROM);
+
+/* Loads a program into memory from a file */
+C8LoadError c8LoadFile(Chip8 *c8, const char *PATH);
+
+/* Describes a load error */
+const char *c8LoadErrorString(C8LoadError error);
+
+/* Reads a byte from memory */
+uint8_t c8ReadByte(const Chip8 *c8, uint16_t addr);
+
+/* Writes a byte to memory, copying its page if it's shared */
+void c8WriteByte(Chip8 *c8, uint16_t addr, uint8_t value);
+
+/* Returns whether the pixel at (x, y) is set */
+bool c8GetPixel(const Chip8 *c8, int x, int y);
 
 /* Parses a raw opcode into an Instruction */
 Instr c8ParseInstruction(const uint16_t INSTR);
 
-/* Executes one Chip-8 cycle */
+/* Presses or releases a key
+ *
+ * Prefer it over writing to the keypad directly: FX0A sees every event, even
+ * a press and release that happen between two cycles
+ */
+void c8KeyEvent(Chip8 *c8, uint8_t key, bool down);
+
+/* Executes one Chip-8 cycle. Does nothing while waiting on FX0A
+ *
+ * Stack errors leave the PC on the instruction, doing nothing every time it
+ * runs. See c8Run for finding out about them
+ */
 void c8Cycle(Chip8 *c8);
 
+/* Runs a frame with the COSMAC VIP timing model
+ *
+ * Instructions are run until they've spent a frame's worth of machine cycles
+ * (VIP_CYCLES_PER_FRAME, less VIP_DISPLAY_CYCLES), going by the original
+ * interpreter's costs. DXYN
+ * waits for the next frame before drawing, and whatever an instruction spends
+ * past the end of a frame comes out of the next one. Returns the instructions
+ * executed
+ */
+uint32_t c8VipFrame(Chip8 *c8);
+
+/* Ends a COSMAC VIP frame, for callers running the instructions themselves
+ *
+ * Run instructions while vipCycles is below VIP_CYCLES_PER_FRAME, then call
+ * this before the next frame
+ */
+void c8EndVipFrame(Chip8 *c8);
+
+/* Executes up to budget cycles, stopping early if the program halts, waits on
+ * FX0A or faults (see C8Status). Invalid opcodes stop after the instruction,
+ * so running again carries on past them, while stack and memory errors leave
+ * the PC on it and fault again
+ *
+ * Instances with trap set print the error and abort on stack and memory
+ * errors instead, dumping the trace if there is one
+ */
+C8RunResult c8Run(Chip8 *c8, uint32_t budget);
+
+/* Describes a status, for error messages */
+const char *c8StatusString(C8Status status);
+
+/* Decrements the timers. Should be called at 60Hz */
+void c8TickTimers(Chip8 *c8);
+
 #endif // !GUARD_CHIP8_H_
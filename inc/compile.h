@@ -0,0 +1,6 @@
+#ifndef GUARD_PROGRAM_COMPILE_H_
+#define GUARD_PROGRAM_COMPILE_H_
+
+int compMain(int argc, char *argv[]);
+
+#endif // !GUARD_PROGRAM_COMPILE_H_
@@ -0,0 +1,6 @@
+#ifndef GUARD_PROGRAM_DEBUG_H_
+#define GUARD_PROGRAM_DEBUG_H_
+
+int debugMain(int argc, char *argv[]);
+
+#endif // !GUARD_PROGRAM_DEBUG_H_
@@ -0,0 +1,123 @@
+#ifndef GUARD_DEBUGGER_H_
+#define GUARD_DEBUGGER_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "chip8.h"
+
+/* Register a condition can test besides V0-VF */
+#define DBG_REG_I 0x10
+
+/* Conditions that can be attached to breakpoints, in total */
+#define DBG_MAX_CONDITIONS 64
+
+typedef enum _DbgStop {
+	DBG_STOP_STEP, /* Finished stepping */
+	DBG_STOP_BREAKPOINT, /* About to execute a breakpoint */
+	DBG_STOP_WATCHPOINT, /* Just wrote to a watched address */
+	DBG_STOP_BUDGET, /* Ran out of cycles before anything was hit */
+} DbgStop;
+
+typedef enum _DbgCmp {
+	DBG_CMP_EQ,
+	DBG_CMP_NE,
+	DBG_CMP_LT,
+	DBG_CMP_LE,
+	DBG_CMP_GT,
+	DBG_CMP_GE,
+} DbgCmp;
+
+/* "reg cmp value", tested when a breakpoint is hit */
+typedef struct _DbgCondition {
+	uint8_t reg; /* 0x0-0xF for VX, DBG_REG_I for I */
+	DbgCmp cmp;
+	uint16_t value;
+} DbgCondition;
+
+/* Runs an interpreter on its own dispatch loop, stopping at breakpoints and
+ * watchpoints
+ *
+ * c8Cycle knows nothing about it: the checks only happen in here, so an
+ * interpreter with no debugger attached runs at full speed
+ */
+typedef struct _Debugger {
+	Chip8 *c8;
+
+	/* Timers tick every cyclesPerFrame instructions. With 0, whoever runs the
+	 * debugger ticks them instead, and there are no frames to step by
+	 */
+	int cyclesPerFrame;
+	int cycle; /* Instructions into the current frame */
+
+	uint64_t executed; /* Instructions executed so far */
+	uint64_t frames; /* Frames finished so far */
+
+	/* One bit per address */
+	uint64_t breakpoints[MEM_SIZE / 64];
+	uint64_t watchpoints[MEM_SIZE / 64];
+
+	/* Breakpoints with conditions only stop if any of them holds */
+	struct {
+		uint16_t addr;
+		DbgCondition cond;
+	} conditions[DBG_MAX_CONDITIONS];
+	size_t conditionCount;
+
+	uint16_t watched; /* Watched address written to, after a watchpoint */
+} Debugger;
+
+/* Attaches a debugger to an interpreter, with no breakpoints */
+void dbgAttach(Debugger *dbg, Chip8 *c8, int cyclesPerFrame);
+
+/* Sets an unconditional breakpoint, dropping any conditions it had */
+void dbgSetBreakpoint(Debugger *dbg, uint16_t addr);
+
+/* Sets a breakpoint that only stops if a condition holds
+ *
+ * Returns EXIT_FAILURE if there's no room for more conditions
+ */
+int dbgSetCondition(Debugger *dbg, uint16_t addr, const DbgCondition COND);
+
+/* Removes a breakpoint, along with its conditions */
+void dbgClearBreakpoint(Debugger *dbg, uint16_t addr);
+
+/* Watches for writes to size bytes of memory */
+void dbgSetWatchpoint(Debugger *dbg, uint16_t addr, size_t size);
+
+/* Stops watching size bytes of memory */
+void dbgClearWatchpoint(Debugger *dbg, uint16_t addr, size_t size);
+
+/* Returns whether there's a breakpoint at an address */
+bool dbgHasBreakpoint(const Debugger *dbg, uint16_t addr);
+
+/* Returns whether an address is being watched */
+bool dbgIsWatched(const Debugger *dbg, uint16_t addr);
+
+/* Executes one instruction, unless there's a breakpoint on it
+ *
+ * For callers driving their own loop, one instruction at a time
+ */
+DbgStop dbgCycle(Debugger *dbg);
+
+/* Executes count instructions
+ *
+ * Like the other run functions, a breakpoint on the current instruction is
+ * ignored, so it's always possible to move past one
+ */
+DbgStop dbgStep(Debugger *dbg, uint64_t count);
+
+/* Runs until count frames are finished */
+DbgStop dbgStepFrame(Debugger *dbg, uint64_t count);
+
+/* Executes one instruction, running through the subroutine if it's a call */
+DbgStop dbgStepOver(Debugger *dbg, uint64_t budget);
+
+/* Runs until the current subroutine returns */
+DbgStop dbgStepOut(Debugger *dbg, uint64_t budget);
+
+/* Runs until a breakpoint or watchpoint is hit, for at most budget cycles */
+DbgStop dbgContinue(Debugger *dbg, uint64_t budget);
+
+#endif // !GUARD_DEBUGGER_H_
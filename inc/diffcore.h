@@ -0,0 +1,25 @@
+#ifndef GUARD_DIFFCORE_H_
+#define GUARD_DIFFCORE_H_
+
+#include "chip8.h"
+
+typedef struct _DiffOptions {
+	int frames; /* Frames to run for */
+	int cycles; /* Cycles per frame */
+
+	/* Instructions between comparisons. 1 compares the full state after
+	 * every instruction, anything else only compares state hashes
+	 */
+	int every;
+
+	const char *INPUT; /* Keypad trace, may be NULL. See keytrace.h */
+} DiffOptions;
+
+/* Runs c8Cycle and the batch engine side by side on the same program and
+ * input, stopping at the first instruction where their states differ
+ *
+ * Returns EXIT_FAILURE if they diverged, or if it fails
+ */
+int diffRun(const C8Image *IMAGE, const DiffOptions *OPTS);
+
+#endif // !GUARD_DIFFCORE_H_
@@ -1,39 +1,171 @@
 #ifndef GUARD_EMULATOR_H_
 #define GUARD_EMULATOR_H_
 
+#include "audio.h"
+#include "capture.h"
 #include "chip8.h"
+#include "gdbstub.h"
+#include "stats.h"
+#include "tracer.h"
 
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
 #include <SDL2/SDL.h>
 
+/* Set in FrameBuffer.ready while the newest frame hasn't been taken */
+#define FRAME_FRESH 0x4
+
+/* Largest grid side, see emuSetGrid */
+#define EMU_GRID_MAX 32
+
+/* Fastest capped speed, see emuSetSpeed */
+#define EMU_SPEED_MAX 64
+
+/* Triple-buffered handoff of finished frames, from the emulation thread to
+ * the render thread
+ *
+ * Each side owns a buffer, and they swap theirs with the middle one, so
+ * neither ever waits for the other: the emulation thread always has a buffer
+ * to draw into, and the render thread always gets the newest frame
+ */
+typedef struct _FrameBuffer {
+	uint64_t *frames[3]; /* Every instance's display, one after another */
+
+	_Atomic int ready; /* Middle buffer, plus FRAME_FRESH */
+	int back; /* Emulation thread's buffer */
+	int front; /* Render thread's buffer */
+} FrameBuffer;
+
+#define INPUT_QUEUE_SIZE 64 /* Power of two */
+
+/* A key going down or up, stamped with when it happened */
+typedef struct _InputEvent {
+	uint64_t time; /* Nanoseconds, on the emulator's clock */
+	uint8_t key;
+	bool down;
+} InputEvent;
+
+/* Keypad events, from the render thread to the emulation thread
+ *
+ * Single producer, single consumer. Events that don't fit are dropped
+ */
+typedef struct _InputQueue {
+	InputEvent events[INPUT_QUEUE_SIZE];
+
+	_Atomic uint32_t head; /* Next slot written, by the render thread */
+	_Atomic uint32_t tail; /* Next slot read, by the emulation thread */
+} InputQueue;
+
 typedef struct _Emulator {
-	Chip8 c8;
+	/* Instances, in a square grid. The first one is traced, debugged and
+	 * heard. Only touched by the emulation thread while running
+	 */
+	Chip8 *c8;
+	size_t count;
+	int columns;
+
+	SDL_Thread *thread; /* Emulation thread */
+	_Atomic bool running;
+
+	_Atomic int speed; /* Times the normal speed */
+	_Atomic bool turbo; /* Runs as fast as possible, ignoring speed */
+	C8Timing timing; /* Instructions per frame */
+
+	Stats stats;
+	FILE *statsFile; /* Reports are appended every second, NULL if not */
+	bool overlay; /* Frame time graph, on top of the display */
+	bool redraw; /* Draw again even without a new frame */
+
+	InputQueue input;
+	uint64_t inputLatency; /* Age of the last event when it was applied, ns */
+
+	/* The emulation thread sleeps on this while FX0A waits for a key */
+	SDL_mutex *parkLock;
+	SDL_cond *parkCond;
+	_Atomic bool parked;
+
+	FrameBuffer fb;
 
 	int delay; /* Delay, in nanoseconds */
 
+	C8Trace *trace; /* Always-on execution trace, NULL if it couldn't start */
+	const char *tracePath; /* Where the trace is dumped to */
+
+	GdbStub *gdb; /* Remote debugging, NULL if not serving */
+
+	Capture *capture; /* Records the first instance, NULL if not */
+
+	Audio audio;
+
 	SDL_Window *window;
 	SDL_Renderer *renderer;
-	SDL_Texture *tex;
+	SDL_Texture *tex; /* Atlas, with every instance's display in its cell */
+
+	uint8_t *atlas; /* Pixels of the atlas, as last uploaded */
+	uint64_t *shown; /* Displays the atlas was drawn from */
 } Emulator;
 
 /* Creates a new emulator */
 int emuNew(Emulator *emu);
 
-/* Runs the emulator from an array of bytes */
-int emuRun(Emulator *emu, uint8_t *program, size_t size);
+/* Runs columns x columns instances in the window, as a grid. May fail
+ *
+ * Call it before emuServeGdb. All of them are drawn with a single texture
+ * and present, and stepped on the same emulation thread
+ */
+int emuSetGrid(Emulator *emu, int columns);
+
+/* Runs the emulator from an array of bytes, on every instance. The bytes are
+ * copied
+ */
+int emuRun(Emulator *emu, const uint8_t *program, size_t size);
 
-/* Runs the emulator from a file */
+/* Runs the emulator from a file, on every instance */
 int emuRunFile(Emulator *emu, const char *PATH);
 
+/* Runs the emulator from several files, spread over the instances in turn */
+int emuRunFiles(Emulator *emu, const char **PATHS, size_t count);
+
 /* Set emulator delay */
 void emuSetDelay(Emulator *emu, const int delayms);
 
+/* Runs at speed times the normal speed, 1 to EMU_SPEED_MAX. May fail */
+int emuSetSpeed(Emulator *emu, int speed);
+
+/* Runs uncapped, as fast as the host allows */
+void emuSetTurbo(Emulator *emu, bool turbo);
+
+/* Picks how many instructions each frame runs. Must be called before running
+ *
+ * C8_TIMING_FIXED runs the same number every frame, C8_TIMING_VIP as many as
+ * a COSMAC VIP would, see c8VipFrame
+ */
+void emuSetTiming(Emulator *emu, C8Timing timing);
+
+/* Records every frame of the first instance, see captureNew. May fail */
+int emuSetCapture(Emulator *emu, const char *PATH);
+
+/* Appends a line of JSON with the stats to a file every second. May fail */
+int emuSetStatsFile(Emulator *emu, const char *PATH);
+
+/* Shows or hides the frame time graph (also F5) */
+void emuSetOverlay(Emulator *emu, bool overlay);
+
 /* Set emulator scaling factor. May fail */
 int emuSetScaleFactor(Emulator *emu, const float SCALE);
 
+/* Sets the file the trace is dumped to, on F12 or on a crash */
+void emuSetTraceFile(Emulator *emu, const char *PATH);
+
+/* Serves the GDB remote protocol on a Unix socket, or on stdio if PATH is "-"
+ *
+ * May fail
+ */
+int emuServeGdb(Emulator *emu, const char *PATH);
+
 /* Frees the emulator and quits SDL */
 void emuQuit(Emulator *emu);
 
@@ -0,0 +1,6 @@
+#ifndef GUARD_PROGRAM_EXPLORE_H_
+#define GUARD_PROGRAM_EXPLORE_H_
+
+int exploreMain(int argc, char *argv[]);
+
+#endif // !GUARD_PROGRAM_EXPLORE_H_
@@ -0,0 +1,82 @@
+#ifndef GUARD_GDBSTUB_H_
+#define GUARD_GDBSTUB_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "chip8.h"
+#include "debugger.h"
+
+/* Largest packet accepted or sent, payload only */
+#define GDB_PACKET_SIZE 1024
+
+/* Replies kept while the client catches up, a few packets' worth */
+#define GDB_PENDING_SIZE (4 * (GDB_PACKET_SIZE + 4))
+
+/* Registers, in the order 'g' and 'G' send them. V0-VF come first */
+typedef enum _GdbReg {
+	GDB_REG_I = 16, /* 2 bytes */
+	GDB_REG_PC, /* 2 bytes */
+	GDB_REG_SP,
+	GDB_REG_DT,
+	GDB_REG_ST,
+	GDB_REG_COUNT,
+} GdbReg;
+
+typedef enum _GdbState {
+	GDB_STATE_IDLE, /* Waiting for a packet */
+	GDB_STATE_DATA, /* Reading a packet's payload */
+	GDB_STATE_CHECKSUM, /* Reading a packet's checksum */
+} GdbState;
+
+/* Serves the GDB remote serial protocol, over a Unix socket or stdio
+ *
+ * Nothing ever blocks: the emulator pumps the stub every cycle, and runs the
+ * interpreter through it so breakpoints work. Replies are queued, and sent as
+ * the client takes them
+ */
+typedef struct _GdbStub {
+	Debugger dbg;
+
+	const char *PATH; /* Socket path, NULL for stdio */
+	int server; /* Listening socket, -1 for stdio */
+	int in, out; /* Client, -1 while nobody is attached */
+
+	bool halted; /* Stopped, waiting for the client */
+	bool resuming; /* Don't stop at the breakpoint the PC is sitting on */
+
+	GdbState state;
+	char packet[GDB_PACKET_SIZE + 1];
+	size_t size;
+	uint8_t checksum; /* Computed while reading the payload */
+	char received[2]; /* Checksum sent by the client */
+	size_t receivedSize;
+
+	char pending[GDB_PENDING_SIZE]; /* Replies not sent yet, see gdbPump */
+	size_t pendingSize;
+} GdbStub;
+
+/* Starts serving an interpreter, on a Unix socket at PATH or on stdio if PATH
+ * is "-". On stdio, the client gets stdout to itself: anything printed after
+ * goes to stderr
+ *
+ * The interpreter is halted whenever a client attaches. Timers are left to the
+ * caller. Returns EXIT_FAILURE if it fails
+ */
+int gdbNew(GdbStub *stub, Chip8 *c8, const char *PATH);
+
+/* Accepts clients, handles whatever they sent and sends the replies, without
+ * blocking
+ */
+void gdbPump(GdbStub *stub);
+
+/* Executes an instruction, unless the client halted the interpreter or it
+ * hit a breakpoint. Returns whether it executed one
+ */
+bool gdbCycle(GdbStub *stub);
+
+/* Disconnects the client and stops serving */
+void gdbFree(GdbStub *stub);
+
+#endif // !GUARD_GDBSTUB_H_
@@ -0,0 +1,36 @@
+#ifndef GUARD_HEADLESS_H_
+#define GUARD_HEADLESS_H_
+
+#include "chip8.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* A display hash expected at the end of a frame */
+typedef struct _HeadlessCheck {
+	int frame; /* 0 is before the first frame */
+	uint64_t hash; /* See c8DisplayHash */
+	bool expected; /* If not set, the hash is only printed */
+} HeadlessCheck;
+
+typedef struct _HeadlessOptions {
+	int frames; /* Frames to run for, with checks it's up to the last one */
+	int cycles; /* Cycles per frame, with C8_TIMING_FIXED */
+	C8Timing timing;
+	const char *INPUT; /* Keypad trace, may be NULL. See keytrace.h */
+	const char *CAPTURE; /* Records every frame, may be NULL. See capture.h */
+
+	HeadlessCheck *checks; /* Sorted by frame when run */
+	size_t checkCount;
+} HeadlessOptions;
+
+/* Runs a program without a window, checking display hashes along the way
+ *
+ * Uses the same seed and frames as the diff-core run. Without checks, prints
+ * the hash of the last frame. Returns EXIT_FAILURE if a hash didn't match, or
+ * if it fails
+ */
+int headlessRun(const C8Image *IMAGE, HeadlessOptions *opts);
+
+#endif // !GUARD_HEADLESS_H_
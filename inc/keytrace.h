@@ -0,0 +1,31 @@
+#ifndef GUARD_KEYTRACE_H_
+#define GUARD_KEYTRACE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* A key pressed or released at the start of a frame */
+typedef struct _KeyTraceEvent {
+	int frame;
+	uint8_t key;
+	bool down;
+} KeyTraceEvent;
+
+/* Recorded keypad input, for headless runs
+ *
+ * Each line of the file is "FRAME KEY STATE", such as "120 A 1" to press key
+ * A at frame 120. Lines starting with '#' are ignored, frames never go back
+ */
+typedef struct _KeyTrace {
+	KeyTraceEvent *events; /* Sorted by frame */
+	size_t count;
+} KeyTrace;
+
+/* Loads a keypad trace. Returns EXIT_FAILURE if it fails */
+int keytraceLoad(KeyTrace *trace, const char *PATH);
+
+/* Frees a keypad trace */
+void keytraceFree(KeyTrace *trace);
+
+#endif // !GUARD_KEYTRACE_H_
@@ -0,0 +1,41 @@
+#ifndef GUARD_PROGRAM_COMPILE_LEXER_H_
+#define GUARD_PROGRAM_COMPILE_LEXER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum _TokenType {
+	TOKEN_WORD, /* Mnemonics, registers, labels and bare hex numbers */
+	TOKEN_NUMBER, /* 0x-prefixed hex or #-prefixed decimal numbers */
+	TOKEN_COMMA,
+	TOKEN_COLON,
+	TOKEN_LBRACKET,
+	TOKEN_RBRACKET,
+	TOKEN_NEWLINE,
+	TOKEN_EOF,
+	TOKEN_ERROR,
+} TokenType;
+
+typedef struct _Token {
+	TokenType type;
+
+	/* Points straight into the source, which is not NUL-terminated */
+	const char *start;
+	size_t length;
+
+	uint32_t value; /* Value of TOKEN_NUMBER */
+	int line;
+} Token;
+
+typedef struct _Lexer {
+	const char *current;
+	const char *end;
+	int line;
+} Lexer;
+
+Lexer lexInit(const char *source, size_t size);
+
+/* Scans the next token. Never allocates */
+Token lexNext(Lexer *lex);
+
+#endif // !GUARD_PROGRAM_COMPILE_LEXER_H_
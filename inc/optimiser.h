@@ -0,0 +1,27 @@
+#ifndef GUARD_PROGRAM_COMPILE_OPTIMISER_H_
+#define GUARD_PROGRAM_COMPILE_OPTIMISER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "assembler.h"
+
+typedef struct _OptStats {
+	size_t folded; /* 6XNN/7XNN merged into the instruction before them */
+	size_t threaded; /* Jumps sent straight to the end of a jump chain */
+	size_t tailCalls; /* 2NNN/00EE pairs turned into 1NNN */
+	size_t removed; /* Bytes of dead code removed */
+
+	uint64_t saved; /* Cycles saved, estimated from the execution counts */
+} OptStats;
+
+/* Runs peephole optimisations over an assembled program, in place
+ *
+ * COUNTS, if not NULL, holds how many times the instruction at each offset
+ * ran in a baseline run, and is used to estimate how many cycles were saved.
+ * Programs reaching a BNNN might jump anywhere, so nothing is removed from
+ * them. Returns EXIT_FAILURE if it fails
+ */
+int optOptimise(Assembler *as, const uint32_t *COUNTS, OptStats *stats);
+
+#endif // !GUARD_PROGRAM_COMPILE_OPTIMISER_H_
@@ -0,0 +1,78 @@
+#ifndef GUARD_PROGRAM_DECOMPILE_PRINTER_H_
+#define GUARD_PROGRAM_DECOMPILE_PRINTER_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "chip8.h"
+
+/* Size of the output buffer. Big enough to hold the listing of a full 4KB
+ * program, so most decompilations are flushed with a single fwrite
+ */
+#define PRT_BUFFER_SIZE (128 * 1024)
+
+typedef enum _PrtFormat {
+	PRT_FORMAT_TEXT, /* "0x0200: 00E0 CLS" listing */
+	PRT_FORMAT_JSON, /* One JSON object per instruction */
+	PRT_FORMAT_ASM, /* Source that 'chip8 compile' turns back into the program */
+} PrtFormat;
+
+typedef struct _Printer {
+	FILE *file; /* Where the buffer is flushed to, NULL to keep it in memory */
+
+	PrtFormat format;
+	bool verbose; /* Plain english instead of mnemonics */
+
+	char *buffer;
+	size_t size;
+	size_t capacity;
+
+	size_t count; /* Instructions printed so far */
+} Printer;
+
+/* Creates a new printer that writes to a file
+ *
+ * Without a file, the buffer grows to hold the whole output instead
+ * Returns EXIT_FAILURE if it fails
+ */
+int prtNew(Printer *prt, FILE *file, PrtFormat format, bool verbose);
+
+/* Flushes the printer and points it at another file, so its buffer can be
+ * reused for another program. Anything kept in memory is dropped
+ */
+void prtReset(Printer *prt, FILE *file);
+
+/* Prints the header describing the program */
+void prtHeader(Printer *prt, const char *NAME, size_t size);
+
+/* Prints a single instruction located at the given address */
+void prtInstruction(Printer *prt, uint16_t addr, const Instr INSTR);
+
+/* Prints the last byte of a program with an odd size */
+void prtTrailingByte(Printer *prt, uint16_t addr, uint8_t byte);
+
+/* Prints whatever comes after the last instruction */
+void prtFooter(Printer *prt);
+
+/* Prints a whole program: header, every instruction and footer */
+void prtProgram(
+	Printer *prt, const char *NAME, const uint8_t *program, size_t size);
+
+/* Prints the mnemonic (or english description) of an instruction */
+void prtMnemonic(Printer *prt, const Instr INSTR);
+
+/* Raw writers */
+void prtChar(Printer *prt, char c);
+void prtString(Printer *prt, const char *STR);
+void prtHex(Printer *prt, uint32_t value, int digits);
+void prtDecimal(Printer *prt, size_t value);
+
+/* Writes the buffer out to the file. Does nothing without a file */
+void prtFlush(Printer *prt);
+
+/* Flushes and frees the printer. Doesn't close the file */
+void prtFree(Printer *prt);
+
+#endif // !GUARD_PROGRAM_DECOMPILE_PRINTER_H_
@@ -0,0 +1,97 @@
+#ifndef GUARD_STATS_H_
+#define GUARD_STATS_H_
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* Frame time histogram: STATS_BUCKETS buckets of STATS_BUCKET_NS, the last
+ * one holding everything slower
+ */
+#define STATS_BUCKETS 256
+#define STATS_BUCKET_NS 250000
+
+#define STATS_HISTORY 128 /* Frame times kept for the overlay */
+
+/* Counters written by the emulation thread only
+ *
+ * Each counter has a single writer, so bumping one is a plain load and store,
+ * and readers on other threads just load them
+ */
+typedef struct _EmuCounters {
+	_Atomic uint64_t cycles; /* Instructions executed, on every instance */
+	_Atomic uint64_t frames; /* Timer ticks */
+	_Atomic uint64_t draws; /* DXYN executed */
+	_Atomic uint64_t pixels; /* Sprite pixels drawn by them */
+	_Atomic uint64_t lostNs; /* Emulated time given up on, when behind */
+} EmuCounters;
+
+/* Counters written and read by the render thread only */
+typedef struct _RenderCounters {
+	uint64_t presents;
+	uint64_t uploads; /* Presents that uploaded the atlas */
+	uint64_t uploadNs; /* Time spent uploading */
+	uint64_t presentNs; /* Time spent presenting */
+	uint64_t lastPresent; /* Host time of the last present, 0 before any */
+
+	uint32_t histogram[STATS_BUCKETS]; /* Time between presents */
+
+	uint64_t history[STATS_HISTORY]; /* Last times between presents */
+	size_t historyHead; /* Next slot written */
+} RenderCounters;
+
+/* Everything measured since the last report */
+typedef struct _StatsReport {
+	double seconds; /* Length of the interval */
+
+	double ips; /* Instructions per second */
+	double fps; /* Presents per second */
+	double frameMs[4]; /* Time between presents: median, 95th, 99th, max */
+
+	double drawsPerFrame; /* DXYN per timer tick */
+	double pixelsPerFrame; /* Sprite pixels drawn per timer tick */
+
+	double uploadMs; /* Average upload time, per upload */
+	double presentMs; /* Average present time, per present */
+
+	double timerHz; /* Timer ticks per second */
+	double driftMs; /* Emulated time given up on */
+
+	uint64_t underruns; /* Audio, see audio.h */
+	uint64_t overruns;
+} StatsReport;
+
+typedef struct _Stats {
+	EmuCounters emu;
+	RenderCounters render;
+
+	/* Counters at the last report */
+	uint64_t lastTime;
+	EmuCounters last;
+} Stats;
+
+/* Resets every counter, starting the first interval at NOW */
+void statsInit(Stats *stats, uint64_t NOW);
+
+/* Adds to a counter. Only for the counter's own thread */
+static inline void statsAdd(_Atomic uint64_t *counter, uint64_t n) {
+	atomic_store_explicit(counter,
+		atomic_load_explicit(counter, memory_order_relaxed) + n,
+		memory_order_relaxed);
+}
+
+/* Records a present at NOW, and how long its upload (0 if there was none)
+ * and present took. Render thread only
+ */
+void statsPresent(Stats *stats, uint64_t NOW, uint64_t uploadNs,
+	uint64_t presentNs);
+
+/* Reports everything since the last report, and starts a new interval at
+ * NOW. Render thread only. Audio counters are left for the caller
+ */
+void statsReport(Stats *stats, uint64_t NOW, StatsReport *report);
+
+/* Writes a report as a single line of JSON */
+void statsWrite(const StatsReport *REPORT, FILE *file);
+
+#endif // !GUARD_STATS_H_
@@ -0,0 +1,69 @@
+#ifndef GUARD_PROGRAM_COMPILE_SYMTAB_H_
+#define GUARD_PROGRAM_COMPILE_SYMTAB_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* What a backpatch has to fill in */
+typedef enum _FixupKind {
+	FIXUP_ADDR, /* Low 12 bits of an instruction */
+	FIXUP_WORD, /* A whole 16-bit word */
+} FixupKind;
+
+/* A use of a label that wasn't defined yet */
+typedef struct _Fixup {
+	uint16_t offset; /* Where in the output */
+	FixupKind kind;
+	int line;
+
+	int32_t next; /* Next fixup of the same symbol, -1 if none */
+} Fixup;
+
+typedef struct _Symbol {
+	/* Points into the source, which outlives the table */
+	const char *name;
+	size_t length;
+	uint32_t hash;
+
+	bool defined;
+	uint16_t addr;
+
+	int32_t fixups; /* Backpatch list, -1 if empty */
+} Symbol;
+
+/* Open-addressed symbol table */
+typedef struct _SymTab {
+	Symbol *slots; /* Empty slots have a NULL name */
+	size_t capacity; /* Always a power of 2 */
+	size_t count;
+
+	/* Every symbol's backpatch list lives in here */
+	Fixup *fixups;
+	size_t fixupCount;
+	size_t fixupCapacity;
+} SymTab;
+
+/* Creates a new symbol table
+ *
+ * Returns EXIT_FAILURE if it fails
+ */
+int symNew(SymTab *tab);
+
+/* Finds a symbol, adding it if it doesn't exist yet
+ *
+ * The pointer is only valid until the next lookup. Returns NULL if it fails
+ */
+Symbol *symLookup(SymTab *tab, const char *name, size_t length);
+
+/* Adds a backpatch to a symbol
+ *
+ * Returns EXIT_FAILURE if it fails
+ */
+int symAddFixup(
+	SymTab *tab, Symbol *sym, uint16_t offset, FixupKind kind, int line);
+
+/* Frees the symbol table */
+void symFree(SymTab *tab);
+
+#endif // !GUARD_PROGRAM_COMPILE_SYMTAB_H_
@@ -0,0 +1,6 @@
+#ifndef GUARD_PROGRAM_TRACE_H_
+#define GUARD_PROGRAM_TRACE_H_
+
+int traceMain(int argc, char *argv[]);
+
+#endif // !GUARD_PROGRAM_TRACE_H_
@@ -0,0 +1,81 @@
+#ifndef GUARD_TRACER_H_
+#define GUARD_TRACER_H_
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include "chip8.h"
+
+/* Entries kept in the ring. Must be a power of 2 */
+#define TRACE_SIZE (1 << 16)
+
+#define TRACE_MAGIC "C8TR"
+#define TRACE_VERSION 1
+
+/* A single executed instruction, and what it left behind */
+typedef struct _TraceEntry {
+	uint16_t pc;
+	uint16_t opcode;
+	uint16_t i; /* I after the instruction */
+	uint8_t vx; /* VX after the instruction */
+	uint8_t vf; /* VF after the instruction */
+} TraceEntry;
+
+/* Ring of the last TRACE_SIZE instructions
+ *
+ * There is a single writer (the core). Anyone can read it at the same time,
+ * without locks: the head is published after the entry is written.
+ */
+typedef struct _C8Trace {
+	TraceEntry entries[TRACE_SIZE];
+	_Atomic uint64_t head; /* Entries written so far */
+} C8Trace;
+
+/* Header of a dumped trace, followed by count entries, oldest first. Both
+ * are written in the machine's byte order
+ */
+typedef struct _TraceHeader {
+	char magic[4]; /* TRACE_MAGIC */
+	uint16_t version;
+	uint16_t entrySize;
+	uint32_t count;
+	uint32_t reserved;
+	uint64_t total; /* Entries ever written, the last one is total - 1 */
+} TraceHeader;
+
+/* Creates a new, empty trace. Returns NULL if it fails */
+C8Trace *traceNew(void);
+
+/* Frees the trace. Nothing may be writing to it */
+void traceFree(C8Trace *trace);
+
+/* Records an instruction the core just executed */
+static inline void traceRecord(
+	C8Trace *trace, uint16_t pc, uint16_t opcode, const Chip8 *c8) {
+	const uint64_t HEAD
+		= atomic_load_explicit(&trace->head, memory_order_relaxed);
+
+	trace->entries[HEAD & (TRACE_SIZE - 1)] = (TraceEntry) {
+		.pc = pc,
+		.opcode = opcode,
+		.i = c8->i,
+		.vx = c8->v[(opcode >> 8) & 0xF],
+		.vf = c8->v[0xF],
+	};
+
+	atomic_store_explicit(&trace->head, HEAD + 1, memory_order_release);
+}
+
+/* Dumps the trace to a file, while the core might still be running
+ *
+ * Returns EXIT_FAILURE if it fails
+ */
+int traceDump(const C8Trace *trace, const char *PATH);
+
+/* Dumps the trace to a file if the program crashes
+ *
+ * Only one trace can be set up at a time, NULL disables it
+ */
+void traceDumpOnCrash(const C8Trace *trace, const char *PATH);
+
+#endif // !GUARD_TRACER_H_
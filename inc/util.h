@@ -1,9 +1,80 @@
 #ifndef GUARD_UTIL_H_
 #define GUARD_UTIL_H_
 
+#include <stdatomic.h>
+#include <stdbool.h>
 #include <stdlib.h>
 #include <stdint.h>
 
+/* A read-only view of a whole file */
+typedef struct _UtilMap {
+	uint8_t *data;
+	size_t size;
+	int mapped; /* Set if data came from mmap, and not from malloc */
+} UtilMap;
+
+/* Fixed-size set of 64-bit hashes, safe to insert into from many threads
+ * without locks
+ */
+typedef struct _UtilHashSet {
+	_Atomic uint64_t *slots;
+	size_t mask; /* Capacity - 1 */
+
+	atomic_size_t size;
+} UtilHashSet;
+
+/* Function run by utilParallelFor for every index. Worker is in 0..jobs */
+typedef void (*UtilTask)(void *ctx, size_t index, int worker);
+
 size_t utilLoadBinaryFile(const char *PATH, uint8_t **buffer);
 
+/* Maps a file into memory, read-only
+ *
+ * Returns EXIT_FAILURE if it fails
+ */
+int utilMapFile(const char *PATH, UtilMap *map);
+
+/* Unmaps a file mapped by utilMapFile */
+void utilUnmapFile(UtilMap *map);
+
+/* Checks if a path is a directory */
+bool utilIsDirectory(const char *PATH);
+
+/* Lists every regular, non-hidden file in a directory, sorted by name
+ *
+ * Returns EXIT_FAILURE if it fails. Free the list with utilFreeList
+ */
+int utilListFiles(const char *PATH, char ***names, size_t *count);
+
+/* Frees a list returned by utilListFiles */
+void utilFreeList(char **names, size_t count);
+
+/* Returns the number of online processors (at least 1) */
+int utilCPUCount(void);
+
+/* Runs task for every index in 0..count, spread over a number of threads
+ *
+ * Returns EXIT_FAILURE if the threads couldn't be started
+ */
+int utilParallelFor(size_t count, int jobs, UtilTask task, void *ctx);
+
+/* Hashes a block of memory (XXH64) */
+uint64_t utilHash64(const void *data, size_t size, uint64_t seed);
+
+/* Creates a hash set holding at least capacity hashes
+ *
+ * Returns EXIT_FAILURE if it fails
+ */
+int utilHashSetNew(UtilHashSet *set, size_t capacity);
+
+/* Inserts a hash into the set
+ *
+ * Returns 1 if it was inserted, 0 if it was already there and -1 if the set
+ * is full
+ */
+int utilHashSetInsert(UtilHashSet *set, uint64_t hash);
+
+/* Frees the hash set */
+void utilHashSetFree(UtilHashSet *set);
+
 #endif // !GUARD_UTIL_H_
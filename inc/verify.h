@@ -0,0 +1,6 @@
+#ifndef GUARD_PROGRAM_VERIFY_H_
+#define GUARD_PROGRAM_VERIFY_H_
+
+int verifyMain(int argc, char *argv[]);
+
+#endif // !GUARD_PROGRAM_VERIFY_H_
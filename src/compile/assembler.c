@@ -0,0 +1,731 @@
+/* cc8 compiler -- Assembler
+ *
+ * Turns cc8 assembly into a chip8 program, in a single pass over the tokens.
+ * Every line is an optional list of labels, followed by an optional mnemonic
+ * and its operands. Mnemonics are case-insensitive, and are the same ones the
+ * decompiler prints.
+ *
+ * Operands:
+ *     V0...VF ...... registers
+ *     I, DT, ST, K . special registers
+ *     PITCH ........ XO-CHIP audio pitch
+ *     [I] .......... memory starting at I
+ *     F, B ......... font/BCD, as the first operand of LD
+ *     1F, 0x1F, #31  numbers. Bare words made only of hex digits are hex
+ *     name ......... labels, anywhere an address is expected
+ */
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "assembler.h"
+
+#define MAX_OPERANDS 3
+
+typedef enum _OperandType {
+	OPERAND_V,
+	OPERAND_I,
+	OPERAND_MEM, /* [I] */
+	OPERAND_DT,
+	OPERAND_ST,
+	OPERAND_K,
+	OPERAND_PITCH,
+	OPERAND_NUMBER,
+	OPERAND_LABEL,
+} OperandType;
+
+typedef struct _Operand {
+	OperandType type;
+	uint32_t value; /* Register index, or number */
+	Token token;
+} Operand;
+
+/* A parsed instruction */
+typedef struct _Line {
+	Token mnemonic;
+	Operand operands[MAX_OPERANDS];
+	int count;
+} Line;
+
+typedef void (*MnemonicFunc)(Assembler *, const Line *, uint16_t);
+
+typedef struct _Mnemonic {
+	const char *NAME;
+	MnemonicFunc func;
+	uint16_t base; /* Opcode, for mnemonics that share a function */
+} Mnemonic;
+
+static void _error(Assembler *as, int line, const char *FMT, ...) {
+	va_list args;
+	va_start(args, FMT);
+
+	fprintf(stderr, "ERR: line %d: ", line);
+	vfprintf(stderr, FMT, args);
+	fputc('\n', stderr);
+
+	va_end(args);
+	++as->errors;
+}
+
+static void _advance(Assembler *as) {
+	as->token = lexNext(&as->lex);
+}
+
+static bool _atLineEnd(const Assembler *as) {
+	return as->token.type == TOKEN_NEWLINE || as->token.type == TOKEN_EOF;
+}
+
+static void _skipLine(Assembler *as) {
+	while( !_atLineEnd(as) ) {
+		_advance(as);
+	}
+}
+
+static char _lower(char c) {
+	return (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+}
+
+static int _hexValue(char c) {
+	if( c >= '0' && c <= '9' ) {
+		return c - '0';
+	}
+
+	c = _lower(c);
+	return (c >= 'a' && c <= 'f') ? c - 'a' + 10 : -1;
+}
+
+/* Case-insensitive comparison of a token with a word */
+static bool _matches(const Token *TOKEN, const char *WORD) {
+	size_t i = 0;
+	for( ; i < TOKEN->length; ++i ) {
+		if( WORD[i] == '\0' || _lower(TOKEN->start[i]) != _lower(WORD[i]) ) {
+			return false;
+		}
+	}
+
+	return WORD[i] == '\0';
+}
+
+/* Reads a bare hex word, like the ones the decompiler prints */
+static bool _hexWord(const Token *TOKEN, uint32_t *value) {
+	if( TOKEN->length > 4 ) {
+		return false;
+	}
+
+	*value = 0;
+	for( size_t i = 0; i < TOKEN->length; ++i ) {
+		const int DIGIT = _hexValue(TOKEN->start[i]);
+		if( DIGIT < 0 ) {
+			return false;
+		}
+
+		*value = (*value << 4) | DIGIT;
+	}
+
+	return true;
+}
+
+static bool _isRegister(const Token *TOKEN) {
+	return TOKEN->length == 2 && _lower(TOKEN->start[0]) == 'v'
+		&& _hexValue(TOKEN->start[1]) >= 0;
+}
+
+/* Words that can't be labels */
+static bool _isReserved(const Token *TOKEN) {
+	uint32_t value;
+	return _isRegister(TOKEN) || _hexWord(TOKEN, &value)
+		|| _matches(TOKEN, "I") || _matches(TOKEN, "DT")
+		|| _matches(TOKEN, "ST") || _matches(TOKEN, "K")
+		|| _matches(TOKEN, "PITCH");
+}
+
+static void _emitByte(Assembler *as, int line, uint8_t byte) {
+	if( as->size == PROGRAM_MAX_SIZE ) {
+		if( !as->full ) {
+			_error(as, line, "Program is larger than %d bytes",
+				PROGRAM_MAX_SIZE);
+			as->full = true;
+		}
+
+		return;
+	}
+
+	as->output[as->size++] = byte;
+}
+
+static void _emit(Assembler *as, int line, uint16_t word) {
+	_emitByte(as, line, word >> 8);
+	_emitByte(as, line, word & 0xFF);
+}
+
+/* Flags whatever was emitted at offset */
+static void _flag(Assembler *as, uint16_t offset, uint8_t flags) {
+	if( offset < as->size ) {
+		as->flags[offset] |= flags;
+	}
+}
+
+static void _patch(Assembler *as, uint16_t offset, FixupKind kind, uint16_t addr) {
+	/* Writes that didn't fit were never emitted */
+	if( (size_t)offset + 2 > as->size ) {
+		return;
+	}
+
+	switch( kind ) {
+	case FIXUP_ADDR:
+		as->output[offset] = (as->output[offset] & 0xF0) | (addr >> 8);
+		break;
+	case FIXUP_WORD:
+		as->output[offset] = addr >> 8;
+		break;
+	}
+
+	as->output[offset + 1] = addr & 0xFF;
+}
+
+static void _define(Assembler *as, const Token *NAME) {
+	if( _isReserved(NAME) ) {
+		_error(as, NAME->line, "'%.*s' can't be used as a label",
+			(int)NAME->length, NAME->start);
+		return;
+	}
+
+	Symbol *sym = symLookup(&as->symbols, NAME->start, NAME->length);
+	if( sym == NULL ) {
+		++as->errors;
+		return;
+	}
+
+	if( sym->defined ) {
+		_error(as, NAME->line, "Label '%.*s' is already defined",
+			(int)NAME->length, NAME->start);
+		return;
+	}
+
+	sym->defined = true;
+	sym->addr = PROGRAM_START_ADDR + as->size;
+
+	/* Backpatches every use seen so far */
+	for( int32_t i = sym->fixups; i >= 0; i = as->symbols.fixups[i].next ) {
+		const Fixup *FIX = &as->symbols.fixups[i];
+		_patch(as, FIX->offset, FIX->kind, sym->addr);
+	}
+
+	sym->fixups = -1;
+}
+
+/* Fills in a label operand at offset, now or once it gets defined */
+static void _resolve(
+	Assembler *as, const Operand *OPR, uint16_t offset, FixupKind kind) {
+	const Token *NAME = &OPR->token;
+
+	Symbol *sym = symLookup(&as->symbols, NAME->start, NAME->length);
+	if( sym == NULL ) {
+		++as->errors;
+	} else if( sym->defined ) {
+		_patch(as, offset, kind, sym->addr);
+	} else if( symAddFixup(&as->symbols, sym, offset, kind, NAME->line)
+		== EXIT_FAILURE ) {
+		++as->errors;
+	}
+}
+
+static int _parseOperand(Assembler *as, Operand *opr) {
+	const Token TOKEN = as->token;
+	*opr = (Operand) { .token = TOKEN };
+
+	switch( TOKEN.type ) {
+	case TOKEN_NUMBER:
+		opr->type = OPERAND_NUMBER;
+		opr->value = TOKEN.value;
+		break;
+	case TOKEN_LBRACKET:
+		_advance(as);
+		if( as->token.type != TOKEN_WORD || !_matches(&as->token, "I") ) {
+			_error(as, TOKEN.line, "Expected 'I' after '['");
+			return EXIT_FAILURE;
+		}
+
+		_advance(as);
+		if( as->token.type != TOKEN_RBRACKET ) {
+			_error(as, TOKEN.line, "Expected ']' after '[I'");
+			return EXIT_FAILURE;
+		}
+
+		opr->type = OPERAND_MEM;
+		break;
+	case TOKEN_WORD:
+		if( _isRegister(&TOKEN) ) {
+			opr->type = OPERAND_V;
+			opr->value = _hexValue(TOKEN.start[1]);
+		} else if( _matches(&TOKEN, "I") ) {
+			opr->type = OPERAND_I;
+		} else if( _matches(&TOKEN, "DT") ) {
+			opr->type = OPERAND_DT;
+		} else if( _matches(&TOKEN, "ST") ) {
+			opr->type = OPERAND_ST;
+		} else if( _matches(&TOKEN, "K") ) {
+			opr->type = OPERAND_K;
+		} else if( _matches(&TOKEN, "PITCH") ) {
+			opr->type = OPERAND_PITCH;
+		} else if( _hexWord(&TOKEN, &opr->value) ) {
+			opr->type = OPERAND_NUMBER;
+		} else {
+			opr->type = OPERAND_LABEL;
+		}
+		break;
+	default:
+		_error(as, TOKEN.line, "Expected an operand, got '%.*s'",
+			(int)TOKEN.length, TOKEN.start);
+		return EXIT_FAILURE;
+	}
+
+	_advance(as);
+	return EXIT_SUCCESS;
+}
+
+static int _parseOperands(Assembler *as, Line *line) {
+	line->count = 0;
+	if( _atLineEnd(as) ) {
+		return EXIT_SUCCESS;
+	}
+
+	for( ;; ) {
+		if( line->count == MAX_OPERANDS ) {
+			_error(as, as->token.line, "Too many operands");
+			return EXIT_FAILURE;
+		}
+
+		if( _parseOperand(as, &line->operands[line->count++])
+			== EXIT_FAILURE ) {
+			return EXIT_FAILURE;
+		}
+
+		if( as->token.type != TOKEN_COMMA ) {
+			break;
+		}
+
+		_advance(as);
+	}
+
+	if( !_atLineEnd(as) ) {
+		_error(as, as->token.line, "Unexpected '%.*s'",
+			(int)as->token.length, as->token.start);
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+/* Checks the operands against a form, one character per operand:
+ *     v -> register        i -> I         m -> [I]
+ *     d -> DT              s -> ST        k -> K
+ *     n -> number          a -> address (number or label)
+ *     f -> F               b -> B         p -> PITCH
+ */
+static bool _is(const Line *LINE, const char *FORM) {
+	int i = 0;
+	for( ; FORM[i]; ++i ) {
+		if( i == LINE->count ) {
+			return false;
+		}
+
+		const Operand *OPR = &LINE->operands[i];
+		bool ok = false;
+
+		switch( FORM[i] ) {
+		case 'v':
+			ok = OPR->type == OPERAND_V;
+			break;
+		case 'i':
+			ok = OPR->type == OPERAND_I;
+			break;
+		case 'm':
+			ok = OPR->type == OPERAND_MEM;
+			break;
+		case 'd':
+			ok = OPR->type == OPERAND_DT;
+			break;
+		case 's':
+			ok = OPR->type == OPERAND_ST;
+			break;
+		case 'k':
+			ok = OPR->type == OPERAND_K;
+			break;
+		case 'n':
+			ok = OPR->type == OPERAND_NUMBER;
+			break;
+		case 'a':
+			ok = OPR->type == OPERAND_NUMBER || OPR->type == OPERAND_LABEL;
+			break;
+		case 'f':
+			ok = OPR->type == OPERAND_NUMBER && _matches(&OPR->token, "F");
+			break;
+		case 'b':
+			ok = OPR->type == OPERAND_NUMBER && _matches(&OPR->token, "B");
+			break;
+		case 'p':
+			ok = OPR->type == OPERAND_PITCH;
+			break;
+		}
+
+		if( !ok ) {
+			return false;
+		}
+	}
+
+	return i == LINE->count;
+}
+
+static void _invalid(Assembler *as, const Line *LINE) {
+	_error(as, LINE->mnemonic.line, "Invalid operands for '%.*s'",
+		(int)LINE->mnemonic.length, LINE->mnemonic.start);
+}
+
+/* Operand as a number that fits in a number of bits */
+static uint16_t _number(
+	Assembler *as, const Line *LINE, int index, uint32_t max) {
+	const Operand *OPR = &LINE->operands[index];
+	if( OPR->value > max ) {
+		_error(as, LINE->mnemonic.line, "Value 0x%X is larger than 0x%X",
+			OPR->value, max);
+		return 0;
+	}
+
+	return OPR->value;
+}
+
+static uint16_t _x(const Line *LINE) {
+	return LINE->operands[0].value << 8;
+}
+
+static uint16_t _y(const Line *LINE) {
+	return LINE->operands[1].value << 4;
+}
+
+/* Emits an instruction whose operand at index is an address */
+static void _emitAddress(
+	Assembler *as, const Line *LINE, uint16_t opcode, int index) {
+	const Operand *OPR = &LINE->operands[index];
+	const uint16_t OFFSET = as->size;
+
+	if( OPR->type == OPERAND_NUMBER ) {
+		_emit(as, LINE->mnemonic.line,
+			opcode | _number(as, LINE, index, 0xFFF));
+	} else {
+		_emit(as, LINE->mnemonic.line, opcode);
+		_resolve(as, OPR, OFFSET, FIXUP_ADDR);
+	}
+
+	_flag(as, OFFSET, ASM_ADDR);
+}
+
+static void _none(Assembler *as, const Line *LINE, uint16_t base) {
+	if( _is(LINE, "") ) {
+		_emit(as, LINE->mnemonic.line, base);
+	} else {
+		_invalid(as, LINE);
+	}
+}
+
+static void _addr(Assembler *as, const Line *LINE, uint16_t base) {
+	if( _is(LINE, "a") ) {
+		_emitAddress(as, LINE, base, 0);
+	} else {
+		_invalid(as, LINE);
+	}
+}
+
+static void _jp(Assembler *as, const Line *LINE, uint16_t base) {
+	if( _is(LINE, "a") ) {
+		_emitAddress(as, LINE, 0x1000, 0);
+	} else if( _is(LINE, "va") && LINE->operands[0].value == 0 ) {
+		_emitAddress(as, LINE, 0xB000, 1);
+	} else {
+		_invalid(as, LINE);
+	}
+}
+
+/* SE and SNE, base is the byte form */
+static void _skip(Assembler *as, const Line *LINE, uint16_t base) {
+	const int LINENO = LINE->mnemonic.line;
+
+	if( _is(LINE, "vn") ) {
+		_emit(as, LINENO, base | _x(LINE) | _number(as, LINE, 1, 0xFF));
+	} else if( _is(LINE, "vv") ) {
+		_emit(as, LINENO,
+			(base == 0x3000 ? 0x5000 : 0x9000) | _x(LINE) | _y(LINE));
+	} else {
+		_invalid(as, LINE);
+	}
+}
+
+static void _ld(Assembler *as, const Line *LINE, uint16_t base) {
+	const int LINENO = LINE->mnemonic.line;
+
+	if( _is(LINE, "vn") ) {
+		_emit(as, LINENO, 0x6000 | _x(LINE) | _number(as, LINE, 1, 0xFF));
+	} else if( _is(LINE, "vv") ) {
+		_emit(as, LINENO, 0x8000 | _x(LINE) | _y(LINE));
+	} else if( _is(LINE, "ia") ) {
+		_emitAddress(as, LINE, 0xA000, 1);
+	} else if( _is(LINE, "vd") ) {
+		_emit(as, LINENO, 0xF007 | _x(LINE));
+	} else if( _is(LINE, "vk") ) {
+		_emit(as, LINENO, 0xF00A | _x(LINE));
+	} else if( _is(LINE, "vm") ) {
+		_emit(as, LINENO, 0xF065 | _x(LINE));
+	} else if( _is(LINE, "dv") ) {
+		_emit(as, LINENO, 0xF015 | LINE->operands[1].value << 8);
+	} else if( _is(LINE, "sv") ) {
+		_emit(as, LINENO, 0xF018 | LINE->operands[1].value << 8);
+	} else if( _is(LINE, "fv") ) {
+		_emit(as, LINENO, 0xF029 | LINE->operands[1].value << 8);
+	} else if( _is(LINE, "bv") ) {
+		_emit(as, LINENO, 0xF033 | LINE->operands[1].value << 8);
+	} else if( _is(LINE, "mv") ) {
+		_emit(as, LINENO, 0xF055 | LINE->operands[1].value << 8);
+	} else if( _is(LINE, "pv") ) {
+		_emit(as, LINENO, 0xF03A | LINE->operands[1].value << 8);
+	} else {
+		_invalid(as, LINE);
+	}
+}
+
+static void _add(Assembler *as, const Line *LINE, uint16_t base) {
+	const int LINENO = LINE->mnemonic.line;
+
+	if( _is(LINE, "vn") ) {
+		_emit(as, LINENO, 0x7000 | _x(LINE) | _number(as, LINE, 1, 0xFF));
+	} else if( _is(LINE, "vv") ) {
+		_emit(as, LINENO, 0x8004 | _x(LINE) | _y(LINE));
+	} else if( _is(LINE, "iv") ) {
+		_emit(as, LINENO, 0xF01E | LINE->operands[1].value << 8);
+	} else {
+		_invalid(as, LINE);
+	}
+}
+
+/* 8XY? operations */
+static void _alu(Assembler *as, const Line *LINE, uint16_t base) {
+	if( _is(LINE, "vv") ) {
+		_emit(as, LINE->mnemonic.line, base | _x(LINE) | _y(LINE));
+	} else {
+		_invalid(as, LINE);
+	}
+}
+
+/* SHR and SHL. A single register shifts itself */
+static void _shift(Assembler *as, const Line *LINE, uint16_t base) {
+	if( _is(LINE, "v") ) {
+		_emit(as, LINE->mnemonic.line, base | _x(LINE) | _x(LINE) >> 4);
+	} else {
+		_alu(as, LINE, base);
+	}
+}
+
+static void _rnd(Assembler *as, const Line *LINE, uint16_t base) {
+	if( _is(LINE, "vn") ) {
+		_emit(as, LINE->mnemonic.line,
+			0xC000 | _x(LINE) | _number(as, LINE, 1, 0xFF));
+	} else {
+		_invalid(as, LINE);
+	}
+}
+
+static void _draw(Assembler *as, const Line *LINE, uint16_t base) {
+	if( _is(LINE, "vvn") ) {
+		_emit(as, LINE->mnemonic.line,
+			0xD000 | _x(LINE) | _y(LINE) | _number(as, LINE, 2, 0xF));
+	} else {
+		_invalid(as, LINE);
+	}
+}
+
+/* SKP, SKNP */
+static void _key(Assembler *as, const Line *LINE, uint16_t base) {
+	if( _is(LINE, "v") ) {
+		_emit(as, LINE->mnemonic.line, base | _x(LINE));
+	} else {
+		_invalid(as, LINE);
+	}
+}
+
+static const Mnemonic MNEMONICS[] = {
+	{ "CLS", _none, 0x00E0 },
+	{ "RET", _none, 0x00EE },
+	{ "SYS", _addr, 0x0000 },
+	{ "JP", _jp, 0 },
+	{ "CALL", _addr, 0x2000 },
+	{ "SE", _skip, 0x3000 },
+	{ "SNE", _skip, 0x4000 },
+	{ "LD", _ld, 0 },
+	{ "ADD", _add, 0 },
+	{ "OR", _alu, 0x8001 },
+	{ "AND", _alu, 0x8002 },
+	{ "XOR", _alu, 0x8003 },
+	{ "SUB", _alu, 0x8005 },
+	{ "SHR", _shift, 0x8006 },
+	{ "SUBN", _alu, 0x8007 },
+	{ "SHL", _shift, 0x800E },
+	{ "RND", _rnd, 0 },
+	{ "DRAW", _draw, 0 },
+	{ "DRW", _draw, 0 },
+	{ "SKP", _key, 0xE09E },
+	{ "SKNP", _key, 0xE0A1 },
+	{ "AUDIO", _none, 0xF002 },
+};
+
+#define MNEMONIC_COUNT (sizeof(MNEMONICS) / sizeof(*MNEMONICS))
+
+/* DB and DW, which take any number of operands */
+static void _data(Assembler *as, const Token *MNEMONIC, bool word) {
+	if( _atLineEnd(as) ) {
+		_error(as, MNEMONIC->line, "Expected data after '%.*s'",
+			(int)MNEMONIC->length, MNEMONIC->start);
+		return;
+	}
+
+	for( ;; ) {
+		Operand opr;
+		if( _parseOperand(as, &opr) == EXIT_FAILURE ) {
+			_skipLine(as);
+			return;
+		}
+
+		if( word && opr.type == OPERAND_LABEL ) {
+			const uint16_t OFFSET = as->size;
+			_emit(as, opr.token.line, 0);
+			_resolve(as, &opr, OFFSET, FIXUP_WORD);
+			_flag(as, OFFSET, ASM_WORD);
+		} else if( opr.type != OPERAND_NUMBER ) {
+			_error(as, opr.token.line, "Expected a number, got '%.*s'",
+				(int)opr.token.length, opr.token.start);
+		} else if( opr.value > (word ? 0xFFFF : 0xFF) ) {
+			_error(as, opr.token.line, "Value 0x%X doesn't fit in a %s",
+				opr.value, word ? "word" : "byte");
+		} else if( word ) {
+			_emit(as, opr.token.line, opr.value);
+		} else {
+			_emitByte(as, opr.token.line, opr.value);
+		}
+
+		if( as->token.type != TOKEN_COMMA ) {
+			break;
+		}
+
+		_advance(as);
+	}
+
+	if( !_atLineEnd(as) ) {
+		_error(as, as->token.line, "Unexpected '%.*s'",
+			(int)as->token.length, as->token.start);
+		_skipLine(as);
+	}
+}
+
+static void _instruction(Assembler *as) {
+	Line line = { .mnemonic = as->token };
+	_advance(as);
+
+	if( _matches(&line.mnemonic, "DB") || _matches(&line.mnemonic, "DW") ) {
+		_data(as, &line.mnemonic, _matches(&line.mnemonic, "DW"));
+		return;
+	}
+
+	const Mnemonic *mnemonic = NULL;
+	for( size_t i = 0; i < MNEMONIC_COUNT; ++i ) {
+		if( _matches(&line.mnemonic, MNEMONICS[i].NAME) ) {
+			mnemonic = &MNEMONICS[i];
+			break;
+		}
+	}
+
+	if( mnemonic == NULL ) {
+		_error(as, line.mnemonic.line, "Unknown mnemonic '%.*s'",
+			(int)line.mnemonic.length, line.mnemonic.start);
+		_skipLine(as);
+		return;
+	}
+
+	if( _parseOperands(as, &line) == EXIT_FAILURE ) {
+		_skipLine(as);
+		return;
+	}
+
+	const uint16_t OFFSET = as->size;
+	mnemonic->func(as, &line, mnemonic->base);
+	_flag(as, OFFSET, ASM_CODE);
+
+	++as->instructions;
+}
+
+static void _line(Assembler *as) {
+	/* Labels, peeking ahead for the colon */
+	while( as->token.type == TOKEN_WORD ) {
+		Lexer peek = as->lex;
+		if( lexNext(&peek).type != TOKEN_COLON ) {
+			break;
+		}
+
+		_define(as, &as->token);
+		as->lex = peek;
+		_advance(as);
+	}
+
+	if( as->token.type == TOKEN_WORD ) {
+		_instruction(as);
+	} else if( !_atLineEnd(as) ) {
+		_error(as, as->token.line, "Expected a mnemonic or label, got '%.*s'",
+			(int)as->token.length, as->token.start);
+		_skipLine(as);
+	}
+
+	if( as->token.type == TOKEN_NEWLINE ) {
+		_advance(as);
+	}
+}
+
+/* Reports every use of a label that was never defined */
+static void _checkUndefined(Assembler *as) {
+	const SymTab *TAB = &as->symbols;
+
+	for( size_t i = 0; i < TAB->capacity; ++i ) {
+		const Symbol *SYM = &TAB->slots[i];
+		for( int32_t f = SYM->name ? SYM->fixups : -1; f >= 0;
+			 f = TAB->fixups[f].next ) {
+			_error(as, TAB->fixups[f].line, "Undefined label '%.*s'",
+				(int)SYM->length, SYM->name);
+		}
+	}
+}
+
+int asmNew(Assembler *as) {
+	as->size = 0;
+	as->full = false;
+	memset(as->flags, 0, sizeof(as->flags));
+	as->instructions = 0;
+	as->errors = 0;
+
+	return symNew(&as->symbols);
+}
+
+int asmAssemble(Assembler *as, const char *source, size_t size) {
+	as->lex = lexInit(source, size);
+	_advance(as);
+
+	while( as->token.type != TOKEN_EOF ) {
+		_line(as);
+	}
+
+	_checkUndefined(as);
+
+	return as->errors > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+void asmFree(Assembler *as) {
+	symFree(&as->symbols);
+}
@@ -0,0 +1,151 @@
+/* cc8 compiler -- Lexer
+ *
+ * Splits cc8 source into tokens, streaming straight over the (usually
+ * memory-mapped) source
+ */
+
+#include <stdbool.h>
+
+#include "lexer.h"
+
+Lexer lexInit(const char *source, size_t size) {
+	return (Lexer) {
+		.current = source,
+		.end = source + size,
+		.line = 1,
+	};
+}
+
+static bool _isWordChar(char c) {
+	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')
+		|| (c >= '0' && c <= '9') || c == '_' || c == '.';
+}
+
+static int _hexValue(char c) {
+	if( c >= '0' && c <= '9' ) {
+		return c - '0';
+	} else if( c >= 'a' && c <= 'f' ) {
+		return c - 'a' + 10;
+	} else if( c >= 'A' && c <= 'F' ) {
+		return c - 'A' + 10;
+	}
+
+	return -1;
+}
+
+static Token _make(Lexer *lex, TokenType type, const char *start) {
+	return (Token) {
+		.type = type,
+		.start = start,
+		.length = lex->current - start,
+		.line = lex->line,
+	};
+}
+
+static void _skipWhitespace(Lexer *lex) {
+	while( lex->current < lex->end ) {
+		switch( *lex->current ) {
+		case ' ':
+		case '\t':
+		case '\r':
+			++lex->current;
+			break;
+		/* Comments run until the end of the line */
+		case ';':
+			while( lex->current < lex->end && *lex->current != '\n' ) {
+				++lex->current;
+			}
+			break;
+		default:
+			return;
+		}
+	}
+}
+
+/* 0x-prefixed hex number */
+static Token _hex(Lexer *lex, const char *start) {
+	uint32_t value = 0;
+
+	lex->current += 2;
+	while( lex->current < lex->end && _isWordChar(*lex->current) ) {
+		const int DIGIT = _hexValue(*lex->current++);
+		if( DIGIT < 0 || value > 0xFFFF ) {
+			return _make(lex, TOKEN_ERROR, start);
+		}
+
+		value = (value << 4) | DIGIT;
+	}
+
+	Token token = _make(lex, TOKEN_NUMBER, start);
+	token.value = value;
+
+	return token.length > 2 ? token : _make(lex, TOKEN_ERROR, start);
+}
+
+/* #-prefixed decimal number */
+static Token _decimal(Lexer *lex, const char *start) {
+	uint32_t value = 0;
+
+	++lex->current;
+	while( lex->current < lex->end && _isWordChar(*lex->current) ) {
+		const char C = *lex->current++;
+		if( C < '0' || C > '9' || value > 0xFFFF ) {
+			return _make(lex, TOKEN_ERROR, start);
+		}
+
+		value = value * 10 + (C - '0');
+	}
+
+	Token token = _make(lex, TOKEN_NUMBER, start);
+	token.value = value;
+
+	return token.length > 1 ? token : _make(lex, TOKEN_ERROR, start);
+}
+
+Token lexNext(Lexer *lex) {
+	_skipWhitespace(lex);
+
+	const char *start = lex->current;
+	if( lex->current >= lex->end ) {
+		return _make(lex, TOKEN_EOF, start);
+	}
+
+	const char C = *lex->current;
+
+	if( C == '0' && lex->current + 1 < lex->end
+		&& (lex->current[1] == 'x' || lex->current[1] == 'X') ) {
+		return _hex(lex, start);
+	}
+
+	if( C == '#' ) {
+		return _decimal(lex, start);
+	}
+
+	if( _isWordChar(C) ) {
+		while( lex->current < lex->end && _isWordChar(*lex->current) ) {
+			++lex->current;
+		}
+
+		return _make(lex, TOKEN_WORD, start);
+	}
+
+	++lex->current;
+	switch( C ) {
+	case ',':
+		return _make(lex, TOKEN_COMMA, start);
+	case ':':
+		return _make(lex, TOKEN_COLON, start);
+	case '[':
+		return _make(lex, TOKEN_LBRACKET, start);
+	case ']':
+		return _make(lex, TOKEN_RBRACKET, start);
+	case '\n': {
+		/* The newline belongs to the line it ends */
+		Token token = _make(lex, TOKEN_NEWLINE, start);
+		++lex->line;
+		return token;
+	}
+	default:
+		return _make(lex, TOKEN_ERROR, start);
+	}
+}
@@ -0,0 +1,305 @@
+/* cc8 compiler -- Peephole optimiser
+ *
+ * Rewrites an assembled program, using the analyser's control-flow graph to
+ * know what is safe to touch. Removed instructions are only flagged while the
+ * passes run, so every pass works on the original offsets. The program is
+ * compacted (and every address operand relocated) at the very end.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "analyser.h"
+#include "optimiser.h"
+
+/* Longest jump chain that gets threaded */
+#define MAX_HOPS 16
+
+typedef struct _Optimiser {
+	Assembler *as;
+	const uint32_t *COUNTS;
+	OptStats *stats;
+
+	Analyser anl;
+
+	/* Per byte of the program */
+	bool referenced[PROGRAM_MAX_SIZE + 1]; /* Some operand holds its address */
+	bool deleted[PROGRAM_MAX_SIZE + 1];
+	uint16_t moved[PROGRAM_MAX_SIZE + 1]; /* Where each byte ends up */
+} Optimiser;
+
+static uint16_t _opcode(const Optimiser *opt, size_t offset) {
+	return (opt->as->output[offset] << 8) | opt->as->output[offset + 1];
+}
+
+static void _setOpcode(Optimiser *opt, size_t offset, uint16_t opcode) {
+	opt->as->output[offset] = opcode >> 8;
+	opt->as->output[offset + 1] = opcode & 0xFF;
+}
+
+static uint64_t _count(const Optimiser *opt, size_t offset) {
+	return opt->COUNTS ? opt->COUNTS[offset] : 0;
+}
+
+/* Checks if offset holds an instruction that can run */
+static bool _isCode(const Optimiser *opt, size_t offset) {
+	return offset + 1 < opt->as->size && !opt->deleted[offset]
+		&& (opt->as->flags[offset] & ASM_CODE)
+		&& (opt->anl.cfg[offset] & ANL_REACHABLE);
+}
+
+/* Checks if something other than the previous instruction leads to offset */
+static bool _isPinned(const Optimiser *opt, size_t offset) {
+	return opt->referenced[offset] || (opt->anl.cfg[offset] & ANL_TARGET);
+}
+
+/* Checks if the instruction at offset can be removed */
+static bool _isRemovable(const Optimiser *opt, size_t offset) {
+	return !_isPinned(opt, offset) && !(opt->anl.cfg[offset] & ANL_SKIPPED);
+}
+
+static void _delete(Optimiser *opt, size_t offset) {
+	opt->deleted[offset] = true;
+	opt->deleted[offset + 1] = true;
+}
+
+/* Offset of the instruction after the one at offset */
+static size_t _next(const Optimiser *opt, size_t offset) {
+	do {
+		offset += 2;
+	} while( offset < opt->as->size && opt->deleted[offset] );
+
+	return offset;
+}
+
+/* Address an operand at offset points to, if it has one */
+static bool _operand(const Optimiser *opt, size_t offset, uint16_t *addr) {
+	const uint8_t FLAGS = opt->as->flags[offset];
+	if( FLAGS & ASM_ADDR ) {
+		*addr = _opcode(opt, offset) & 0x0FFF;
+	} else if( FLAGS & ASM_WORD ) {
+		*addr = _opcode(opt, offset);
+	} else {
+		return false;
+	}
+
+	return *addr >= PROGRAM_START_ADDR
+		&& *addr <= PROGRAM_START_ADDR + opt->as->size;
+}
+
+/* Rebuilds the control-flow graph and references after the code changed */
+static int _analyse(Optimiser *opt) {
+	if( anlBuildCFG(&opt->anl) == EXIT_FAILURE ) {
+		return EXIT_FAILURE;
+	}
+
+	memset(opt->referenced, 0, sizeof(opt->referenced));
+	for( size_t i = 0; i + 1 < opt->as->size; ++i ) {
+		uint16_t addr;
+		if( !opt->deleted[i] && _operand(opt, i, &addr) ) {
+			opt->referenced[addr - PROGRAM_START_ADDR] = true;
+		}
+	}
+
+	return EXIT_SUCCESS;
+}
+
+/* 6XNN/7XNN followed by 6XMM/7XMM, on the same register */
+static void _fold(Optimiser *opt) {
+	for( size_t i = 0; i < opt->as->size; ++i ) {
+		if( !_isCode(opt, i) || (opt->anl.cfg[i] & ANL_SKIPPED) ) {
+			continue;
+		}
+
+		size_t first = i;
+		uint16_t a = _opcode(opt, first);
+
+		while( (a >> 12) == 0x6 || (a >> 12) == 0x7 ) {
+			const size_t NEXT = _next(opt, first);
+			if( !_isCode(opt, NEXT) || !_isRemovable(opt, NEXT) ) {
+				break;
+			}
+
+			const uint16_t B = _opcode(opt, NEXT);
+			if( ((B >> 12) != 0x6 && (B >> 12) != 0x7)
+				|| ((a ^ B) & 0x0F00) ) {
+				break;
+			}
+
+			if( (B >> 12) == 0x6 ) {
+				/* The first one is overwritten anyway */
+				if( !_isRemovable(opt, first) ) {
+					break;
+				}
+
+				_delete(opt, first);
+				opt->stats->saved += _count(opt, first);
+
+				first = NEXT;
+				a = B;
+			} else {
+				a = (a & 0xFF00) | ((a + B) & 0xFF);
+				_setOpcode(opt, first, a);
+
+				_delete(opt, NEXT);
+				opt->stats->saved += _count(opt, NEXT);
+			}
+
+			++opt->stats->folded;
+		}
+	}
+}
+
+/* 2NNN followed by 00EE becomes 1NNN, the subroutine returns for both */
+static void _tailCalls(Optimiser *opt) {
+	for( size_t i = 0; i < opt->as->size; ++i ) {
+		const uint16_t OPCODE = _isCode(opt, i) ? _opcode(opt, i) : 0;
+		if( (OPCODE >> 12) != 0x2 ) {
+			continue;
+		}
+
+		const size_t NEXT = _next(opt, i);
+		if( _isCode(opt, NEXT) && _opcode(opt, NEXT) == 0x00EE ) {
+			_setOpcode(opt, i, 0x1000 | (OPCODE & 0x0FFF));
+			opt->stats->saved += _count(opt, i);
+			++opt->stats->tailCalls;
+		}
+	}
+}
+
+/* Jumps and calls to a jump go straight to its target, and jumps to a return
+ * become the return
+ */
+static void _thread(Optimiser *opt) {
+	for( size_t i = 0; i < opt->as->size; ++i ) {
+		const uint16_t OPCODE = _isCode(opt, i) ? _opcode(opt, i) : 0;
+		if( (OPCODE >> 12) != 0x1 && (OPCODE >> 12) != 0x2 ) {
+			continue;
+		}
+
+		uint16_t target = OPCODE & 0x0FFF;
+		int hops = 0;
+
+		for( ; hops < MAX_HOPS; ++hops ) {
+			const size_t OFFSET = target - PROGRAM_START_ADDR;
+			if( target < PROGRAM_START_ADDR || !_isCode(opt, OFFSET) ) {
+				break;
+			}
+
+			const uint16_t NEXT = _opcode(opt, OFFSET);
+			if( (NEXT >> 12) != 0x1 || (NEXT & 0x0FFF) == target ) {
+				break;
+			}
+
+			target = NEXT & 0x0FFF;
+		}
+
+		if( hops > 0 ) {
+			_setOpcode(opt, i, (OPCODE & 0xF000) | target);
+			opt->stats->saved += _count(opt, i) * hops;
+			++opt->stats->threaded;
+		}
+
+		const size_t OFFSET = target - PROGRAM_START_ADDR;
+		if( (OPCODE >> 12) == 0x1 && target >= PROGRAM_START_ADDR
+			&& _isCode(opt, OFFSET) && _opcode(opt, OFFSET) == 0x00EE ) {
+			_setOpcode(opt, i, 0x00EE);
+			opt->as->flags[i] &= ~ASM_ADDR;
+			opt->stats->saved += _count(opt, i);
+			++opt->stats->threaded;
+		}
+	}
+}
+
+/* Unreachable code right after an unconditional jump or return */
+static void _removeDead(Optimiser *opt) {
+	for( size_t i = 0; i < opt->as->size; ++i ) {
+		const uint16_t OPCODE = _isCode(opt, i) ? _opcode(opt, i) : 0;
+		if( (OPCODE >> 12) != 0x1 && OPCODE != 0x00EE ) {
+			continue;
+		}
+
+		for( size_t dead = _next(opt, i); dead + 1 < opt->as->size;
+			 dead = _next(opt, dead) ) {
+			if( !(opt->as->flags[dead] & ASM_CODE)
+				|| (opt->anl.cfg[dead] & ANL_REACHABLE)
+				|| _isPinned(opt, dead) ) {
+				break;
+			}
+
+			_delete(opt, dead);
+			opt->stats->removed += 2;
+		}
+	}
+}
+
+/* Squeezes out the deleted bytes, fixing every address operand */
+static void _compact(Optimiser *opt) {
+	Assembler *as = opt->as;
+
+	size_t size = 0;
+	for( size_t i = 0; i <= as->size; ++i ) {
+		opt->moved[i] = size;
+		size += i < as->size && !opt->deleted[i];
+	}
+
+	for( size_t i = 0; i + 1 < as->size; ++i ) {
+		uint16_t addr;
+		if( opt->deleted[i] || !_operand(opt, i, &addr) ) {
+			continue;
+		}
+
+		const uint16_t MOVED
+			= PROGRAM_START_ADDR + opt->moved[addr - PROGRAM_START_ADDR];
+		const uint16_t MASK = (as->flags[i] & ASM_ADDR) ? 0x0FFF : 0xFFFF;
+		_setOpcode(opt, i, (_opcode(opt, i) & ~MASK) | MOVED);
+	}
+
+	for( size_t i = 0; i < as->size; ++i ) {
+		if( !opt->deleted[i] ) {
+			as->output[opt->moved[i]] = as->output[i];
+			as->flags[opt->moved[i]] = as->flags[i];
+		}
+	}
+
+	memset(&as->flags[size], 0, as->size - size);
+	as->size = size;
+}
+
+int optOptimise(Assembler *as, const uint32_t *COUNTS, OptStats *stats) {
+	Optimiser *opt = calloc(1, sizeof(*opt));
+	if( opt == NULL ) {
+		fprintf(stderr, "ERR: Couldn't allocate memory for optimiser\n");
+		return EXIT_FAILURE;
+	}
+
+	*stats = (OptStats) { 0 };
+	opt->as = as;
+	opt->COUNTS = COUNTS;
+	opt->stats = stats;
+	opt->anl = anlInit(as->output, as->size);
+
+	int result = _analyse(opt);
+	if( result == EXIT_SUCCESS ) {
+		if( !opt->anl.indirect ) {
+			_fold(opt);
+		}
+
+		_tailCalls(opt);
+		_thread(opt);
+
+		result = _analyse(opt);
+	}
+
+	if( result == EXIT_SUCCESS && !opt->anl.indirect ) {
+		_removeDead(opt);
+		_compact(opt);
+	}
+
+	anlFree(&opt->anl);
+	free(opt);
+
+	return result;
+}
@@ -0,0 +1,133 @@
+/* cc8 compiler -- Symbol table
+ *
+ * Open-addressed (linear probing) hash table of labels. Every label that is
+ * used before it's defined keeps a list of places to backpatch once it is.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "symtab.h"
+
+#define SYMTAB_START_CAPACITY 256
+
+/* FNV-1a */
+static uint32_t _hash(const char *name, size_t length) {
+	uint32_t hash = 2166136261u;
+	for( size_t i = 0; i < length; ++i ) {
+		hash = (hash ^ (uint8_t)name[i]) * 16777619u;
+	}
+
+	return hash;
+}
+
+int symNew(SymTab *tab) {
+	*tab = (SymTab) { .capacity = SYMTAB_START_CAPACITY };
+
+	tab->slots = calloc(tab->capacity, sizeof(*tab->slots));
+	if( tab->slots == NULL ) {
+		fprintf(stderr, "ERR: Couldn't allocate memory for symbol table\n");
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+static Symbol *_find(Symbol *slots, size_t mask, const char *name,
+	size_t length, uint32_t hash) {
+	for( size_t i = hash & mask;; i = (i + 1) & mask ) {
+		Symbol *sym = &slots[i];
+		if( sym->name == NULL ) {
+			return sym;
+		}
+
+		if( sym->hash == hash && sym->length == length
+			&& memcmp(sym->name, name, length) == 0 ) {
+			return sym;
+		}
+	}
+}
+
+/* Doubles the table, once it's 70% full */
+static int _grow(SymTab *tab) {
+	const size_t CAPACITY = tab->capacity * 2;
+
+	Symbol *slots = calloc(CAPACITY, sizeof(*slots));
+	if( slots == NULL ) {
+		fprintf(stderr, "ERR: Couldn't allocate memory for symbol table\n");
+		return EXIT_FAILURE;
+	}
+
+	for( size_t i = 0; i < tab->capacity; ++i ) {
+		const Symbol *SYM = &tab->slots[i];
+		if( SYM->name ) {
+			*_find(slots, CAPACITY - 1, SYM->name, SYM->length, SYM->hash)
+				= *SYM;
+		}
+	}
+
+	free(tab->slots);
+	tab->slots = slots;
+	tab->capacity = CAPACITY;
+
+	return EXIT_SUCCESS;
+}
+
+Symbol *symLookup(SymTab *tab, const char *name, size_t length) {
+	if( (tab->count + 1) * 10 > tab->capacity * 7
+		&& _grow(tab) == EXIT_FAILURE ) {
+		return NULL;
+	}
+
+	const uint32_t HASH = _hash(name, length);
+	Symbol *sym = _find(tab->slots, tab->capacity - 1, name, length, HASH);
+
+	if( sym->name == NULL ) {
+		*sym = (Symbol) {
+			.name = name,
+			.length = length,
+			.hash = HASH,
+			.fixups = -1,
+		};
+
+		++tab->count;
+	}
+
+	return sym;
+}
+
+int symAddFixup(
+	SymTab *tab, Symbol *sym, uint16_t offset, FixupKind kind, int line) {
+	if( tab->fixupCount == tab->fixupCapacity ) {
+		const size_t CAPACITY
+			= tab->fixupCapacity ? tab->fixupCapacity * 2 : 256;
+
+		Fixup *fixups = realloc(tab->fixups, CAPACITY * sizeof(*fixups));
+		if( fixups == NULL ) {
+			fprintf(stderr, "ERR: Couldn't allocate memory for fixups\n");
+			return EXIT_FAILURE;
+		}
+
+		tab->fixups = fixups;
+		tab->fixupCapacity = CAPACITY;
+	}
+
+	tab->fixups[tab->fixupCount] = (Fixup) {
+		.offset = offset,
+		.kind = kind,
+		.line = line,
+		.next = sym->fixups,
+	};
+
+	sym->fixups = tab->fixupCount++;
+
+	return EXIT_SUCCESS;
+}
+
+void symFree(SymTab *tab) {
+	free(tab->slots);
+	free(tab->fixups);
+
+	*tab = (SymTab) { 0 };
+}
@@ -4,50 +4,71 @@
  */
 
 #include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "chip8.h"
 #include "analyser.h"
 
-static void _addToVec16(Vec16 *vec16, uint16_t value) {
+static bool _addToVec16(Vec16 *vec16, uint16_t value) {
+	if( vec16->size == vec16->capacity ) {
+		const size_t CAPACITY = vec16->capacity ? vec16->capacity * 2 : 64;
+
+		uint16_t *list = realloc(vec16->list, CAPACITY * sizeof(*list));
+		if( list == NULL ) {
+			fprintf(stderr,
+				"ERR: Couldn't allocate memory (%zu bytes) for analyser\n",
+				CAPACITY * sizeof(*list));
+			return false;
+		}
+
+		vec16->list = list;
+		vec16->capacity = CAPACITY;
+	}
+
 	vec16->list[vec16->size++] = value;
+	return true;
 }
 
-static void _addJmp(Analyser *anl, uint16_t from, uint16_t to) {
-	_addToVec16(&anl->jumps, from);
-	_addToVec16(&anl->jumps, to);
+static void _freeVec16(Vec16 *vec16) {
+	free(vec16->list);
+	*vec16 = (Vec16) { 0 };
 }
 
-static void _addSub(Analyser *anl, uint16_t from, uint16_t to) {
-	_addToVec16(&anl->subroutines, from);
-	_addToVec16(&anl->subroutines, to);
+static bool _addJmp(Analyser *anl, uint16_t from, uint16_t to) {
+	return _addToVec16(&anl->jumps, from) && _addToVec16(&anl->jumps, to);
 }
 
-static void _addSkip(Analyser *anl, uint16_t from) {
-	_addToVec16(&anl->subroutines, from);
+static bool _addSub(Analyser *anl, uint16_t from, uint16_t to) {
+	return _addToVec16(&anl->subroutines, from)
+		&& _addToVec16(&anl->subroutines, to);
 }
 
-static void _analyse(Analyser *anl, size_t addr, const Instr INSTR) {
+static bool _addSkip(Analyser *anl, uint16_t from) {
+	return _addToVec16(&anl->skips, from);
+}
+
+static bool _analyse(Analyser *anl, size_t addr, const Instr INSTR) {
 	switch( INSTR.op ) {
 	case 0x1:
-		_addJmp(anl, addr, INSTR.nnn);
-		break;
+		return _addJmp(anl, addr, INSTR.nnn);
 	case 0xB:
-		_addJmp(anl, addr, INSTR.nnn | (1 << 15));
-		break;
+		return _addJmp(anl, addr, INSTR.nnn | (1 << 15));
 	case 0x2:
-		_addSub(anl, addr, INSTR.nnn);
-		break;
+		return _addSub(anl, addr, INSTR.nnn);
 	case 0x3:
 	case 0x4:
 	case 0x5:
 	case 0x9:
 	case 0xE:
-		_addSkip(anl, addr);
-		break;
+		return _addSkip(anl, addr);
 	}
+
+	return true;
 }
 
-Analyser anlInit(uint8_t *buffer, size_t size) {
+Analyser anlInit(const uint8_t *buffer, size_t size) {
 	return (Analyser) {
 		.buffer = buffer,
 		.size = size,
@@ -55,9 +76,403 @@ Analyser anlInit(uint8_t *buffer, size_t size) {
 	};
 }
 
-void anlAnalyse(Analyser *anl) {
-	for( size_t i = 0; i < anl->size; i += 2 ) {
+/* Queues an offset to be visited, if it's inside the code */
+static bool _follow(Analyser *anl, Vec16 *pending, size_t offset, uint8_t flags) {
+	if( offset + 1 >= anl->size ) {
+		return true;
+	}
+
+	anl->cfg[offset] |= flags;
+	return (anl->cfg[offset] & ANL_REACHABLE) || _addToVec16(pending, offset);
+}
+
+static Instr _instrAt(const Analyser *anl, size_t offset) {
+	return c8ParseInstruction(
+		(anl->buffer[offset] << 8) | anl->buffer[offset + 1]);
+}
+
+/* Finds every offset the instruction at offset can continue to, and the flags
+ * each is reached with. Calls continue to both the subroutine and the
+ * instruction after them. Returns how many there are, up to 2
+ */
+static int _next(const Analyser *anl, size_t offset, size_t *next,
+	uint8_t *flags) {
+	const Instr INSTR = _instrAt(anl, offset);
+	const size_t TARGET = INSTR.nnn - PROGRAM_START_ADDR;
+
+	switch( INSTR.op ) {
+	case 0x0:
+		if( INSTR.nnn == 0x0EE ) {
+			return 0;
+		}
+		break;
+	case 0x1:
+		if( INSTR.nnn < PROGRAM_START_ADDR ) {
+			return 0;
+		}
+
+		next[0] = TARGET;
+		flags[0] = ANL_TARGET;
+		return 1;
+	case 0x2:
+		next[0] = offset + 2;
+		flags[0] = 0;
+		if( INSTR.nnn < PROGRAM_START_ADDR ) {
+			return 1;
+		}
+
+		next[1] = TARGET;
+		flags[1] = ANL_TARGET;
+		return 2;
+	case 0xB:
+		return 0;
+	case 0x3:
+	case 0x4:
+	case 0x5:
+	case 0x9:
+	case 0xE:
+		next[0] = offset + 2;
+		flags[0] = ANL_SKIPPED;
+		next[1] = offset + 4;
+		flags[1] = ANL_TARGET;
+		return 2;
+	}
+
+	next[0] = offset + 2;
+	flags[0] = 0;
+	return 1;
+}
+
+/* Queues every offset the instruction at offset can continue to */
+static bool _successors(Analyser *anl, Vec16 *pending, size_t offset) {
+	if( _instrAt(anl, offset).op == 0xB ) {
+		anl->indirect = true;
+	}
+
+	size_t next[2];
+	uint8_t flags[2];
+	const int COUNT = _next(anl, offset, next, flags);
+	for( int n = 0; n < COUNT; ++n ) {
+		if( !_follow(anl, pending, next[n], flags[n]) ) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+int anlBuildCFG(Analyser *anl) {
+	anl->indirect = false;
+	free(anl->cfg);
+
+	anl->cfg = calloc(anl->size + 1, sizeof(*anl->cfg));
+	if( anl->cfg == NULL ) {
+		fprintf(stderr, "ERR: Couldn't allocate memory for analyser\n");
+		return EXIT_FAILURE;
+	}
+
+	Vec16 pending = { 0 };
+	bool ok = _follow(anl, &pending, 0, ANL_TARGET);
+
+	while( ok && pending.size > 0 ) {
+		const uint16_t OFFSET = pending.list[--pending.size];
+		if( anl->cfg[OFFSET] & ANL_REACHABLE ) {
+			continue;
+		}
+
+		anl->cfg[OFFSET] |= ANL_REACHABLE;
+		ok = _successors(anl, &pending, OFFSET);
+	}
+
+	_freeVec16(&pending);
+
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+bool anlIsCode(const Analyser *anl, size_t offset) {
+	return (anl->cfg[offset] & ANL_REACHABLE)
+		|| (offset > 0 && (anl->cfg[offset - 1] & ANL_REACHABLE));
+}
+
+/* Adds a call to the report, along with the subroutine it calls */
+static bool _addCall(AnlReport *report, uint16_t caller, uint16_t callee) {
+	for( size_t n = 0; n < report->calls.size; n += 2 ) {
+		if( report->calls.list[n] == caller
+			&& report->calls.list[n + 1] == callee ) {
+			return true;
+		}
+	}
+
+	bool known = false;
+	for( size_t n = 0; n < report->functions.size; ++n ) {
+		known |= report->functions.list[n] == callee;
+	}
+
+	return (known || _addToVec16(&report->functions, callee))
+		&& _addToVec16(&report->calls, caller)
+		&& _addToVec16(&report->calls, callee);
+}
+
+/* Follows a subroutine's own code, without going into the ones it calls,
+ * adding every call it makes
+ */
+static bool _findCalls(const Analyser *anl, AnlReport *report, uint16_t entry,
+	uint8_t *seen) {
+	memset(seen, 0, anl->size);
+
+	Vec16 pending = { 0 };
+	bool ok = _addToVec16(&pending, entry - PROGRAM_START_ADDR);
+
+	while( ok && pending.size > 0 ) {
+		const uint16_t OFFSET = pending.list[--pending.size];
+		if( (size_t)OFFSET + 1 >= anl->size || seen[OFFSET] ) {
+			continue;
+		}
+
+		seen[OFFSET] = true;
+
+		size_t next[2];
+		uint8_t flags[2];
+		const int COUNT = _next(anl, OFFSET, next, flags);
+		const bool CALL = _instrAt(anl, OFFSET).op == 0x2;
+
+		for( int n = 0; ok && n < COUNT; ++n ) {
+			if( CALL && (flags[n] & ANL_TARGET) ) {
+				ok = next[n] + 1 >= anl->size
+					|| _addCall(report, entry, next[n] + PROGRAM_START_ADDR);
+			} else {
+				ok = _addToVec16(&pending, next[n]);
+			}
+		}
+	}
+
+	_freeVec16(&pending);
+	return ok;
+}
+
+#define DEPTH_UNKNOWN -2
+#define DEPTH_VISITING -3
+
+/* Deepest the stack gets from a subroutine on, -1 if it can recurse */
+static int _depth(const AnlReport *REPORT, size_t function, int *depths) {
+	if( depths[function] == DEPTH_VISITING ) {
+		return -1;
+	} else if( depths[function] != DEPTH_UNKNOWN ) {
+		return depths[function];
+	}
+
+	depths[function] = DEPTH_VISITING;
+
+	const uint16_t ENTRY = REPORT->functions.list[function];
+	int deepest = 0;
+	for( size_t n = 0; n < REPORT->calls.size && deepest >= 0; n += 2 ) {
+		if( REPORT->calls.list[n] != ENTRY ) {
+			continue;
+		}
+
+		size_t callee = 0;
+		while( REPORT->functions.list[callee] != REPORT->calls.list[n + 1] ) {
+			++callee;
+		}
+
+		const int DEPTH = _depth(REPORT, callee, depths);
+		if( DEPTH < 0 ) {
+			deepest = -1;
+		} else if( DEPTH + 1 > deepest ) {
+			deepest = DEPTH + 1;
+		}
+	}
+
+	depths[function] = deepest;
+	return deepest;
+}
+
+/* Values of I, while following what it holds through the code */
+#define I_UNSET -1 /* Not reached yet */
+#define I_UNKNOWN -2 /* Depends on the path, or on registers */
+
+/* What I holds after an instruction */
+static int32_t _nextI(Instr instr, int32_t i) {
+	if( instr.op == 0xA ) {
+		return instr.nnn;
+	} else if( instr.op != 0xF || i == I_UNKNOWN ) {
+		return i;
+	}
+
+	switch( instr.nn ) {
+	case 0x1E:
+	case 0x29:
+		return I_UNKNOWN;
+	case 0x55:
+	case 0x65:
+		return (i + instr.x + 1) & 0xFFFF;
+	}
+
+	return i;
+}
+
+/* Works out what I holds at every instruction, where it's the same on every
+ * path. Subroutines can leave anything in I, so it's unknown after calls
+ */
+static bool _trackI(const Analyser *anl, int32_t *regI) {
+	for( size_t n = 0; n < anl->size; ++n ) {
+		regI[n] = I_UNSET;
+	}
+
+	Vec16 pending = { 0 };
+	regI[0] = 0;
+	bool ok = _addToVec16(&pending, 0);
+
+	while( ok && pending.size > 0 ) {
+		const uint16_t OFFSET = pending.list[--pending.size];
+		const Instr INSTR = _instrAt(anl, OFFSET);
+		const int32_t I = _nextI(INSTR, regI[OFFSET]);
+
+		size_t next[2];
+		uint8_t flags[2];
+		const int COUNT = _next(anl, OFFSET, next, flags);
+
+		for( int n = 0; ok && n < COUNT; ++n ) {
+			if( next[n] + 1 >= anl->size ) {
+				continue;
+			}
+
+			int32_t value = I;
+			if( INSTR.op == 0x2 && !(flags[n] & ANL_TARGET) ) {
+				value = I_UNKNOWN;
+			}
+
+			int32_t *known = &regI[next[n]];
+			if( *known == I_UNSET ) {
+				*known = value;
+			} else if( *known != value && *known != I_UNKNOWN ) {
+				*known = I_UNKNOWN;
+			} else {
+				continue;
+			}
+
+			ok = _addToVec16(&pending, next[n]);
+		}
+	}
+
+	_freeVec16(&pending);
+	return ok;
+}
+
+/* Checks every FX33 and FX55 that can execute for writes into code */
+static bool _findWrites(const Analyser *anl, AnlReport *report,
+	const int32_t *REG_I) {
+	for( size_t offset = 0; offset + 1 < anl->size; ++offset ) {
+		const Instr INSTR = _instrAt(anl, offset);
+		if( !(anl->cfg[offset] & ANL_REACHABLE) || INSTR.op != 0xF
+			|| (INSTR.nn != 0x33 && INSTR.nn != 0x55) ) {
+			continue;
+		}
+
+		const uint16_t ORIGIN = offset + PROGRAM_START_ADDR;
+		if( REG_I[offset] == I_UNKNOWN ) {
+			if( !_addToVec16(&report->unknownWrites, ORIGIN) ) {
+				return false;
+			}
+			continue;
+		}
+
+		const int SIZE = INSTR.nn == 0x33 ? 3 : INSTR.x + 1;
+		for( int n = 0; n < SIZE; ++n ) {
+			const int32_t ADDR = REG_I[offset] + n;
+			if( ADDR < PROGRAM_START_ADDR
+				|| (size_t)(ADDR - PROGRAM_START_ADDR) >= anl->size
+				|| !anlIsCode(anl, ADDR - PROGRAM_START_ADDR) ) {
+				continue;
+			}
+
+			if( !_addToVec16(&report->codeWrites, ORIGIN)
+				|| !_addToVec16(&report->codeWrites, ADDR) ) {
+				return false;
+			}
+			break;
+		}
+	}
+
+	return true;
+}
+
+int anlReport(Analyser *anl, AnlReport *report) {
+	*report = (AnlReport) { 0 };
+
+	if( anl->cfg == NULL && anlBuildCFG(anl) == EXIT_FAILURE ) {
+		return EXIT_FAILURE;
+	}
+
+	uint8_t *seen = malloc(anl->size + 1);
+	int32_t *regI = malloc((anl->size + 1) * sizeof(*regI));
+
+	/* Subroutines can start at any byte, so there's at most one per byte */
+	int *depths = malloc((anl->size + 1) * sizeof(*depths));
+	if( seen == NULL || regI == NULL || depths == NULL ) {
+		fprintf(stderr, "ERR: Couldn't allocate memory for analyser\n");
+		free(seen);
+		free(regI);
+		free(depths);
+		return EXIT_FAILURE;
+	}
+
+	bool ok = _addToVec16(&report->functions, PROGRAM_START_ADDR);
+
+	/* Subroutines found along the way are appended, and checked in turn */
+	for( size_t n = 0; ok && n < report->functions.size; ++n ) {
+		ok = _findCalls(anl, report, report->functions.list[n], seen);
+	}
+
+	if( ok ) {
+		for( size_t n = 0; n < report->functions.size; ++n ) {
+			depths[n] = DEPTH_UNKNOWN;
+		}
+
+		report->maxDepth = _depth(report, 0, depths);
+		ok = anl->size < 2 || (_trackI(anl, regI)
+			&& _findWrites(anl, report, regI));
+	}
+
+	for( size_t offset = 0; ok && offset < anl->size; ++offset ) {
+		report->unreachable += !anlIsCode(anl, offset);
+	}
+
+	free(seen);
+	free(regI);
+	free(depths);
+
+	if( !ok ) {
+		anlReportFree(report);
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+void anlReportFree(AnlReport *report) {
+	_freeVec16(&report->functions);
+	_freeVec16(&report->calls);
+	_freeVec16(&report->codeWrites);
+	_freeVec16(&report->unknownWrites);
+}
+
+int anlAnalyse(Analyser *anl) {
+	for( size_t i = 0; i + 1 < anl->size; i += 2 ) {
 		const uint16_t INSTR = (anl->buffer[i] << 8) | (anl->buffer[i + 1]);
-		_analyse(anl, i, c8ParseInstruction(INSTR));
+		if( !_analyse(anl, i, c8ParseInstruction(INSTR)) ) {
+			return EXIT_FAILURE;
+		}
 	}
+
+	return EXIT_SUCCESS;
+}
+
+void anlFree(Analyser *anl) {
+	_freeVec16(&anl->subroutines);
+	_freeVec16(&anl->jumps);
+	_freeVec16(&anl->skips);
+
+	free(anl->cfg);
+	anl->cfg = NULL;
 }
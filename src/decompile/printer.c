@@ -1,4 +1,487 @@
 /* Chip-8 decompiler -- code printer
  *
  * Helps print out the decompiled data
+ *
+ * Output goes into a large buffer that is only written out when it fills up
+ * (or when the printer is freed), so a whole program is usually written with a
+ * single fwrite. Printers without a file grow the buffer instead, keeping the
+ * whole output in memory. Nothing here goes through printf: instructions are described
+ * by small templates, which are expanded by hand.
+ *
+ * Template codes:
+ *     %x -> X nibble, as in "%X"
+ *     %w -> X nibble, as in "%x"
+ *     %y -> Y nibble
+ *     %n -> N nibble
+ *     %b -> NN byte, as in "%X"
+ *     %a -> NNN address, as in "%04X"
  */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "chip8.h"
+#include "printer.h"
+
+/* Longest possible line, used to know when to flush */
+#define LINE_MAX_SIZE 128
+
+static const char HEX_UPPER[] = "0123456789ABCDEF";
+static const char HEX_LOWER[] = "0123456789abcdef";
+
+#define VPRINT(Y, N) (verbose ? Y : N)
+
+static const char *_op0(const Instr OP, bool verbose) {
+	switch( OP.nn ) {
+	case 0xE0:
+		return VPRINT("Clear the screen", "CLS");
+	case 0xEE:
+		return VPRINT("Return from subroutine", "RET");
+	default:
+		return VPRINT("Run assembly @ %a (might be data)", "SYS %a");
+	}
+}
+
+static const char *_op1(const Instr OP, bool verbose) {
+	return VPRINT("Jump to %a", "JP %a");
+}
+
+static const char *_op2(const Instr OP, bool verbose) {
+	return VPRINT("Call subroutine @ %a", "CALL %a");
+}
+
+static const char *_op3(const Instr OP, bool verbose) {
+	return VPRINT("Skip next if V%x == %b", "SE V%x, %b");
+}
+
+static const char *_op4(const Instr OP, bool verbose) {
+	return VPRINT("Skip next if V%x != %b", "SNE V%x, %b");
+}
+
+static const char *_op5(const Instr OP, bool verbose) {
+	return VPRINT("Skip next if V%x == V%y", "SE V%x, V%y");
+}
+
+static const char *_op6(const Instr OP, bool verbose) {
+	return VPRINT("Set V%x to %b", "LD V%x, %b");
+}
+
+static const char *_op7(const Instr OP, bool verbose) {
+	return VPRINT("Add %b to V%w", "ADD V%x, %b");
+}
+
+static const char *_op8(const Instr OP, bool verbose) {
+	switch( OP.n ) {
+	case 0x0:
+		return VPRINT("Set V%x to V%y", "LD V%x, V%y");
+	case 0x1:
+		return VPRINT("OR V%x with V%y", "OR V%x, V%y");
+	case 0x2:
+		return VPRINT("AND V%x with V%y", "AND V%x, V%y");
+	case 0x3:
+		return VPRINT("XOR V%x with V%y", "XOR V%x, V%y");
+	case 0x4:
+		return VPRINT("Add V%y to V%x", "ADD V%x, V%y");
+	case 0x5:
+		return VPRINT("Subtract V%y from V%x", "SUB V%x, V%y");
+	case 0x6:
+		return VPRINT("Set V%x to V%y >> 1", "SHR V%x, V%y");
+	case 0x7:
+		return VPRINT(
+			"Subtract V%x from V%y, store in V%x", "SUBN V%x, V%y");
+	case 0xE:
+		return VPRINT("Set V%x to V%y << 1", "SHL V%x, V%y");
+	default:
+		return VPRINT("Unknown instruction (might be data)", "???");
+	}
+}
+
+static const char *_op9(const Instr OP, bool verbose) {
+	return VPRINT("Skip next if V%x != V%y", "SNE V%x, V%y");
+}
+
+static const char *_opA(const Instr OP, bool verbose) {
+	return VPRINT("Set I to %a", "LD I, %a");
+}
+
+static const char *_opB(const Instr OP, bool verbose) {
+	return VPRINT("Jump to V0 + %a", "JP V0, %a");
+}
+
+static const char *_opC(const Instr OP, bool verbose) {
+	return VPRINT("Set V%x to random byte w/ mask %b", "RND V%x, %b");
+}
+
+static const char *_opD(const Instr OP, bool verbose) {
+	return VPRINT(
+		"Draw %n-byte long sprite to (V%x, V%y)", "DRAW V%x, V%y, %n");
+}
+
+static const char *_opE(const Instr OP, bool verbose) {
+	switch( OP.nn ) {
+	case 0x9E:
+		return VPRINT("Skip next if key %x is pressed", "SKP V%x");
+	case 0xA1:
+		return VPRINT("Skip next if key %x is not pressed", "SKNP V%x");
+	default:
+		return VPRINT("Unknown instruction (might be data)", "???");
+	}
+}
+
+static const char *_opF(const Instr OP, bool verbose) {
+	switch( OP.nn ) {
+	case 0x02:
+		if( OP.x != 0 ) {
+			break;
+		}
+
+		return VPRINT("Load audio pattern from I...I+15", "AUDIO");
+	case 0x07:
+		return VPRINT("Load delay timer into V%x", "LD V%x, DT");
+	case 0x0A:
+		return VPRINT("Wait for key, store in V%x", "LD V%x, K");
+	case 0x15:
+		return VPRINT("Set delay timer to V%x", "LD DT, V%x");
+	case 0x18:
+		return VPRINT("Set sound timer to V%x", "LD ST, V%x");
+	case 0x1E:
+		return VPRINT("Add V%x to I", "ADD I, V%x");
+	case 0x29:
+		return VPRINT("Load digit V%x address into I", "LD F, V%x");
+	case 0x3A:
+		return VPRINT("Set audio pitch to V%x", "LD PITCH, V%x");
+	case 0x33:
+		return VPRINT("Store BCD of V%x into I...I+2", "LD B, V%x");
+	case 0x55:
+		return VPRINT("Store V0...V%x starting at I", "LD [I], V%x");
+	case 0x65:
+		return VPRINT("Read V0...V%x starting at I", "LD V%x, [I]");
+	}
+
+	return VPRINT("Unknown instruction (might be data)", "???");
+}
+
+typedef const char *(*templateFunc)(Instr, bool);
+
+static const templateFunc opTable[] = {
+	_op0,
+	_op1,
+	_op2,
+	_op3,
+	_op4,
+	_op5,
+	_op6,
+	_op7,
+	_op8,
+	_op9,
+	_opA,
+	_opB,
+	_opC,
+	_opD,
+	_opE,
+	_opF,
+};
+
+static void _reserve(Printer *prt, size_t size) {
+	if( prt->size + size <= prt->capacity ) {
+		return;
+	}
+
+	if( prt->file ) {
+		prtFlush(prt);
+		return;
+	}
+
+	const size_t CAPACITY = prt->capacity * 2 + size;
+	char *buffer = realloc(prt->buffer, CAPACITY);
+	if( buffer == NULL ) {
+		fprintf(stderr,
+			"ERR: Couldn't allocate memory (%zu bytes) for printer\n", CAPACITY);
+		abort();
+	}
+
+	prt->buffer = buffer;
+	prt->capacity = CAPACITY;
+}
+
+int prtNew(Printer *prt, FILE *file, PrtFormat format, bool verbose) {
+	prt->file = file;
+	prt->format = format;
+	/* English can't be assembled back */
+	prt->verbose = verbose && format != PRT_FORMAT_ASM;
+	prt->size = 0;
+	prt->capacity = PRT_BUFFER_SIZE;
+	prt->count = 0;
+
+	prt->buffer = malloc(PRT_BUFFER_SIZE);
+	if( prt->buffer == NULL ) {
+		fprintf(stderr,
+			"ERR: Couldn't allocate memory (%d bytes) for printer\n",
+			PRT_BUFFER_SIZE);
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+void prtReset(Printer *prt, FILE *file) {
+	prtFlush(prt);
+
+	prt->file = file;
+	prt->size = 0;
+	prt->count = 0;
+}
+
+void prtChar(Printer *prt, char c) {
+	_reserve(prt, 1);
+	prt->buffer[prt->size++] = c;
+}
+
+void prtString(Printer *prt, const char *STR) {
+	size_t len = strlen(STR);
+
+	while( len > 0 ) {
+		_reserve(prt, len < LINE_MAX_SIZE ? len : LINE_MAX_SIZE);
+
+		size_t chunk = prt->capacity - prt->size;
+		if( chunk > len ) {
+			chunk = len;
+		}
+
+		memcpy(&prt->buffer[prt->size], STR, chunk);
+		prt->size += chunk;
+
+		STR += chunk;
+		len -= chunk;
+	}
+}
+
+static void _hex(Printer *prt, uint32_t value, int digits, const char *TABLE) {
+	char tmp[8];
+	int len = 0;
+
+	do {
+		tmp[len++] = TABLE[value & 0xF];
+		value >>= 4;
+	} while( value > 0 );
+
+	_reserve(prt, 8);
+
+	while( digits-- > len ) {
+		prt->buffer[prt->size++] = '0';
+	}
+
+	while( len > 0 ) {
+		prt->buffer[prt->size++] = tmp[--len];
+	}
+}
+
+void prtHex(Printer *prt, uint32_t value, int digits) {
+	_hex(prt, value, digits, HEX_UPPER);
+}
+
+void prtDecimal(Printer *prt, size_t value) {
+	char tmp[20];
+	int len = 0;
+
+	do {
+		tmp[len++] = '0' + (value % 10);
+		value /= 10;
+	} while( value > 0 );
+
+	_reserve(prt, sizeof(tmp));
+
+	while( len > 0 ) {
+		prt->buffer[prt->size++] = tmp[--len];
+	}
+}
+
+/* Writes a string as a JSON string literal */
+static void _jsonString(Printer *prt, const char *STR) {
+	prtChar(prt, '"');
+
+	for( ; *STR; ++STR ) {
+		const unsigned char C = *STR;
+		if( C == '"' || C == '\\' ) {
+			prtChar(prt, '\\');
+			prtChar(prt, C);
+		} else if( C < 0x20 ) {
+			prtString(prt, "\\u");
+			prtHex(prt, C, 4);
+		} else {
+			prtChar(prt, C);
+		}
+	}
+
+	prtChar(prt, '"');
+}
+
+void prtMnemonic(Printer *prt, const Instr INSTR) {
+	const char *tmpl = opTable[INSTR.op](INSTR, prt->verbose);
+
+	_reserve(prt, LINE_MAX_SIZE);
+
+	for( ; *tmpl; ++tmpl ) {
+		if( *tmpl != '%' ) {
+			prt->buffer[prt->size++] = *tmpl;
+			continue;
+		}
+
+		switch( *++tmpl ) {
+		case 'x':
+			prt->buffer[prt->size++] = HEX_UPPER[INSTR.x];
+			break;
+		case 'w':
+			prt->buffer[prt->size++] = HEX_LOWER[INSTR.x];
+			break;
+		case 'y':
+			prt->buffer[prt->size++] = HEX_UPPER[INSTR.y];
+			break;
+		case 'n':
+			prt->buffer[prt->size++] = HEX_UPPER[INSTR.n];
+			break;
+		case 'b':
+			prtHex(prt, INSTR.nn, 1);
+			break;
+		case 'a':
+			prtHex(prt, INSTR.nnn, 4);
+			break;
+		}
+	}
+}
+
+static uint16_t _getraw(const Instr OP) {
+	return (OP.op << 12) | OP.nnn;
+}
+
+/* Checks if the mnemonic assembles back into the exact same opcode */
+static bool _isCanonical(const Instr OP) {
+	switch( OP.op ) {
+	case 0x0:
+		return (OP.nn != 0xE0 && OP.nn != 0xEE) || OP.x == 0;
+	case 0x5:
+	case 0x9:
+		return OP.n == 0;
+	default:
+		return opTable[OP.op](OP, false)[0] != '?';
+	}
+}
+
+void prtHeader(Printer *prt, const char *NAME, size_t size) {
+	switch( prt->format ) {
+	case PRT_FORMAT_TEXT:
+		prtString(prt, NAME);
+		prtString(prt, ", ");
+		prtDecimal(prt, size);
+		prtString(prt, " bytes long\n\n");
+		break;
+	case PRT_FORMAT_ASM:
+		prtString(prt, "; ");
+		prtString(prt, NAME);
+		prtString(prt, ", ");
+		prtDecimal(prt, size);
+		prtString(prt, " bytes long\n\n");
+		break;
+	case PRT_FORMAT_JSON:
+		prtString(prt, "{\"file\": ");
+		_jsonString(prt, NAME);
+		prtString(prt, ", \"size\": ");
+		prtDecimal(prt, size);
+		prtString(prt, ", \"instructions\": [");
+		break;
+	}
+}
+
+void prtInstruction(Printer *prt, uint16_t addr, const Instr INSTR) {
+	switch( prt->format ) {
+	case PRT_FORMAT_TEXT:
+		prtString(prt, "0x");
+		prtHex(prt, addr, 4);
+		prtString(prt, ": ");
+		prtHex(prt, _getraw(INSTR), 4);
+		prtChar(prt, ' ');
+		prtMnemonic(prt, INSTR);
+		prtChar(prt, '\n');
+		break;
+	case PRT_FORMAT_JSON:
+		/* The templates never contain characters that need escaping */
+		prtString(prt, prt->count > 0 ? ",\n\t" : "\n\t");
+		prtString(prt, "{\"addr\": \"0x");
+		prtHex(prt, addr, 4);
+		prtString(prt, "\", \"raw\": \"");
+		prtHex(prt, _getraw(INSTR), 4);
+		prtString(prt, "\", \"asm\": \"");
+		prtMnemonic(prt, INSTR);
+		prtString(prt, "\"}");
+		break;
+	case PRT_FORMAT_ASM:
+		/* Data (or odd encodings) is kept as-is */
+		if( _isCanonical(INSTR) ) {
+			prtMnemonic(prt, INSTR);
+		} else {
+			prtString(prt, "DW ");
+			prtHex(prt, _getraw(INSTR), 4);
+		}
+
+		prtChar(prt, '\n');
+		break;
+	}
+
+	++prt->count;
+}
+
+void prtTrailingByte(Printer *prt, uint16_t addr, uint8_t byte) {
+	if( prt->format != PRT_FORMAT_ASM ) {
+		/* Listings show it as an instruction, padded with a zero */
+		prtInstruction(prt, addr, c8ParseInstruction(byte << 8));
+		return;
+	}
+
+	prtString(prt, "DB ");
+	prtHex(prt, byte, 2);
+	prtChar(prt, '\n');
+	++prt->count;
+}
+
+void prtFooter(Printer *prt) {
+	if( prt->format == PRT_FORMAT_JSON ) {
+		prtString(prt, "\n]}\n");
+	}
+}
+
+void prtProgram(
+	Printer *prt, const char *NAME, const uint8_t *program, size_t size) {
+	prtHeader(prt, NAME, size);
+
+	size_t i = 0;
+	for( ; i + 1 < size; i += 2 ) {
+		const uint16_t INSTR = (program[i] << 8) | program[i + 1];
+		prtInstruction(
+			prt, PROGRAM_START_ADDR + i, c8ParseInstruction(INSTR));
+	}
+
+	if( i < size ) {
+		prtTrailingByte(prt, PROGRAM_START_ADDR + i, program[i]);
+	}
+
+	prtFooter(prt);
+}
+
+void prtFlush(Printer *prt) {
+	if( prt->size == 0 || prt->file == NULL ) {
+		return;
+	}
+
+	if( fwrite(prt->buffer, 1, prt->size, prt->file) < prt->size ) {
+		fprintf(stderr, "ERR: Couldn't write decompiled output\n");
+	}
+
+	prt->size = 0;
+}
+
+void prtFree(Printer *prt) {
+	prtFlush(prt);
+
+	free(prt->buffer);
+	prt->buffer = NULL;
+}
@@ -0,0 +1,156 @@
+/* Chip-8 audio
+ *
+ * Plays the interpreter's audio pattern (a buzzer, unless an XO-CHIP program
+ * loads its own) while the sound timer runs. Samples are produced by the
+ * emulator, in step with wall-clock time, and drained by the SDL audio
+ * callback through a lock-free ring
+ */
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "audio.h"
+#include "chip8.h"
+
+#define VOLUME 4096
+
+/* Bits in a pattern */
+#define PATTERN_BITS (AUDIO_PATTERN_SIZE * 8)
+
+/* Consumer side, runs on SDL's audio thread */
+static void _callback(void *userdata, Uint8 *stream, int len) {
+	Audio *audio = userdata;
+	AudioRing *ring = &audio->ring;
+
+	int16_t *out = (int16_t *)stream;
+	const size_t COUNT = len / sizeof(*out);
+
+	const uint64_t TAIL
+		= atomic_load_explicit(&ring->tail, memory_order_relaxed);
+	const uint64_t HEAD
+		= atomic_load_explicit(&ring->head, memory_order_acquire);
+
+	const size_t AVAILABLE = HEAD - TAIL;
+	const size_t READ = AVAILABLE < COUNT ? AVAILABLE : COUNT;
+
+	for( size_t n = 0; n < READ; ++n ) {
+		out[n] = ring->samples[(TAIL + n) & (AUDIO_RING_SIZE - 1)];
+	}
+
+	atomic_store_explicit(&ring->tail, TAIL + READ, memory_order_release);
+
+	if( READ == COUNT ) {
+		return;
+	}
+
+	memset(out + READ, 0, (COUNT - READ) * sizeof(*out));
+	if( atomic_load_explicit(&audio->playing, memory_order_relaxed) ) {
+		atomic_fetch_add_explicit(&audio->underruns, 1, memory_order_relaxed);
+	}
+}
+
+int audioNew(Audio *audio) {
+	memset(audio, 0, sizeof(*audio));
+	atomic_init(&audio->ring.head, 0);
+	atomic_init(&audio->ring.tail, 0);
+	atomic_init(&audio->playing, false);
+	atomic_init(&audio->underruns, 0);
+	atomic_init(&audio->overruns, 0);
+
+	audio->start = SDL_GetPerformanceCounter();
+
+	const SDL_AudioSpec WANTED = {
+		.freq = AUDIO_RATE,
+		.format = AUDIO_S16SYS,
+		.channels = 1,
+		.samples = AUDIO_DEVICE_SAMPLES,
+		.callback = _callback,
+		.userdata = audio,
+	};
+
+	/* No changes allowed, so samples can go straight to the device */
+	audio->device = SDL_OpenAudioDevice(NULL, 0, &WANTED, NULL, 0);
+	if( audio->device == 0 ) {
+		fprintf(stderr, "ERR: Failed to open audio device: %s\n",
+			SDL_GetError());
+		return EXIT_FAILURE;
+	}
+
+	SDL_PauseAudioDevice(audio->device, 0);
+	return EXIT_SUCCESS;
+}
+
+/* Bits of the pattern played per sample */
+static double _step(uint8_t pitch) {
+	return 4000.0 * pow(2.0, (pitch - 64) / 48.0) / AUDIO_RATE;
+}
+
+void audioPump(Audio *audio, const Chip8 *C8) {
+	AudioRing *ring = &audio->ring;
+
+	/* Nobody would ever drain the ring */
+	if( audio->device == 0 ) {
+		return;
+	}
+
+	const double ELAPSED = SDL_GetPerformanceCounter() - audio->start;
+	const uint64_t DUE
+		= ELAPSED * AUDIO_RATE / SDL_GetPerformanceFrequency() + AUDIO_LATENCY;
+
+	if( DUE <= audio->produced ) {
+		return;
+	}
+
+	const uint64_t HEAD
+		= atomic_load_explicit(&ring->head, memory_order_relaxed);
+	const uint64_t TAIL
+		= atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+	const bool PLAYING = C8->timers.st > 0;
+	const double STEP = _step(C8->pitch);
+
+	atomic_store_explicit(&audio->playing, PLAYING, memory_order_relaxed);
+
+	/* Whatever doesn't fit is dropped, to catch up with the clock. Silence
+	 * owed from a park isn't worth counting
+	 */
+	size_t count = DUE - audio->produced;
+	const size_t ROOM = AUDIO_RING_SIZE - (HEAD - TAIL);
+	if( count > ROOM ) {
+		count = ROOM;
+		if( PLAYING ) {
+			atomic_fetch_add_explicit(
+				&audio->overruns, 1, memory_order_relaxed);
+		}
+	}
+
+	for( size_t n = 0; n < count; ++n ) {
+		int16_t sample = 0;
+
+		if( PLAYING ) {
+			const int BIT = (int)audio->phase;
+			const bool ON = (C8->pattern[BIT >> 3] >> (7 - (BIT & 7))) & 1;
+			sample = ON ? VOLUME : -VOLUME;
+
+			audio->phase += STEP;
+			if( audio->phase >= PATTERN_BITS ) {
+				audio->phase -= PATTERN_BITS;
+			}
+		}
+
+		ring->samples[(HEAD + n) & (AUDIO_RING_SIZE - 1)] = sample;
+	}
+
+	atomic_store_explicit(&ring->head, HEAD + count, memory_order_release);
+	audio->produced = DUE;
+}
+
+void audioFree(Audio *audio) {
+	if( audio->device != 0 ) {
+		SDL_CloseAudioDevice(audio->device);
+		audio->device = 0;
+	}
+}
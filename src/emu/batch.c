@@ -0,0 +1,343 @@
+/* Chip-8 lockstep batch engine
+ *
+ * Steps many interpreters at once. Every cycle, lane 0 decides the
+ * instruction, and every lane sitting on the same instruction executes it
+ * along with it. Only simple register instructions are executed in lockstep,
+ * everything else (and every lane that wandered off) goes through c8Cycle
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "batch.h"
+#include "chip8.h"
+
+int c8BatchNew(Chip8Batch *batch, const C8Image *IMAGE, size_t count) {
+	*batch = (Chip8Batch) { .count = count };
+
+	batch->lanes = calloc(count, sizeof(*batch->lanes));
+	batch->pc = calloc(count, sizeof(*batch->pc));
+	batch->i = calloc(count, sizeof(*batch->i));
+	batch->v[0] = calloc(count * 16, sizeof(*batch->v[0]));
+	batch->active = calloc(count, sizeof(*batch->active));
+
+	if( !batch->lanes || !batch->pc || !batch->i || !batch->v[0]
+		|| !batch->active ) {
+		fprintf(stderr, "ERR: Couldn't allocate memory for %zu lanes\n", count);
+		c8BatchFree(batch);
+		return EXIT_FAILURE;
+	}
+
+	for( int reg = 1; reg < 16; ++reg ) {
+		batch->v[reg] = batch->v[0] + reg * count;
+	}
+
+	for( size_t lane = 0; lane < count; ++lane ) {
+		batch->lanes[lane] = c8NewShared(IMAGE);
+		c8Seed(&batch->lanes[lane], lane + 1);
+
+		c8BatchPush(batch, lane);
+	}
+
+	return EXIT_SUCCESS;
+}
+
+Chip8 *c8BatchPull(Chip8Batch *batch, size_t lane) {
+	Chip8 *c8 = &batch->lanes[lane];
+
+	c8->pc = batch->pc[lane];
+	c8->i = batch->i[lane];
+	for( int reg = 0; reg < 16; ++reg ) {
+		c8->v[reg] = batch->v[reg][lane];
+	}
+
+	return c8;
+}
+
+void c8BatchPush(Chip8Batch *batch, size_t lane) {
+	const Chip8 *C8 = &batch->lanes[lane];
+
+	batch->pc[lane] = C8->pc;
+	batch->i[lane] = C8->i;
+	for( int reg = 0; reg < 16; ++reg ) {
+		batch->v[reg][lane] = C8->v[reg];
+	}
+}
+
+static uint16_t _fetch(const Chip8Batch *batch, size_t lane) {
+	const Chip8 *C8 = &batch->lanes[lane];
+	const uint16_t PC = batch->pc[lane];
+
+	return (c8ReadByte(C8, PC) << 8) | c8ReadByte(C8, PC + 1);
+}
+
+/* Checks if a lane is about to run the same instruction as lane 0 */
+static bool _agrees(const Chip8Batch *batch, size_t lane, uint16_t opcode) {
+	const uint16_t PC = batch->pc[0];
+	if( batch->pc[lane] != PC ) {
+		return false;
+	}
+
+	/* Traces are only recorded by c8Cycle, which also faults on fetches past
+	 * the end of memory in checked builds
+	 */
+	if( batch->lanes[lane].trace ) {
+		return false;
+	}
+
+#ifdef C8_CHECKED
+	if( PC > MEM_SIZE - 2 ) {
+		return false;
+	}
+#endif
+
+	/* Lanes sharing the code's pages can't possibly disagree */
+	const Chip8 *LEADER = &batch->lanes[0];
+	const Chip8 *C8 = &batch->lanes[lane];
+	const int FIRST = (PC & (MEM_SIZE - 1)) >> PAGE_BITS;
+	const int LAST = ((PC + 1) & (MEM_SIZE - 1)) >> PAGE_BITS;
+
+	if( C8->pages[FIRST] == LEADER->pages[FIRST]
+		&& C8->pages[LAST] == LEADER->pages[LAST] ) {
+		return true;
+	}
+
+	return _fetch(batch, lane) == opcode;
+}
+
+/* Instructions that only touch PC, I and V, and can run in lockstep */
+static bool _isLockstep(const Instr OP) {
+	switch( OP.op ) {
+	case 0x1:
+	case 0x3:
+	case 0x4:
+	case 0x5:
+	case 0x6:
+	case 0x7:
+	case 0x9:
+	case 0xA:
+		return true;
+	/* Unknown ones are left to c8Cycle, which reports them */
+	case 0x8:
+		return OP.n <= 0x7 || OP.n == 0xE;
+	case 0xF:
+		return OP.nn == 0x1E || OP.nn == 0x29;
+	default:
+		return false;
+	}
+}
+
+/* 8??? opcodes, in lockstep
+ *
+ * Every loop writes VX before VF, same as c8Cycle, so X = F behaves the same
+ */
+static void _lockstep8(Chip8Batch *batch, const Instr OP) {
+	const size_t COUNT = batch->count;
+	const uint8_t *ACTIVE = batch->active;
+
+	uint8_t *vx = batch->v[OP.x];
+	uint8_t *vy = batch->v[OP.y];
+	uint8_t *vf = batch->v[0xF];
+
+	switch( OP.n ) {
+	case 0x0:
+		for( size_t l = 0; l < COUNT; ++l ) {
+			vx[l] = ACTIVE[l] ? vy[l] : vx[l];
+		}
+		break;
+	case 0x1:
+		for( size_t l = 0; l < COUNT; ++l ) {
+			vx[l] = ACTIVE[l] ? vx[l] | vy[l] : vx[l];
+		}
+		break;
+	case 0x2:
+		for( size_t l = 0; l < COUNT; ++l ) {
+			vx[l] = ACTIVE[l] ? vx[l] & vy[l] : vx[l];
+		}
+		break;
+	case 0x3:
+		for( size_t l = 0; l < COUNT; ++l ) {
+			vx[l] = ACTIVE[l] ? vx[l] ^ vy[l] : vx[l];
+		}
+		break;
+	case 0x4:
+		for( size_t l = 0; l < COUNT; ++l ) {
+			const uint16_t VALUE = vx[l] + vy[l];
+			vx[l] = ACTIVE[l] ? (uint8_t)VALUE : vx[l];
+			vf[l] = ACTIVE[l] ? VALUE > UINT8_MAX : vf[l];
+		}
+		break;
+	case 0x5:
+		for( size_t l = 0; l < COUNT; ++l ) {
+			const uint8_t LARGER = vx[l] >= vy[l];
+			vx[l] = ACTIVE[l] ? vx[l] - vy[l] : vx[l];
+			vf[l] = ACTIVE[l] ? LARGER : vf[l];
+		}
+		break;
+	case 0x6:
+		for( size_t l = 0; l < COUNT; ++l ) {
+			const uint8_t LSB = vx[l] & 1;
+			vx[l] = ACTIVE[l] ? vy[l] >> 1 : vx[l];
+			vf[l] = ACTIVE[l] ? LSB : vf[l];
+		}
+		break;
+	case 0x7:
+		for( size_t l = 0; l < COUNT; ++l ) {
+			const uint8_t LARGER = vy[l] >= vx[l];
+			vx[l] = ACTIVE[l] ? vy[l] - vx[l] : vx[l];
+			vf[l] = ACTIVE[l] ? LARGER : vf[l];
+		}
+		break;
+	case 0xE:
+		for( size_t l = 0; l < COUNT; ++l ) {
+			const uint8_t MSB = vx[l] >> 7;
+			vx[l] = ACTIVE[l] ? vy[l] << 1 : vx[l];
+			vf[l] = ACTIVE[l] ? MSB : vf[l];
+		}
+		break;
+	}
+}
+
+/* Executes an instruction on every active lane */
+static void _lockstep(Chip8Batch *batch, const Instr OP) {
+	const size_t COUNT = batch->count;
+	const uint8_t *ACTIVE = batch->active;
+
+	uint16_t *pc = batch->pc;
+	uint16_t *i = batch->i;
+	uint8_t *vx = batch->v[OP.x];
+	uint8_t *vy = batch->v[OP.y];
+
+	switch( OP.op ) {
+	/* 1NNN -> Jump to address NNN */
+	case 0x1:
+		for( size_t l = 0; l < COUNT; ++l ) {
+			pc[l] = ACTIVE[l] ? OP.nnn : pc[l];
+		}
+		return;
+	/* 3XNN -> Skip next if VX == NN */
+	case 0x3:
+		for( size_t l = 0; l < COUNT; ++l ) {
+			pc[l] += (ACTIVE[l] & (vx[l] == OP.nn)) << 1;
+		}
+		break;
+	/* 4XNN -> Skip next if VX != NN */
+	case 0x4:
+		for( size_t l = 0; l < COUNT; ++l ) {
+			pc[l] += (ACTIVE[l] & (vx[l] != OP.nn)) << 1;
+		}
+		break;
+	/* 5XY0 -> Skip next if VX == VY */
+	case 0x5:
+		for( size_t l = 0; l < COUNT; ++l ) {
+			pc[l] += (ACTIVE[l] & (vx[l] == vy[l])) << 1;
+		}
+		break;
+	/* 6XNN -> Set VX to NN */
+	case 0x6:
+		for( size_t l = 0; l < COUNT; ++l ) {
+			vx[l] = ACTIVE[l] ? OP.nn : vx[l];
+		}
+		break;
+	/* 7XNN -> Add NN to VX */
+	case 0x7:
+		for( size_t l = 0; l < COUNT; ++l ) {
+			vx[l] += ACTIVE[l] ? OP.nn : 0;
+		}
+		break;
+	case 0x8:
+		_lockstep8(batch, OP);
+		break;
+	/* 9XY0 -> Skip next if VX != VY */
+	case 0x9:
+		for( size_t l = 0; l < COUNT; ++l ) {
+			pc[l] += (ACTIVE[l] & (vx[l] != vy[l])) << 1;
+		}
+		break;
+	/* ANNN -> Set I to NNN */
+	case 0xA:
+		for( size_t l = 0; l < COUNT; ++l ) {
+			i[l] = ACTIVE[l] ? OP.nnn : i[l];
+		}
+		break;
+	case 0xF:
+		/* FX1E -> Add the value in VX to I */
+		if( OP.nn == 0x1E ) {
+			for( size_t l = 0; l < COUNT; ++l ) {
+				i[l] += ACTIVE[l] ? vx[l] : 0;
+			}
+		}
+
+		/* FX29 -> Set I to the address of the sprite for the digit VX */
+		if( OP.nn == 0x29 ) {
+			for( size_t l = 0; l < COUNT; ++l ) {
+				i[l] = ACTIVE[l] ? FONT_START_ADDR + vx[l] * 5 : i[l];
+			}
+		}
+		break;
+	}
+
+	/* Advance */
+	for( size_t l = 0; l < COUNT; ++l ) {
+		pc[l] += ACTIVE[l] << 1;
+	}
+}
+
+/* Runs a single lane through c8Cycle */
+static void _scalar(Chip8Batch *batch, size_t lane) {
+	c8Cycle(c8BatchPull(batch, lane));
+	c8BatchPush(batch, lane);
+}
+
+static void _step(Chip8Batch *batch) {
+	const uint16_t OPCODE = _fetch(batch, 0);
+	const Instr OP = c8ParseInstruction(OPCODE);
+
+	if( !_isLockstep(OP) ) {
+		for( size_t l = 0; l < batch->count; ++l ) {
+			_scalar(batch, l);
+		}
+
+		return;
+	}
+
+	for( size_t l = 0; l < batch->count; ++l ) {
+		batch->active[l] = _agrees(batch, l, OPCODE);
+	}
+
+	_lockstep(batch, OP);
+
+	for( size_t l = 0; l < batch->count; ++l ) {
+		if( !batch->active[l] ) {
+			_scalar(batch, l);
+		}
+	}
+}
+
+void c8BatchStep(Chip8Batch *batch, size_t cycles) {
+	if( batch->count == 0 ) {
+		return;
+	}
+
+	while( cycles-- > 0 ) {
+		_step(batch);
+	}
+}
+
+void c8BatchFree(Chip8Batch *batch) {
+	if( batch->lanes ) {
+		for( size_t lane = 0; lane < batch->count; ++lane ) {
+			c8Free(&batch->lanes[lane]);
+		}
+	}
+
+	free(batch->lanes);
+	free(batch->pc);
+	free(batch->i);
+	free(batch->v[0]);
+	free(batch->active);
+
+	*batch = (Chip8Batch) { 0 };
+}
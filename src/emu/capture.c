@@ -0,0 +1,341 @@
+/* Frame capture
+ *
+ * Displays are copied out on the capturing thread, and turned into PNGs or a
+ * PackBits video stream on an encoder thread. Chip-8 programs redraw the same
+ * frame over and over, so repeats are skipped before they're ever queued
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "capture.h"
+
+#define FPS 60
+
+#define PATH_SIZE 4096
+
+/* Bytes in a packed display */
+#define PACKED_SIZE (SCR_HEIGHT * sizeof(uint64_t))
+
+/* PackBits can grow data by a byte for every 128 */
+#define RLE_SIZE (PACKED_SIZE + PACKED_SIZE / 128 + 1)
+
+/* Packs a display into bytes, leftmost pixel in the highest bit */
+static void _pack(const uint64_t *DISPLAY, uint8_t *packed) {
+	for( int y = 0; y < SCR_HEIGHT; ++y ) {
+		for( int byte = 0; byte < 8; ++byte ) {
+			packed[y * 8 + byte] = DISPLAY[y] >> (56 - byte * 8);
+		}
+	}
+}
+
+/* Compresses with PackBits: a header byte N, then N + 1 literal bytes for N
+ * below 128, or one byte repeated 257 - N times otherwise
+ */
+static size_t _packBits(const uint8_t *IN, size_t size, uint8_t *out) {
+	size_t written = 0;
+
+	for( size_t i = 0; i < size; ) {
+		size_t run = 1;
+		while( i + run < size && run < 128 && IN[i + run] == IN[i] ) {
+			++run;
+		}
+
+		if( run > 1 ) {
+			out[written++] = 257 - run;
+			out[written++] = IN[i];
+			i += run;
+			continue;
+		}
+
+		/* Literals, up to the next run of 2 */
+		size_t count = 1;
+		for( ; i + count < size && count < 128; ++count ) {
+			const size_t NEXT = i + count;
+			if( NEXT + 1 < size && IN[NEXT] == IN[NEXT + 1] ) {
+				break;
+			}
+		}
+
+		out[written++] = count - 1;
+		memcpy(&out[written], &IN[i], count);
+		written += count;
+		i += count;
+	}
+
+	return written;
+}
+
+static uint32_t _crc32(uint32_t crc, const uint8_t *DATA, size_t size) {
+	crc = ~crc;
+	for( size_t i = 0; i < size; ++i ) {
+		crc ^= DATA[i];
+		for( int bit = 0; bit < 8; ++bit ) {
+			crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+		}
+	}
+
+	return ~crc;
+}
+
+static void _put32(uint8_t *out, uint32_t value) {
+	out[0] = value >> 24;
+	out[1] = value >> 16;
+	out[2] = value >> 8;
+	out[3] = value;
+}
+
+/* Writes a PNG chunk, with its length and CRC */
+static void _chunk(FILE *file, const char *TYPE, const uint8_t *DATA,
+	uint32_t size) {
+	uint8_t word[4];
+
+	_put32(word, size);
+	fwrite(word, 1, 4, file);
+	fwrite(TYPE, 1, 4, file);
+	if( size > 0 ) {
+		fwrite(DATA, 1, size, file);
+	}
+
+	_put32(word, _crc32(_crc32(0, (const uint8_t *)TYPE, 4), DATA, size));
+	fwrite(word, 1, 4, file);
+}
+
+/* Writes a 1-bit grayscale PNG, stored without compression */
+static int _writePng(const char *PATH, const uint8_t *PACKED) {
+	static const uint8_t SIGNATURE[] = { 0x89, 'P', 'N', 'G', '\r', '\n',
+		0x1A, '\n' };
+	const int STRIDE = SCR_WIDTH / 8 + 1; /* Filter byte, then pixels */
+	const int RAW = STRIDE * SCR_HEIGHT;
+
+	uint8_t header[13] = { 0 };
+	_put32(header, SCR_WIDTH);
+	_put32(header + 4, SCR_HEIGHT);
+	header[8] = 1; /* Bit depth */
+
+	/* Zlib header, one final stored deflate block, then Adler-32 */
+	uint8_t data[2 + 5 + SCR_HEIGHT * (SCR_WIDTH / 8 + 1) + 4] = {
+		0x78, 0x01, /* Zlib, no dictionary */
+		0x01, RAW & 0xFF, RAW >> 8, ~RAW & 0xFF, (~RAW >> 8) & 0xFF,
+	};
+
+	uint8_t *raw = data + 7;
+	uint32_t a = 1, b = 0;
+	for( int y = 0; y < SCR_HEIGHT; ++y ) {
+		raw[y * STRIDE] = 0;
+		memcpy(&raw[y * STRIDE + 1], &PACKED[y * 8], 8);
+	}
+
+	for( int i = 0; i < RAW; ++i ) {
+		a = (a + raw[i]) % 65521;
+		b = (b + a) % 65521;
+	}
+
+	_put32(raw + RAW, (b << 16) | a);
+
+	FILE *file = fopen(PATH, "wb");
+	if( file == NULL ) {
+		fprintf(stderr, "ERR: Couldn't open file '%s'\n", PATH);
+		return EXIT_FAILURE;
+	}
+
+	fwrite(SIGNATURE, 1, sizeof(SIGNATURE), file);
+	_chunk(file, "IHDR", header, sizeof(header));
+	_chunk(file, "IDAT", data, sizeof(data));
+	_chunk(file, "IEND", NULL, 0);
+
+	if( ferror(file) ) {
+		fprintf(stderr, "ERR: Couldn't write file '%s'\n", PATH);
+		fclose(file);
+		return EXIT_FAILURE;
+	}
+
+	fclose(file);
+	return EXIT_SUCCESS;
+}
+
+/* Appends a record to the video stream */
+static int _writeRecord(Capture *cap, uint32_t frame, const uint8_t *DATA,
+	uint16_t size) {
+	const CaptureRecord RECORD = { .frame = frame, .size = size };
+
+	if( fwrite(&RECORD, sizeof(RECORD), 1, cap->file) != 1
+		|| (size > 0 && fwrite(DATA, 1, size, cap->file) != size) ) {
+		fprintf(stderr, "ERR: Couldn't write capture '%s'\n", cap->PATH);
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+/* Names a frame's PNG, after the capture's path */
+static void _pngPath(const Capture *CAP, uint32_t frame, char *path) {
+	const char *EXT = strrchr(CAP->PATH, '.');
+	const char *SLASH = strrchr(CAP->PATH, '/');
+	if( EXT == NULL || (SLASH && EXT < SLASH) ) {
+		EXT = CAP->PATH + strlen(CAP->PATH);
+	}
+
+	snprintf(path, PATH_SIZE, "%.*s_%06u%s", (int)(EXT - CAP->PATH),
+		CAP->PATH, (unsigned int)frame, *EXT ? EXT : ".png");
+}
+
+static int _encode(Capture *cap, const CaptureFrame *FRAME) {
+	uint8_t packed[PACKED_SIZE];
+	_pack(FRAME->display, packed);
+
+	if( cap->format == CAPTURE_PNG ) {
+		char path[PATH_SIZE];
+		_pngPath(cap, FRAME->frame, path);
+
+		return _writePng(path, packed);
+	}
+
+	uint8_t rle[RLE_SIZE];
+	const size_t SIZE = _packBits(packed, PACKED_SIZE, rle);
+
+	return _writeRecord(cap, FRAME->frame, rle, SIZE);
+}
+
+/* Encoder thread: encodes queued frames until closed */
+static int _encoder(void *data) {
+	Capture *cap = data;
+
+	for( ;; ) {
+		SDL_SemWait(cap->queued);
+
+		const uint32_t TAIL
+			= atomic_load_explicit(&cap->tail, memory_order_relaxed);
+		if( TAIL == atomic_load_explicit(&cap->head, memory_order_acquire) ) {
+			/* Only posted without a frame on close */
+			if( atomic_load(&cap->closing) ) {
+				break;
+			}
+
+			continue;
+		}
+
+		const CaptureFrame *FRAME = &cap->pool[TAIL & (CAPTURE_POOL - 1)];
+		if( !atomic_load(&cap->failed) ) {
+			if( _encode(cap, FRAME) == EXIT_FAILURE ) {
+				atomic_store(&cap->failed, true);
+			} else {
+				atomic_fetch_add(&cap->written, 1);
+			}
+		}
+
+		atomic_store_explicit(&cap->tail, TAIL + 1, memory_order_release);
+	}
+
+	return EXIT_SUCCESS;
+}
+
+int captureNew(Capture *cap, const char *PATH) {
+	memset(cap, 0, sizeof(*cap));
+	cap->PATH = PATH;
+
+	const size_t LENGTH = strlen(PATH);
+	const size_t EXT = strlen(CAPTURE_EXTENSION);
+	cap->format = LENGTH >= EXT
+			&& strcmp(PATH + LENGTH - EXT, CAPTURE_EXTENSION) == 0
+		? CAPTURE_RLE
+		: CAPTURE_PNG;
+
+	if( cap->format == CAPTURE_RLE ) {
+		cap->file = fopen(PATH, "wb");
+		if( cap->file == NULL ) {
+			fprintf(stderr, "ERR: Couldn't open file '%s'\n", PATH);
+			return EXIT_FAILURE;
+		}
+
+		CaptureHeader header = {
+			.version = CAPTURE_VERSION,
+			.width = SCR_WIDTH,
+			.height = SCR_HEIGHT,
+			.fps = FPS,
+		};
+		memcpy(header.magic, CAPTURE_MAGIC, sizeof(header.magic));
+
+		if( fwrite(&header, sizeof(header), 1, cap->file) != 1 ) {
+			fprintf(stderr, "ERR: Couldn't write file '%s'\n", PATH);
+			fclose(cap->file);
+			return EXIT_FAILURE;
+		}
+	}
+
+	cap->queued = SDL_CreateSemaphore(0);
+	if( cap->queued == NULL ) {
+		fprintf(stderr, "ERR: Failed to create semaphore: %s\n",
+			SDL_GetError());
+		if( cap->file ) {
+			fclose(cap->file);
+		}
+		return EXIT_FAILURE;
+	}
+
+	cap->thread = SDL_CreateThread(_encoder, "capture", cap);
+	if( cap->thread == NULL ) {
+		fprintf(stderr, "ERR: Failed to create capture thread: %s\n",
+			SDL_GetError());
+		SDL_DestroySemaphore(cap->queued);
+		if( cap->file ) {
+			fclose(cap->file);
+		}
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+void captureFrame(Capture *cap, const Chip8 *C8) {
+	const uint32_t FRAME = cap->frames++;
+
+	if( FRAME > 0 && memcmp(cap->last, C8->display, sizeof(cap->last)) == 0 ) {
+		++cap->duplicates;
+		return;
+	}
+
+	const uint32_t HEAD
+		= atomic_load_explicit(&cap->head, memory_order_relaxed);
+	if( HEAD - atomic_load_explicit(&cap->tail, memory_order_acquire)
+		== CAPTURE_POOL ) {
+		/* Repeats are still compared against the last frame queued */
+		atomic_fetch_add_explicit(&cap->dropped, 1, memory_order_relaxed);
+		return;
+	}
+
+	CaptureFrame *slot = &cap->pool[HEAD & (CAPTURE_POOL - 1)];
+	memcpy(slot->display, C8->display, sizeof(slot->display));
+	slot->frame = FRAME;
+
+	memcpy(cap->last, C8->display, sizeof(cap->last));
+
+	atomic_store_explicit(&cap->head, HEAD + 1, memory_order_release);
+	SDL_SemPost(cap->queued);
+}
+
+int captureFree(Capture *cap) {
+	atomic_store(&cap->closing, true);
+	SDL_SemPost(cap->queued);
+	SDL_WaitThread(cap->thread, NULL);
+	SDL_DestroySemaphore(cap->queued);
+
+	cap->thread = NULL;
+	cap->queued = NULL;
+
+	bool failed = atomic_load(&cap->failed);
+	if( cap->file ) {
+		/* Empty record, marking where the last frame ends */
+		failed |= _writeRecord(cap, cap->frames, NULL, 0) == EXIT_FAILURE;
+		failed |= fclose(cap->file) != 0;
+		cap->file = NULL;
+	}
+
+	printf("Captured %u frames to '%s' (%u repeats skipped, %u dropped)\n",
+		(unsigned int)atomic_load(&cap->written), cap->PATH,
+		(unsigned int)cap->duplicates,
+		(unsigned int)atomic_load(&cap->dropped));
+
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
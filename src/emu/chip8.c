@@ -1,3 +1,4 @@
+#include <stdatomic.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -5,64 +6,337 @@
 #include <time.h>
 
 #include "chip8.h"
+#include "tracer.h"
 #include "util.h"
 
-#define FONT_START_ADDR 0x50
-#define FONT_SIZE 0x50
-
-#define PROGRAM_START_ADDR 0x200
-
-static const uint8_t CHIP8_FONT[FONT_SIZE] = {
-	0xF0, 0x90, 0x90, 0x90, 0xF0, /* 0 */
-	0x20, 0x60, 0x20, 0x20, 0x70, /* 1 */
-	0xF0, 0x10, 0xF0, 0x80, 0xF0, /* 2 */
-	0xF0, 0x10, 0xF0, 0x10, 0xF0, /* 3 */
-	0x90, 0x90, 0xF0, 0x10, 0x10, /* 4 */
-	0xF0, 0x80, 0xF0, 0x10, 0xF0, /* 5 */
-	0xF0, 0x80, 0xF0, 0x90, 0xF0, /* 6 */
-	0xF0, 0x10, 0x20, 0x40, 0x40, /* 7 */
-	0xF0, 0x90, 0xF0, 0x90, 0xF0, /* 8 */
-	0xF0, 0x90, 0xF0, 0x10, 0xF0, /* 9 */
-	0xF0, 0x90, 0xF0, 0x90, 0x90, /* A */
-	0xE0, 0x90, 0xE0, 0x90, 0xE0, /* B */
-	0xF0, 0x80, 0x80, 0x80, 0xF0, /* C */
-	0xE0, 0x90, 0x90, 0x90, 0xE0, /* D */
-	0xF0, 0x80, 0xF0, 0x80, 0xF0, /* E */
-	0xF0, 0x80, 0xF0, 0x80, 0x80, /* F */
+/* Image with nothing but the font, used by interpreters without a program */
+static const C8Image BLANK_IMAGE = {
+	.mem = {
+		[FONT_START_ADDR] =
+		0xF0, 0x90, 0x90, 0x90, 0xF0, /* 0 */
+		0x20, 0x60, 0x20, 0x20, 0x70, /* 1 */
+		0xF0, 0x10, 0xF0, 0x80, 0xF0, /* 2 */
+		0xF0, 0x10, 0xF0, 0x10, 0xF0, /* 3 */
+		0x90, 0x90, 0xF0, 0x10, 0x10, /* 4 */
+		0xF0, 0x80, 0xF0, 0x10, 0xF0, /* 5 */
+		0xF0, 0x80, 0xF0, 0x90, 0xF0, /* 6 */
+		0xF0, 0x10, 0x20, 0x40, 0x40, /* 7 */
+		0xF0, 0x90, 0xF0, 0x90, 0xF0, /* 8 */
+		0xF0, 0x90, 0xF0, 0x10, 0xF0, /* 9 */
+		0xF0, 0x90, 0xF0, 0x90, 0x90, /* A */
+		0xE0, 0x90, 0xE0, 0x90, 0xE0, /* B */
+		0xF0, 0x80, 0x80, 0x80, 0xF0, /* C */
+		0xE0, 0x90, 0x90, 0x90, 0xE0, /* D */
+		0xF0, 0x80, 0xF0, 0x80, 0xF0, /* E */
+		0xF0, 0x80, 0xF0, 0x80, 0x80, /* F */
+	},
+};
+
+/* COSMAC VIP timing model, in machine cycles
+ *
+ * Approximations of the original interpreter: every instruction pays for its
+ * fetch and decode, plus its handler's usual cost. The few whose cost depends
+ * on their operands add the rest themselves, see the VIP_* costs below
+ */
+#define VIP_FETCH 40
+
+static const uint8_t VIP_COSTS[16] = {
+	[0x0] = VIP_FETCH + 10,
+	[0x1] = VIP_FETCH + 12,
+	[0x2] = VIP_FETCH + 26,
+	[0x3] = VIP_FETCH + 10,
+	[0x4] = VIP_FETCH + 10,
+	[0x5] = VIP_FETCH + 14,
+	[0x6] = VIP_FETCH + 6,
+	[0x7] = VIP_FETCH + 10,
+	[0x8] = VIP_FETCH + 44,
+	[0x9] = VIP_FETCH + 14,
+	[0xA] = VIP_FETCH + 12,
+	[0xB] = VIP_FETCH + 22,
+	[0xC] = VIP_FETCH + 36,
+	[0xD] = VIP_FETCH + 26,
+	[0xE] = VIP_FETCH + 14,
+	[0xF] = VIP_FETCH + 10,
+};
+
+#define VIP_CLEAR 3078 /* 00E0, on top of the table */
+#define VIP_SPRITE_ROW 68 /* DXYN, per row */
+#define VIP_BCD 72 /* FX33 */
+#define VIP_REGISTER 14 /* FX55 and FX65, per register */
+
+/* Default audio pattern, a 250Hz square wave at the default pitch */
+static const uint8_t BUZZER[AUDIO_PATTERN_SIZE] = {
+	0xFF, 0x00, 0xFF, 0x00, 0xFF, 0x00, 0xFF, 0x00,
+	0xFF, 0x00, 0xFF, 0x00, 0xFF, 0x00, 0xFF, 0x00,
 };
 
 Chip8 c8New(void) {
-	srand(time(NULL));
+	return c8NewShared(&BLANK_IMAGE);
+}
+
+Chip8 c8NewShared(const C8Image *IMAGE) {
+	static atomic_uint instances = 0;
 
 	Chip8 c8 = { 0 };
 
 	c8.pc = PROGRAM_START_ADDR;
-	memcpy(&c8.mem[FONT_START_ADDR], CHIP8_FONT, FONT_SIZE);
+	c8.pitch = AUDIO_DEFAULT_PITCH;
+	c8.vipCycles = VIP_DISPLAY_CYCLES; /* See c8EndVipFrame */
+	memcpy(c8.pattern, BUZZER, AUDIO_PATTERN_SIZE);
+
+	c8Seed(&c8, time(NULL) ^ (atomic_fetch_add(&instances, 1) * 0x9E3779B9));
+
+	/* Shared pages are never written to, see c8WriteByte */
+	for( int i = 0; i < C8_PAGE_COUNT; ++i ) {
+		c8.pages[i] = (uint8_t *)&IMAGE->mem[i * C8_PAGE_SIZE];
+	}
 
 	return c8;
 }
 
-int c8Load(Chip8 *c8, uint8_t *program, size_t size) {
-	if( size > 0xFFF ) {
+int c8Clone(Chip8 *dst, const Chip8 *SRC) {
+	*dst = *SRC;
+	dst->trace = NULL;
+
+	for( int i = 0; i < C8_PAGE_COUNT; ++i ) {
+		if( !(SRC->owned & (1 << i)) ) {
+			continue;
+		}
+
+		dst->pages[i] = malloc(C8_PAGE_SIZE);
+		if( dst->pages[i] == NULL ) {
+			fprintf(stderr,
+				"ERR: Couldn't allocate memory (%d bytes) for memory page\n",
+				C8_PAGE_SIZE);
+
+			/* Only free what was copied so far */
+			dst->owned &= (1 << i) - 1;
+			c8Free(dst);
+			return EXIT_FAILURE;
+		}
+
+		memcpy(dst->pages[i], SRC->pages[i], C8_PAGE_SIZE);
+	}
+
+	return EXIT_SUCCESS;
+}
+
+uint64_t c8StateHash(const Chip8 *c8) {
+	uint64_t hash = utilHash64(c8->display, sizeof(c8->display), c8->pc);
+
+	hash = utilHash64(c8->v, sizeof(c8->v), hash);
+	const size_t DEPTH = c8->sp < 16 ? c8->sp : 16;
+	hash = utilHash64(c8->stack, DEPTH * sizeof(*c8->stack), hash);
+	hash = utilHash64(c8->keypad, sizeof(c8->keypad), hash);
+	hash = utilHash64(c8->pattern, sizeof(c8->pattern), hash);
+	hash = utilHash64(&c8->rng, sizeof(c8->rng), hash);
+
+	const uint8_t REGS[] = {
+		c8->i & 0xFF,
+		c8->i >> 8,
+		c8->sp,
+		c8->timers.dt,
+		c8->timers.st,
+		c8->waiting,
+		c8->waitKey,
+		c8->pitch,
+	};
+	hash = utilHash64(REGS, sizeof(REGS), hash);
+
+	for( int i = 0; i < C8_PAGE_COUNT; ++i ) {
+		if( c8->owned & (1 << i) ) {
+			hash = utilHash64(c8->pages[i], C8_PAGE_SIZE, hash ^ i);
+		}
+	}
+
+	return hash;
+}
+
+uint64_t c8DisplayHash(const Chip8 *c8) {
+	uint8_t packed[SCR_HEIGHT * sizeof(uint64_t)];
+
+	for( int y = 0; y < SCR_HEIGHT; ++y ) {
+		for( int byte = 0; byte < 8; ++byte ) {
+			packed[y * 8 + byte] = c8->display[y] >> (56 - byte * 8);
+		}
+	}
+
+	return utilHash64(packed, sizeof(packed), 0);
+}
+
+void c8Seed(Chip8 *c8, uint32_t seed) {
+	/* Xorshift gets stuck at 0 */
+	c8->rng = seed ? seed : 0x2545F491;
+}
+
+void c8Free(Chip8 *c8) {
+	for( int i = 0; i < C8_PAGE_COUNT; ++i ) {
+		if( c8->owned & (1 << i) ) {
+			free(c8->pages[i]);
+			c8->pages[i] = (uint8_t *)&BLANK_IMAGE.mem[i * C8_PAGE_SIZE];
+		}
+	}
+
+	c8->owned = 0;
+}
+
+/* Copies a shared page into a private one */
+static uint8_t *_ownPage(Chip8 *c8, int page) {
+	if( c8->owned & (1 << page) ) {
+		return c8->pages[page];
+	}
+
+	uint8_t *copy = malloc(C8_PAGE_SIZE);
+	if( copy == NULL ) {
 		fprintf(stderr,
-			"ERR: Tried to load program that's too big\n"
-			"     (is 0x%zu, more than maximum of 4095)\n",
-			size);
-		return EXIT_FAILURE;
+			"ERR: Couldn't allocate memory (%d bytes) for memory page\n",
+			C8_PAGE_SIZE);
+		abort();
 	}
 
-	/* Copy program to memory */
-	memcpy(&c8->mem[PROGRAM_START_ADDR], program, size);
-	free(program);
+	memcpy(copy, c8->pages[page], C8_PAGE_SIZE);
 
-	return EXIT_SUCCESS;
+	c8->pages[page] = copy;
+	c8->owned |= 1 << page;
+
+	return copy;
+}
+
+uint8_t c8ReadByte(const Chip8 *c8, uint16_t addr) {
+	addr &= MEM_SIZE - 1;
+	return c8->pages[addr >> PAGE_BITS][addr & (C8_PAGE_SIZE - 1)];
 }
 
-int c8LoadFile(Chip8 *c8, const char *PATH) {
-	uint8_t *buffer = NULL;
-	const size_t BYTES_READ = utilLoadBinaryFile(PATH, &buffer);
+void c8WriteByte(Chip8 *c8, uint16_t addr, uint8_t value) {
+	addr &= MEM_SIZE - 1;
+	_ownPage(c8, addr >> PAGE_BITS)[addr & (C8_PAGE_SIZE - 1)] = value;
+}
+
+bool c8GetPixel(const Chip8 *c8, int x, int y) {
+	return (c8->display[y] >> (SCR_WIDTH - 1 - x)) & 1;
+}
+
+static C8LoadError _validate(size_t size) {
+	if( size == 0 ) {
+		return C8_LOAD_ERR_EMPTY;
+	}
+
+	if( size > PROGRAM_MAX_SIZE ) {
+		return C8_LOAD_ERR_TOO_BIG;
+	}
+
+	return C8_LOAD_OK;
+}
+
+C8LoadError c8RomOpen(C8Rom *rom, const char *PATH) {
+	if( utilMapFile(PATH, &rom->map) == EXIT_FAILURE ) {
+		return C8_LOAD_ERR_OPEN;
+	}
+
+	const C8LoadError ERROR = _validate(rom->map.size);
+	if( ERROR != C8_LOAD_OK ) {
+		utilUnmapFile(&rom->map);
+	}
 
-	return c8Load(c8, buffer, BYTES_READ);
+	return ERROR;
+}
+
+void c8RomClose(C8Rom *rom) {
+	utilUnmapFile(&rom->map);
+}
+
+C8LoadError c8Load(Chip8 *c8, const uint8_t *program, size_t size) {
+	const C8LoadError ERROR = _validate(size);
+	if( ERROR != C8_LOAD_OK ) {
+		return ERROR;
+	}
+
+	/* Copy program to memory, a page at a time */
+	for( size_t done = 0; done < size; ) {
+		const size_t ADDR = PROGRAM_START_ADDR + done;
+		const size_t OFFSET = ADDR & (C8_PAGE_SIZE - 1);
+
+		size_t chunk = C8_PAGE_SIZE - OFFSET;
+		if( chunk > size - done ) {
+			chunk = size - done;
+		}
+
+		memcpy(_ownPage(c8, ADDR >> PAGE_BITS) + OFFSET, program + done, chunk);
+		done += chunk;
+	}
+
+	return C8_LOAD_OK;
+}
+
+C8LoadError c8ImageNew(C8Image *image, const uint8_t *program, size_t size) {
+	const C8LoadError ERROR = _validate(size);
+	if( ERROR != C8_LOAD_OK ) {
+		return ERROR;
+	}
+
+	*image = BLANK_IMAGE;
+	memcpy(&image->mem[PROGRAM_START_ADDR], program, size);
+
+	return C8_LOAD_OK;
+}
+
+C8LoadError c8LoadRom(Chip8 *c8, const C8Rom *ROM) {
+	return c8Load(c8, ROM->map.data, ROM->map.size);
+}
+
+C8LoadError c8LoadFile(Chip8 *c8, const char *PATH) {
+	C8Rom rom;
+
+	C8LoadError error = c8RomOpen(&rom, PATH);
+	if( error != C8_LOAD_OK ) {
+		return error;
+	}
+
+	error = c8LoadRom(c8, &rom);
+	c8RomClose(&rom);
+
+	return error;
+}
+
+const char *c8LoadErrorString(C8LoadError error) {
+	switch( error ) {
+	case C8_LOAD_OK:
+		return "no error";
+	case C8_LOAD_ERR_OPEN:
+		return "couldn't open program";
+	case C8_LOAD_ERR_EMPTY:
+		return "program is empty";
+	case C8_LOAD_ERR_TOO_BIG:
+		return "program is too big (maximum is 3584 bytes)";
+	}
+
+	return "unknown error";
+}
+
+/* Bounds checking
+ *
+ * Checked builds (C8_CHECKED, see meson_options.txt) fault on instructions
+ * reaching past the end of memory. Others let addresses wrap around, which
+ * costs nothing and still keeps runaway programs inside the interpreter. Stack
+ * errors are faults either way. Faults are reported through c8Run, or abort
+ * for instances that trap
+ */
+#ifdef C8_CHECKED
+#define _CHECKED true
+#else
+#define _CHECKED false
+#endif
+
+/* Aborts on a program error, with a diagnostic. Aborting dumps the execution
+ * trace, if there is one, see traceDumpOnCrash
+ */
+static void _trap(const Chip8 *c8) {
+	const uint16_t OPCODE
+		= (c8ReadByte(c8, c8->pc) << 8) | c8ReadByte(c8, c8->pc + 1);
+
+	fprintf(stderr, "ERR: %s at 0x%03X (%04X, I=0x%03X, SP=%d)\n",
+		c8StatusString(c8->fault), c8->pc, OPCODE, c8->i, c8->sp);
+	abort();
 }
 
 static void _advance(Chip8 *c8) {
@@ -73,12 +347,60 @@ static void _backtrack(Chip8 *c8) {
 	c8->pc -= 2;
 }
 
-static void _push(Chip8 *c8, uint16_t value) {
+/* Stops on a program error before the PC moves past the instruction, so it
+ * faults again if run
+ */
+static void _stop(Chip8 *c8, C8Status fault) {
+	c8->fault = fault;
+
+	if( c8->trap ) {
+		_trap(c8);
+	}
+}
+
+/* Stops on a program error in the instruction being run, see _stop */
+static void _fault(Chip8 *c8, C8Status fault) {
+	_stop(c8, fault);
+	_backtrack(c8);
+}
+
+/* Checks an instruction's size bytes starting at I are all in memory,
+ * faulting if not. Always true in unchecked builds
+ */
+static bool _inMemory(Chip8 *c8, uint32_t size) {
+	if( !_CHECKED || c8->i + size <= MEM_SIZE ) {
+		return true;
+	}
+
+	_fault(c8, C8_MEMORY_FAULT);
+	return false;
+}
+
+/* Pushes a return address. Returns false if the stack is full */
+static bool _push(Chip8 *c8, uint16_t value) {
+	if( c8->sp >= C8_STACK_SIZE ) {
+		_fault(c8, C8_STACK_OVERFLOW);
+		return false;
+	}
+
 	c8->stack[c8->sp++] = value;
+	return true;
 }
 
-static uint16_t _pop(Chip8 *c8) {
-	return c8->stack[--c8->sp];
+/* Pops a return address. Returns false if the stack is empty */
+static bool _pop(Chip8 *c8, uint16_t *value) {
+	if( c8->sp == 0 ) {
+		_fault(c8, C8_STACK_UNDERFLOW);
+		return false;
+	}
+
+	*value = c8->stack[--c8->sp];
+	return true;
+}
+
+/* Unknown opcodes do nothing, but are reported, see c8Run */
+static void _invalid(Chip8 *c8) {
+	c8->fault = C8_INVALID_OPCODE;
 }
 
 static void _setflag(Chip8 *c8, bool value) {
@@ -94,17 +416,15 @@ static void op0(Chip8 *c8, Instr op) {
 	switch( op.nn ) {
 	/* 00E0 -> Clears the screen */
 	case 0xE0:
-		for( int y = 0; y < SCR_HEIGHT; ++y ) {
-			for( int x = 0; x < SCR_WIDTH; ++x ) {
-				c8->display[y][x] = 0;
-			}
-		}
-
+		memset(c8->display, 0, sizeof(c8->display));
+		c8->vipCycles += VIP_CLEAR;
 		break;
 	/* 00EE -> Returns from subroutine */
 	case 0xEE:
-		c8->pc = _pop(c8);
+		_pop(c8, &c8->pc);
 		break;
+	default:
+		_invalid(c8);
 	}
 }
 
@@ -115,8 +435,9 @@ static void op1(Chip8 *c8, Instr op) {
 
 /* 2NNN -> Call subroutine NNN */
 static void op2(Chip8 *c8, Instr op) {
-	_push(c8, c8->pc);
-	_jump(c8, op.nnn);
+	if( _push(c8, c8->pc) ) {
+		_jump(c8, op.nnn);
+	}
 }
 
 /* 3XNN -> Skip next if VX == NN */
@@ -208,6 +529,8 @@ static void op8(Chip8 *c8, Instr op) {
 		c8->v[op.x] = c8->v[op.y] << 1;
 		c8->v[0xF] = MSB;
 	} break;
+	default:
+		_invalid(c8);
 	}
 }
 
@@ -225,12 +548,17 @@ static void opA(Chip8 *c8, Instr op) {
 
 /* BNNN -> Jump to address NNN + V0 */
 static void opB(Chip8 *c8, Instr op) {
-	c8->pc = op.nnn + c8->v[0x0];
+	_jump(c8, op.nnn + c8->v[0x0]);
 }
 
 /* CXNN -> Set VX to a random number ANDed with NN */
 static void opC(Chip8 *c8, Instr op) {
-	uint8_t randbyte = rand() % 256;
+	/* Xorshift32 */
+	c8->rng ^= c8->rng << 13;
+	c8->rng ^= c8->rng >> 17;
+	c8->rng ^= c8->rng << 5;
+
+	uint8_t randbyte = c8->rng >> 24;
 	c8->v[op.x] = randbyte & op.nn;
 }
 
@@ -242,28 +570,42 @@ static void opC(Chip8 *c8, Instr op) {
  * VF represents if any set pixels were changed to unset
  */
 static void opD(Chip8 *c8, Instr op) {
+	if( !_inMemory(c8, op.n) ) {
+		return;
+	}
+
 	c8->v[0xF] = 0;
 
 	uint8_t px = c8->v[op.x] % SCR_WIDTH;
 	uint8_t py = c8->v[op.y] % SCR_HEIGHT;
 
+	++c8->draws;
+
+	/* The VIP waits for the next vertical blank before drawing */
+	if( c8->vipCycles < VIP_CYCLES_PER_FRAME ) {
+		c8->vipCycles = VIP_CYCLES_PER_FRAME;
+	}
+
+	c8->vipCycles += VIP_SPRITE_ROW * op.n;
+
 	for( int row = 0; row < op.n; ++row ) {
-		int spriteByte = c8->mem[c8->i + row];
+		const uint8_t BYTE = c8ReadByte(c8, c8->i + row);
+		const uint64_t SPRITE = (uint64_t)BYTE << 56;
 
-		for( int col = 0; col < 8; ++col ) {
-			int ix = (px + col) % SCR_WIDTH;
-			int iy = (py + row) % SCR_HEIGHT;
-			uint8_t *scrPixel = &c8->display[iy][ix];
+		for( uint8_t bits = BYTE; bits; bits &= bits - 1 ) {
+			++c8->pixels;
+		}
 
-			int sprPixel = (spriteByte >> (7 - col)) & 1;
-			if( sprPixel == 1 ) {
-				if( *scrPixel == 0xFF ) {
-					c8->v[0xF] = 1;
-				}
+		/* Rotating wraps the sprite around the screen horizontally */
+		const uint64_t BITS
+			= (SPRITE >> px) | (SPRITE << ((SCR_WIDTH - px) % SCR_WIDTH));
 
-				*scrPixel ^= 0xFF;
-			}
+		uint64_t *scrRow = &c8->display[(py + row) % SCR_HEIGHT];
+		if( *scrRow & BITS ) {
+			c8->v[0xF] = 1;
 		}
+
+		*scrRow ^= BITS;
 	}
 
 	c8->dirty = true;
@@ -274,34 +616,50 @@ static void opE(Chip8 *c8, Instr op) {
 	switch( op.nn ) {
 	/* EX9E -> Skip next if the key VX is pressed */
 	case 0x9E:
-		if( c8->keypad[op.x] ) {
+		if( c8->keypad[c8->v[op.x] & 0xF] ) {
 			_advance(c8);
 		}
 		break;
 	/* EXA1 -> Skip next if the key VX is not pressed */
 	case 0xA1:
-		if( !c8->keypad[op.x] ) {
+		if( !c8->keypad[c8->v[op.x] & 0xF] ) {
 			_advance(c8);
 		}
 		break;
+	default:
+		_invalid(c8);
 	}
 }
 
 /* F??? opcodes */
 static void opF(Chip8 *c8, Instr op) {
 	switch( op.nn ) {
+	/* F002 -> Load the audio pattern from I..=I + 15 (XO-CHIP) */
+	case 0x02:
+		if( op.x != 0 ) {
+			_invalid(c8);
+			break;
+		}
+
+		if( !_inMemory(c8, AUDIO_PATTERN_SIZE) ) {
+			break;
+		}
+
+		for( int i = 0; i < AUDIO_PATTERN_SIZE; ++i ) {
+			c8->pattern[i] = c8ReadByte(c8, c8->i + i);
+		}
+		break;
 	/* FX07 -> Set VX to the delay timer */
 	case 0x07:
 		c8->v[op.x] = c8->timers.dt;
 		break;
-	/* FX0A -> Wait for a keypress, store the key in VX */
+	/* FX0A -> Wait for a key to be pressed and released, store it in VX.
+	 * The PC stays here until then
+	 */
 	case 0x0A:
-		for( int i = 0; i < 16; ++i ) {
-			if( c8->keypad[op.x] ) {
-				c8->v[op.x] = i;
-				return;
-			}
-		}
+		c8->waiting = true;
+		c8->waitReg = op.x;
+		c8->waitKey = -1;
 
 		_backtrack(c8);
 		break;
@@ -317,39 +675,62 @@ static void opF(Chip8 *c8, Instr op) {
 	case 0x1E:
 		c8->i += c8->v[op.x];
 		break;
+	/* FX3A -> Set the audio pitch to VX (XO-CHIP) */
+	case 0x3A:
+		c8->pitch = c8->v[op.x];
+		break;
 	/* FX29 -> Set I to the address of the sprite for the digit VX */
 	case 0x29:
 		c8->i = FONT_START_ADDR + (c8->v[op.x] * 5);
 		break;
 	/* FX33 -> Store the BCD representation of VX at I..=I + 2 */
 	case 0x33: {
+		if( !_inMemory(c8, 3) ) {
+			break;
+		}
+
 		uint8_t value = c8->v[op.x];
 
-		c8->mem[c8->i + 2] = value % 10;
+		c8WriteByte(c8, c8->i + 2, value % 10);
 		value /= 10;
 
-		c8->mem[c8->i + 1] = value % 10;
+		c8WriteByte(c8, c8->i + 1, value % 10);
 		value /= 10;
 
-		c8->mem[c8->i] = value % 10;
+		c8WriteByte(c8, c8->i, value % 10);
+
+		c8->vipCycles += VIP_BCD;
 	} break;
 	/* FX55 -> Store V0..=VX in memory starting at I. Adds X + 1 to I */
 	case 0x55:
+		if( !_inMemory(c8, op.x + 1) ) {
+			break;
+		}
+
 		for( int i = 0; i <= op.x; ++i ) {
-			c8->mem[c8->i + i] = c8->v[i];
+			c8WriteByte(c8, c8->i + i, c8->v[i]);
 		}
 
 		c8->i += op.x + 1;
+		c8->vipCycles += VIP_REGISTER * (op.x + 1);
 		break;
 	/* FX65 -> Set V0..=VX to values in memory starting at I. Adds X + 1
 	 * to I
 	 */
 	case 0x65:
+		if( !_inMemory(c8, op.x + 1) ) {
+			break;
+		}
+
 		for( int i = 0; i <= op.x; ++i ) {
-			c8->v[i] = c8->mem[c8->i + i];
+			c8->v[i] = c8ReadByte(c8, c8->i + i);
 		}
 
 		c8->i += op.x + 1;
+		c8->vipCycles += VIP_REGISTER * (op.x + 1);
+		break;
+	default:
+		_invalid(c8);
 	}
 }
 
@@ -375,7 +756,8 @@ static const opFunc opTable[] = {
 };
 
 static Instr _fetch(Chip8 *c8) {
-	const uint16_t OPCODE = (c8->mem[c8->pc] << 8) | (c8->mem[c8->pc + 1]);
+	const uint16_t OPCODE
+		= (c8ReadByte(c8, c8->pc) << 8) | c8ReadByte(c8, c8->pc + 1);
 	return c8ParseInstruction(OPCODE);
 }
 
@@ -390,9 +772,153 @@ Instr c8ParseInstruction(const uint16_t INSTR) {
 	};
 }
 
+/* Stops waiting on FX0A, moving past it */
+static void _endWait(Chip8 *c8) {
+	c8->v[c8->waitReg] = c8->waitKey;
+	c8->waiting = false;
+
+	_advance(c8);
+}
+
+void c8KeyEvent(Chip8 *c8, uint8_t key, bool down) {
+	key &= 0xF;
+	c8->keypad[key] = down;
+
+	if( !c8->waiting ) {
+		return;
+	}
+
+	if( down && c8->waitKey < 0 ) {
+		c8->waitKey = key;
+	} else if( !down && key == c8->waitKey ) {
+		_endWait(c8);
+	}
+}
+
+/* Waiting on FX0A, for callers that write to the keypad directly */
+static void _pollWait(Chip8 *c8) {
+	if( c8->waitKey >= 0 ) {
+		if( !c8->keypad[c8->waitKey] ) {
+			_endWait(c8);
+		}
+
+		return;
+	}
+
+	for( int key = 0; key < 16; ++key ) {
+		if( c8->keypad[key] ) {
+			c8->waitKey = key;
+			return;
+		}
+	}
+}
+
 void c8Cycle(Chip8 *c8) {
+	/* The VIP spins in its keypad loop, going through FX0A over and over */
+	if( c8->waiting ) {
+		c8->vipCycles += VIP_COSTS[0xF];
+		_pollWait(c8);
+		return;
+	}
+
+	const uint16_t PC = c8->pc;
+
+	if( _CHECKED && PC > MEM_SIZE - 2 ) {
+		c8->vipCycles += VIP_FETCH;
+		_stop(c8, C8_MEMORY_FAULT);
+		return;
+	}
+
 	Instr instruction = _fetch(c8);
+	c8->vipCycles += VIP_COSTS[instruction.op];
 	opTable[instruction.op](c8, instruction);
 
 	_advance(c8);
+
+	if( c8->trace ) {
+		const uint16_t OPCODE = (instruction.op << 12) | instruction.nnn;
+		traceRecord(c8->trace, PC, OPCODE, c8);
+	}
+}
+
+/* Checks if the instruction just run at PC jumped to itself */
+static bool _halted(const Chip8 *c8, uint16_t PC) {
+	const uint8_t OP = c8ReadByte(c8, PC) >> 4;
+	return c8->pc == PC && (OP == 0x1 || OP == 0xB);
+}
+
+C8RunResult c8Run(Chip8 *c8, uint32_t budget) {
+	C8RunResult result = { .status = C8_RUNNING };
+	c8->fault = C8_RUNNING;
+
+	while( result.cycles < budget ) {
+		const uint16_t PC = c8->pc;
+		const bool WAITING = c8->waiting;
+
+		c8Cycle(c8);
+		++result.cycles;
+
+		/* A wait only ends on a key, so it's pointless polling it again */
+		if( c8->fault != C8_RUNNING || (WAITING && c8->waiting) ) {
+			result.status = WAITING ? C8_WAITING : c8->fault;
+			break;
+		} else if( !WAITING && _halted(c8, PC) ) {
+			result.status = C8_HALTED;
+			break;
+		}
+	}
+
+	return result;
+}
+
+const char *c8StatusString(C8Status status) {
+	switch( status ) {
+	case C8_RUNNING:
+		return "running";
+	case C8_HALTED:
+		return "halted";
+	case C8_WAITING:
+		return "waiting for a key";
+	case C8_INVALID_OPCODE:
+		return "invalid opcode";
+	case C8_STACK_OVERFLOW:
+		return "stack overflow";
+	case C8_STACK_UNDERFLOW:
+		return "stack underflow";
+	case C8_MEMORY_FAULT:
+		return "access past the end of memory";
+	}
+
+	return "unknown status";
+}
+
+uint32_t c8VipFrame(Chip8 *c8) {
+	uint32_t executed = 0;
+	for( ; c8->vipCycles < VIP_CYCLES_PER_FRAME; ++executed ) {
+		c8Cycle(c8);
+	}
+
+	c8EndVipFrame(c8);
+	return executed;
+}
+
+void c8EndVipFrame(Chip8 *c8) {
+	/* Frames cut short (by a debugger halting it) carry nothing over */
+	if( c8->vipCycles < VIP_CYCLES_PER_FRAME ) {
+		c8->vipCycles = 0;
+	} else {
+		c8->vipCycles -= VIP_CYCLES_PER_FRAME;
+	}
+
+	c8->vipCycles += VIP_DISPLAY_CYCLES;
+}
+
+void c8TickTimers(Chip8 *c8) {
+	if( c8->timers.dt > 0 ) {
+		--c8->timers.dt;
+	}
+
+	if( c8->timers.st > 0 ) {
+		--c8->timers.st;
+	}
 }
@@ -0,0 +1,274 @@
+/* Chip-8 debugger
+ *
+ * A dispatch loop of its own around c8Cycle, which checks breakpoints and
+ * watchpoints before every instruction. Breakpoints are a bitmap over the
+ * address space, so checking one is a single load
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chip8.h"
+#include "debugger.h"
+
+/* Where a stepping function stops */
+typedef struct _Target {
+	uint8_t sp;
+	uint16_t pc;
+	uint64_t frames;
+} Target;
+
+typedef bool (*DoneFunc)(const Debugger *dbg, const Target *TARGET);
+
+static bool _test(const uint64_t *bits, uint16_t addr) {
+	addr &= MEM_SIZE - 1;
+	return (bits[addr >> 6] >> (addr & 63)) & 1;
+}
+
+static void _set(uint64_t *bits, uint16_t addr, bool value) {
+	addr &= MEM_SIZE - 1;
+	if( value ) {
+		bits[addr >> 6] |= 1ull << (addr & 63);
+	} else {
+		bits[addr >> 6] &= ~(1ull << (addr & 63));
+	}
+}
+
+static uint16_t _opcode(const Debugger *dbg) {
+	const Chip8 *C8 = dbg->c8;
+	return (c8ReadByte(C8, C8->pc) << 8) | c8ReadByte(C8, C8->pc + 1);
+}
+
+void dbgAttach(Debugger *dbg, Chip8 *c8, int cyclesPerFrame) {
+	*dbg = (Debugger) {
+		.c8 = c8,
+		.cyclesPerFrame = cyclesPerFrame,
+	};
+}
+
+/* Drops every condition set on an address */
+static void _dropConditions(Debugger *dbg, uint16_t addr) {
+	size_t kept = 0;
+	for( size_t n = 0; n < dbg->conditionCount; ++n ) {
+		if( dbg->conditions[n].addr != addr ) {
+			dbg->conditions[kept++] = dbg->conditions[n];
+		}
+	}
+
+	dbg->conditionCount = kept;
+}
+
+void dbgSetBreakpoint(Debugger *dbg, uint16_t addr) {
+	addr &= MEM_SIZE - 1;
+
+	_dropConditions(dbg, addr);
+	_set(dbg->breakpoints, addr, true);
+}
+
+int dbgSetCondition(Debugger *dbg, uint16_t addr, const DbgCondition COND) {
+	addr &= MEM_SIZE - 1;
+
+	if( dbg->conditionCount >= DBG_MAX_CONDITIONS ) {
+		return EXIT_FAILURE;
+	}
+
+	dbg->conditions[dbg->conditionCount].addr = addr;
+	dbg->conditions[dbg->conditionCount].cond = COND;
+	++dbg->conditionCount;
+
+	_set(dbg->breakpoints, addr, true);
+	return EXIT_SUCCESS;
+}
+
+void dbgClearBreakpoint(Debugger *dbg, uint16_t addr) {
+	addr &= MEM_SIZE - 1;
+
+	_dropConditions(dbg, addr);
+	_set(dbg->breakpoints, addr, false);
+}
+
+void dbgSetWatchpoint(Debugger *dbg, uint16_t addr, size_t size) {
+	for( size_t n = 0; n < size; ++n ) {
+		_set(dbg->watchpoints, addr + n, true);
+	}
+}
+
+void dbgClearWatchpoint(Debugger *dbg, uint16_t addr, size_t size) {
+	for( size_t n = 0; n < size; ++n ) {
+		_set(dbg->watchpoints, addr + n, false);
+	}
+}
+
+bool dbgHasBreakpoint(const Debugger *dbg, uint16_t addr) {
+	return _test(dbg->breakpoints, addr);
+}
+
+bool dbgIsWatched(const Debugger *dbg, uint16_t addr) {
+	return _test(dbg->watchpoints, addr);
+}
+
+static bool _holds(const Chip8 *C8, const DbgCondition *COND) {
+	const uint16_t VALUE = COND->reg == DBG_REG_I ? C8->i : C8->v[COND->reg];
+
+	switch( COND->cmp ) {
+	case DBG_CMP_EQ:
+		return VALUE == COND->value;
+	case DBG_CMP_NE:
+		return VALUE != COND->value;
+	case DBG_CMP_LT:
+		return VALUE < COND->value;
+	case DBG_CMP_LE:
+		return VALUE <= COND->value;
+	case DBG_CMP_GT:
+		return VALUE > COND->value;
+	case DBG_CMP_GE:
+		return VALUE >= COND->value;
+	}
+
+	return false;
+}
+
+/* Checks if the instruction about to execute is a breakpoint */
+static bool _breaks(const Debugger *dbg) {
+	const uint16_t PC = dbg->c8->pc & (MEM_SIZE - 1);
+	if( !_test(dbg->breakpoints, PC) ) {
+		return false;
+	}
+
+	bool conditional = false;
+	for( size_t n = 0; n < dbg->conditionCount; ++n ) {
+		if( dbg->conditions[n].addr != PC ) {
+			continue;
+		}
+
+		if( _holds(dbg->c8, &dbg->conditions[n].cond) ) {
+			return true;
+		}
+
+		conditional = true;
+	}
+
+	return !conditional;
+}
+
+/* Checks if the instruction about to execute writes to a watched address
+ *
+ * Only FX33 and FX55 write to memory, both starting at I
+ */
+static bool _watches(Debugger *dbg) {
+	const Instr OP = c8ParseInstruction(_opcode(dbg));
+	if( OP.op != 0xF || (OP.nn != 0x33 && OP.nn != 0x55) ) {
+		return false;
+	}
+
+	const int SIZE = OP.nn == 0x33 ? 3 : OP.x + 1;
+	for( int n = 0; n < SIZE; ++n ) {
+		const uint16_t ADDR = (dbg->c8->i + n) & (MEM_SIZE - 1);
+		if( _test(dbg->watchpoints, ADDR) ) {
+			dbg->watched = ADDR;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/* Executes one instruction, ticking the timers at the end of a frame */
+static void _cycle(Debugger *dbg) {
+	c8Cycle(dbg->c8);
+	++dbg->executed;
+
+	if( dbg->cyclesPerFrame > 0 && ++dbg->cycle >= dbg->cyclesPerFrame ) {
+		dbg->cycle = 0;
+		++dbg->frames;
+		c8TickTimers(dbg->c8);
+	}
+}
+
+static DbgStop _run(
+	Debugger *dbg, uint64_t budget, DoneFunc done, const Target *TARGET) {
+	for( uint64_t n = 0; n < budget; ++n ) {
+		if( n > 0 && _breaks(dbg) ) {
+			return DBG_STOP_BREAKPOINT;
+		}
+
+		const bool WATCHED = _watches(dbg);
+		_cycle(dbg);
+
+		if( WATCHED ) {
+			return DBG_STOP_WATCHPOINT;
+		}
+
+		if( done && done(dbg, TARGET) ) {
+			return DBG_STOP_STEP;
+		}
+	}
+
+	return DBG_STOP_BUDGET;
+}
+
+DbgStop dbgCycle(Debugger *dbg) {
+	if( _breaks(dbg) ) {
+		return DBG_STOP_BREAKPOINT;
+	}
+
+	const bool WATCHED = _watches(dbg);
+	_cycle(dbg);
+
+	return WATCHED ? DBG_STOP_WATCHPOINT : DBG_STOP_STEP;
+}
+
+DbgStop dbgStep(Debugger *dbg, uint64_t count) {
+	const DbgStop STOP = _run(dbg, count, NULL, NULL);
+	return STOP == DBG_STOP_BUDGET ? DBG_STOP_STEP : STOP;
+}
+
+static bool _frameDone(const Debugger *dbg, const Target *TARGET) {
+	return dbg->frames >= TARGET->frames;
+}
+
+DbgStop dbgStepFrame(Debugger *dbg, uint64_t count) {
+	const Target TARGET = { .frames = dbg->frames + count };
+	if( count == 0 || dbg->cyclesPerFrame == 0 ) {
+		return DBG_STOP_STEP;
+	}
+
+	/* Never takes more than count frames worth of cycles */
+	const uint64_t BUDGET = count * dbg->cyclesPerFrame;
+	const DbgStop STOP = _run(dbg, BUDGET, _frameDone, &TARGET);
+
+	return STOP == DBG_STOP_BUDGET ? DBG_STOP_STEP : STOP;
+}
+
+/* Back at the same depth, right after the call */
+static bool _returned(const Debugger *dbg, const Target *TARGET) {
+	return dbg->c8->sp == TARGET->sp && dbg->c8->pc == TARGET->pc;
+}
+
+DbgStop dbgStepOver(Debugger *dbg, uint64_t budget) {
+	if( (_opcode(dbg) >> 12) != 0x2 ) {
+		return dbgStep(dbg, 1);
+	}
+
+	const Target TARGET = {
+		.sp = dbg->c8->sp,
+		.pc = dbg->c8->pc + 2,
+	};
+
+	return _run(dbg, budget, _returned, &TARGET);
+}
+
+/* One level up the stack */
+static bool _left(const Debugger *dbg, const Target *TARGET) {
+	return dbg->c8->sp == TARGET->sp;
+}
+
+DbgStop dbgStepOut(Debugger *dbg, uint64_t budget) {
+	const Target TARGET = { .sp = (dbg->c8->sp - 1) & 0xF };
+	return _run(dbg, budget, _left, &TARGET);
+}
+
+DbgStop dbgContinue(Debugger *dbg, uint64_t budget) {
+	return _run(dbg, budget, NULL, NULL);
+}
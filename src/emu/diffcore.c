@@ -0,0 +1,303 @@
+/* Differential execution of two cores
+ *
+ * Runs the reference core (c8Cycle) and a candidate core (the batch engine)
+ * in lockstep, feeding both the same keys and timer ticks. When comparing
+ * only every few instructions, both states are checkpointed at every
+ * comparison that agrees, so a divergence can be replayed one instruction at
+ * a time to find exactly where it happened.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "batch.h"
+#include "chip8.h"
+#include "diffcore.h"
+#include "keytrace.h"
+#include "printer.h"
+
+#define DETAIL_SIZE 96
+
+/* Instructions shown before and after the diverging one */
+#define CONTEXT 4
+
+/* Both states at some point of the run */
+typedef struct _Checkpoint {
+	Chip8 ref;
+	Chip8 cand;
+
+	uint64_t executed;
+	size_t nextEvent;
+} Checkpoint;
+
+typedef struct _Diff {
+	const DiffOptions *OPTS;
+
+	Chip8 ref;
+	Chip8Batch batch; /* A single lane */
+
+	KeyTrace input;
+	size_t nextEvent;
+
+	uint64_t executed; /* Instructions run so far */
+	uint16_t lastPc; /* Where the last instruction was */
+} Diff;
+
+static Chip8 *_candidate(Diff *diff) {
+	return c8BatchPull(&diff->batch, 0);
+}
+
+/* Runs a single instruction on both cores, along with input and timers */
+static void _step(Diff *diff) {
+	const int CYCLES = diff->OPTS->cycles;
+	const int FRAME = diff->executed / CYCLES;
+
+	Chip8 *cand = &diff->batch.lanes[0];
+
+	if( diff->executed % CYCLES == 0 ) {
+		for( ; diff->nextEvent < diff->input.count
+			 && diff->input.events[diff->nextEvent].frame <= FRAME;
+			 ++diff->nextEvent ) {
+			const KeyTraceEvent *EV = &diff->input.events[diff->nextEvent];
+			c8KeyEvent(&diff->ref, EV->key, EV->down);
+
+			/* Ending a wait on FX0A writes to VX and PC */
+			c8KeyEvent(_candidate(diff), EV->key, EV->down);
+			c8BatchPush(&diff->batch, 0);
+		}
+	}
+
+	diff->lastPc = diff->ref.pc;
+	c8Cycle(&diff->ref);
+	c8BatchStep(&diff->batch, 1);
+
+	if( ++diff->executed % CYCLES == 0 ) {
+		c8TickTimers(&diff->ref);
+		c8TickTimers(cand);
+	}
+}
+
+/* Compares every bit of state, describing the first difference found. Names
+ * are only formatted on a difference, this runs after every instruction
+ *
+ * Returns false if the states differ
+ */
+static bool _compare(const Chip8 *A, const Chip8 *B, char *detail) {
+#define FIELD(X, Y, ...)                                                       \
+	if( (X) != (Y) ) {                                                         \
+		char name[16];                                                         \
+		snprintf(name, sizeof(name), __VA_ARGS__);                             \
+		snprintf(detail, DETAIL_SIZE, "%s is 0x%X vs 0x%X", name,             \
+			(unsigned int)(X), (unsigned int)(Y));                            \
+		return false;                                                          \
+	}
+
+	FIELD(A->pc, B->pc, "PC");
+	FIELD(A->i, B->i, "I");
+	FIELD(A->sp, B->sp, "SP");
+
+	if( memcmp(A->v, B->v, sizeof(A->v)) != 0 ) {
+		for( int reg = 0; reg < 16; ++reg ) {
+			FIELD(A->v[reg], B->v[reg], "V%X", reg);
+		}
+	}
+
+	if( memcmp(A->stack, B->stack, sizeof(A->stack)) != 0 ) {
+		for( int level = 0; level < C8_STACK_SIZE; ++level ) {
+			FIELD(A->stack[level], B->stack[level], "stack[%d]", level);
+		}
+	}
+
+	FIELD(A->timers.dt, B->timers.dt, "DT");
+	FIELD(A->timers.st, B->timers.st, "ST");
+	FIELD(A->rng, B->rng, "RNG");
+	FIELD(A->pitch, B->pitch, "pitch");
+	FIELD(A->waiting, B->waiting, "waiting");
+	FIELD((uint8_t)A->waitKey, (uint8_t)B->waitKey, "waitKey");
+	FIELD(A->fault, B->fault, "fault");
+
+	if( memcmp(A->pattern, B->pattern, sizeof(A->pattern)) != 0 ) {
+		for( int n = 0; n < AUDIO_PATTERN_SIZE; ++n ) {
+			FIELD(A->pattern[n], B->pattern[n], "pattern[%d]", n);
+		}
+	}
+
+	for( int y = 0; y < SCR_HEIGHT; ++y ) {
+		if( A->display[y] != B->display[y] ) {
+			snprintf(detail, DETAIL_SIZE, "display row %d differs", y);
+			return false;
+		}
+	}
+
+	/* Pages still shared with the image are the same on both */
+	for( int page = 0; page < C8_PAGE_COUNT; ++page ) {
+		const uint8_t *PA = A->pages[page], *PB = B->pages[page];
+		if( PA == PB || memcmp(PA, PB, C8_PAGE_SIZE) == 0 ) {
+			continue;
+		}
+
+		for( int n = 0; n < C8_PAGE_SIZE; ++n ) {
+			FIELD(PA[n], PB[n], "mem[0x%03X]", page * C8_PAGE_SIZE + n);
+		}
+	}
+
+#undef FIELD
+
+	return true;
+}
+
+static void _freeCheckpoint(Checkpoint *cp) {
+	c8Free(&cp->ref);
+	c8Free(&cp->cand);
+}
+
+static int _save(Diff *diff, Checkpoint *cp) {
+	_freeCheckpoint(cp);
+
+	cp->executed = diff->executed;
+	cp->nextEvent = diff->nextEvent;
+
+	if( c8Clone(&cp->ref, &diff->ref) == EXIT_FAILURE ) {
+		cp->cand = (Chip8) { 0 };
+		return EXIT_FAILURE;
+	}
+
+	return c8Clone(&cp->cand, _candidate(diff));
+}
+
+static int _restore(Diff *diff, const Checkpoint *CP) {
+	diff->executed = CP->executed;
+	diff->nextEvent = CP->nextEvent;
+
+	c8Free(&diff->ref);
+	c8Free(&diff->batch.lanes[0]);
+
+	if( c8Clone(&diff->ref, &CP->ref) == EXIT_FAILURE
+		|| c8Clone(&diff->batch.lanes[0], &CP->cand) == EXIT_FAILURE ) {
+		return EXIT_FAILURE;
+	}
+
+	c8BatchPush(&diff->batch, 0);
+	return EXIT_SUCCESS;
+}
+
+/* Disassembles the code around the instruction that diverged */
+static void _report(Diff *diff, const char *DETAIL) {
+	const int CYCLES = diff->OPTS->cycles;
+
+	printf("Cores diverged at instruction %llu (frame %llu): %s "
+		   "(c8Cycle vs batch)\n\n",
+		(unsigned long long)diff->executed,
+		(unsigned long long)(diff->executed - 1) / CYCLES, DETAIL);
+
+	Printer prt;
+	if( prtNew(&prt, stdout, PRT_FORMAT_TEXT, false) == EXIT_FAILURE ) {
+		return;
+	}
+
+	/* Read from the reference, in case the program modified itself */
+	for( int i = -CONTEXT; i <= CONTEXT; ++i ) {
+		const uint16_t ADDR = (diff->lastPc + i * 2) & (MEM_SIZE - 1);
+		const uint16_t OPCODE = (c8ReadByte(&diff->ref, ADDR) << 8)
+			| c8ReadByte(&diff->ref, ADDR + 1);
+
+		prtString(&prt, i == 0 ? "-> " : "   ");
+		prtInstruction(&prt, ADDR, c8ParseInstruction(OPCODE));
+	}
+
+	prtFree(&prt);
+}
+
+/* Finds the exact instruction that diverged, after a hash mismatch */
+static int _replay(Diff *diff, const Checkpoint *CP, uint64_t until) {
+	char detail[DETAIL_SIZE];
+
+	if( _restore(diff, CP) == EXIT_FAILURE ) {
+		return EXIT_FAILURE;
+	}
+
+	while( diff->executed < until ) {
+		_step(diff);
+
+		if( !_compare(&diff->ref, _candidate(diff), detail) ) {
+			_report(diff, detail);
+			return EXIT_FAILURE;
+		}
+	}
+
+	/* Same states, hashing them differently */
+	_report(diff, "state hashes differ");
+	return EXIT_FAILURE;
+}
+
+static int _run(Diff *diff) {
+	const DiffOptions *OPTS = diff->OPTS;
+	const uint64_t TOTAL = (uint64_t)OPTS->frames * OPTS->cycles;
+
+	Checkpoint cp = { 0 };
+	if( OPTS->every > 1 && _save(diff, &cp) == EXIT_FAILURE ) {
+		return EXIT_FAILURE;
+	}
+
+	int result = EXIT_SUCCESS;
+	while( diff->executed < TOTAL ) {
+		_step(diff);
+
+		if( OPTS->every == 1 ) {
+			char detail[DETAIL_SIZE];
+			if( !_compare(&diff->ref, _candidate(diff), detail) ) {
+				_report(diff, detail);
+				result = EXIT_FAILURE;
+				break;
+			}
+		} else if( diff->executed % OPTS->every == 0
+			|| diff->executed == TOTAL ) {
+			if( c8StateHash(&diff->ref) != c8StateHash(_candidate(diff)) ) {
+				result = _replay(diff, &cp, diff->executed);
+				break;
+			}
+
+			if( _save(diff, &cp) == EXIT_FAILURE ) {
+				result = EXIT_FAILURE;
+				break;
+			}
+		}
+	}
+
+	_freeCheckpoint(&cp);
+
+	if( result == EXIT_SUCCESS ) {
+		printf("Cores agree over %llu instructions (%d frames)\n",
+			(unsigned long long)diff->executed, OPTS->frames);
+	}
+
+	return result;
+}
+
+int diffRun(const C8Image *IMAGE, const DiffOptions *OPTS) {
+	Diff diff = { .OPTS = OPTS };
+
+	if( OPTS->INPUT
+		&& keytraceLoad(&diff.input, OPTS->INPUT) == EXIT_FAILURE ) {
+		return EXIT_FAILURE;
+	}
+
+	if( c8BatchNew(&diff.batch, IMAGE, 1) == EXIT_FAILURE ) {
+		keytraceFree(&diff.input);
+		return EXIT_FAILURE;
+	}
+
+	/* Same seed as the batch gives its first lane */
+	diff.ref = c8NewShared(IMAGE);
+	c8Seed(&diff.ref, 1);
+
+	const int RESULT = _run(&diff);
+
+	c8Free(&diff.ref);
+	c8BatchFree(&diff.batch);
+	keytraceFree(&diff.input);
+
+	return RESULT;
+}
@@ -1,3 +1,4 @@
+#include <math.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -75,23 +76,149 @@ int clock_gettime(int, timespec *spec) {
 
 #define DEFAULT_SCALE_FACTOR 10.0f
 
-static void _draw(Emulator *emu) {
-	int pitch = 0;
-	void *pixels = NULL;
+#define DEFAULT_TRACE_PATH "chip8.trace"
 
-	if( SDL_LockTexture(emu->tex, NULL, &pixels, &pitch) != 0 ) {
-		fprintf(stderr, "ERR: Couldn't lock texture: %s\n", SDL_GetError());
-	} else {
-		memcpy(pixels, emu->c8.display, SCR_HEIGHT * SCR_WIDTH);
+#define NS_PER_SECOND 1000000000
+#define NS_PER_CYCLE 1000000 /* 1000 cycles per second */
+#define NS_PER_TICK (NS_PER_SECOND / 60)
+
+#define TURBO_BATCH 4096 /* Cycles between checks, uncapped */
+#define MAX_LAG (NS_PER_SECOND / 10) /* Host time given up on, when behind */
+
+static uint64_t _now(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (uint64_t)now.tv_sec * NS_PER_SECOND + now.tv_nsec;
+}
+
+/* Publishes every display as the newest frame */
+static void _publish(Emulator *emu) {
+	FrameBuffer *fb = &emu->fb;
+
+	uint64_t *frame = fb->frames[fb->back];
+	for( size_t n = 0; n < emu->count; ++n ) {
+		memcpy(frame + n * SCR_HEIGHT, emu->c8[n].display,
+			sizeof(emu->c8[n].display));
+		emu->c8[n].dirty = false;
 	}
 
-	SDL_UnlockTexture(emu->tex);
+	fb->back = atomic_exchange_explicit(
+				   &fb->ready, fb->back | FRAME_FRESH, memory_order_acq_rel)
+		& ~FRAME_FRESH;
+}
+
+/* Takes the newest frame, if there's one that hasn't been drawn yet */
+static bool _take(Emulator *emu) {
+	FrameBuffer *fb = &emu->fb;
+
+	if( !(atomic_load_explicit(&fb->ready, memory_order_relaxed)
+			& FRAME_FRESH) ) {
+		return false;
+	}
+
+	fb->front
+		= atomic_exchange_explicit(&fb->ready, fb->front, memory_order_acq_rel)
+		& ~FRAME_FRESH;
+	return true;
+}
+
+/* Expands a 1-bit display into RGB332 pixels, in its cell of the atlas */
+static void _expand(Emulator *emu, size_t n, const uint64_t *DISPLAY) {
+	const int PITCH = emu->columns * SCR_WIDTH;
+
+	uint8_t *cell = emu->atlas + (n / emu->columns) * SCR_HEIGHT * PITCH
+		+ (n % emu->columns) * SCR_WIDTH;
+
+	for( int y = 0; y < SCR_HEIGHT; ++y ) {
+		uint8_t *row = cell + y * PITCH;
+		for( int x = 0; x < SCR_WIDTH; ++x ) {
+			row[x] = (DISPLAY[y] >> (SCR_WIDTH - 1 - x)) & 1 ? 0xFF : 0x00;
+		}
+	}
+}
+
+/* Frame time graph, over the last STATS_HISTORY presents. Frames slower than
+ * the refresh are red, the line is the refresh
+ */
+static void _drawOverlay(Emulator *emu, uint64_t refresh) {
+	const RenderCounters *RENDER = &emu->stats.render;
+	const float WIDTH = emu->columns * SCR_WIDTH;
+	const float HEIGHT = emu->columns * SCR_HEIGHT;
+
+	/* Half the screen is 2 refreshes */
+	const float SCALE = HEIGHT / 4 / refresh;
+	const float BAR = WIDTH / STATS_HISTORY;
+
+	for( size_t n = 0; n < STATS_HISTORY; ++n ) {
+		const uint64_t FRAME
+			= RENDER->history[(RENDER->historyHead + n) % STATS_HISTORY];
+
+		float height = FRAME * SCALE;
+		if( height > HEIGHT / 2 ) {
+			height = HEIGHT / 2;
+		}
+
+		const SDL_FRect RECT = { n * BAR, HEIGHT - height, BAR, height };
+		if( FRAME > refresh + refresh / 2 ) {
+			SDL_SetRenderDrawColor(emu->renderer, 0xFF, 0x00, 0x00, 0xFF);
+		} else {
+			SDL_SetRenderDrawColor(emu->renderer, 0x00, 0xC0, 0x00, 0xFF);
+		}
+
+		SDL_RenderFillRectF(emu->renderer, &RECT);
+	}
+
+	const SDL_FRect LINE = { 0, HEIGHT - refresh * SCALE, WIDTH, 0.25f };
+	SDL_SetRenderDrawColor(emu->renderer, 0xFF, 0xFF, 0xFF, 0xFF);
+	SDL_RenderFillRectF(emu->renderer, &LINE);
+
+	SDL_SetRenderDrawColor(emu->renderer, 0x00, 0x00, 0x00, 0xFF);
+}
+
+static void _draw(Emulator *emu, uint64_t refresh) {
+	const uint64_t *FRAME = emu->fb.frames[emu->fb.front];
+	const size_t SIZE = SCR_HEIGHT * sizeof(*FRAME);
+
+	/* Only displays that changed since the last frame are expanded, then the
+	 * whole atlas goes up in one upload
+	 */
+	bool changed = false;
+	for( size_t n = 0; n < emu->count; ++n ) {
+		const uint64_t *DISPLAY = FRAME + n * SCR_HEIGHT;
+		uint64_t *shown = emu->shown + n * SCR_HEIGHT;
+
+		if( memcmp(shown, DISPLAY, SIZE) != 0 ) {
+			memcpy(shown, DISPLAY, SIZE);
+			_expand(emu, n, DISPLAY);
+			changed = true;
+		}
+	}
+
+	uint64_t upload = 0;
+	if( changed ) {
+		const uint64_t START = _now();
+		if( SDL_UpdateTexture(
+				emu->tex, NULL, emu->atlas, emu->columns * SCR_WIDTH)
+			!= 0 ) {
+			fprintf(stderr, "ERR: Couldn't update texture: %s\n",
+				SDL_GetError());
+		}
+
+		upload = _now() - START;
+	}
 
 	SDL_RenderClear(emu->renderer);
 	SDL_RenderCopy(emu->renderer, emu->tex, NULL, NULL);
+	if( emu->overlay ) {
+		_drawOverlay(emu, refresh);
+	}
+
+	const uint64_t PRESENT = _now();
 	SDL_RenderPresent(emu->renderer);
 
-	emu->c8.dirty = false;
+	const uint64_t NOW = _now();
+	statsPresent(&emu->stats, NOW, upload, NOW - PRESENT);
 }
 
 /*
@@ -135,80 +262,470 @@ static int _keyindex(int key) {
 	case SDLK_v:
 		return 0xF;
 	default:
-		return 0x0;
+		return -1;
 	}
 }
 
-#define NS_PER_SECOND 1000000000
+static void _dumpTrace(const Emulator *emu) {
+	if( emu->trace == NULL ) {
+		return;
+	}
 
-static struct timespec _getTimeDiff(struct timespec t1, struct timespec t2) {
-	struct timespec td;
+	if( traceDump(emu->trace, emu->tracePath) == EXIT_SUCCESS ) {
+		printf("Trace dumped to '%s'\n", emu->tracePath);
+	}
+}
+
+static bool _inputEmpty(Emulator *emu) {
+	return atomic_load(&emu->input.tail) == atomic_load(&emu->input.head);
+}
 
-	td.tv_nsec = t2.tv_nsec - t1.tv_nsec;
-	td.tv_sec = t2.tv_sec - t1.tv_sec;
+/* Queues a key event, and wakes the emulation thread if it's parked */
+static void _pushInput(Emulator *emu, int key, bool down) {
+	InputQueue *queue = &emu->input;
 
-	if( td.tv_sec > 0 && td.tv_nsec < 0 ) {
-		td.tv_nsec += NS_PER_SECOND;
-		td.tv_sec--;
-	} else if( td.tv_sec < 0 && td.tv_nsec > 0 ) {
-		td.tv_nsec -= NS_PER_SECOND;
-		td.tv_sec++;
+	if( key < 0 ) {
+		return;
 	}
 
-	return td;
+	const uint32_t HEAD
+		= atomic_load_explicit(&queue->head, memory_order_relaxed);
+	if( HEAD - atomic_load(&queue->tail) == INPUT_QUEUE_SIZE ) {
+		return;
+	}
+
+	queue->events[HEAD & (INPUT_QUEUE_SIZE - 1)] = (InputEvent) {
+		.time = _now(),
+		.key = key,
+		.down = down,
+	};
+	atomic_store(&queue->head, HEAD + 1);
+
+	/* Checked after the push, the emulation thread checks the queue after
+	 * setting it, so one of the two always sees the other
+	 */
+	if( atomic_load(&emu->parked) ) {
+		SDL_LockMutex(emu->parkLock);
+		SDL_CondSignal(emu->parkCond);
+		SDL_UnlockMutex(emu->parkLock);
+	}
 }
 
-static Uint32 _updateTimers(Uint32 interval, void *emu) {
-	Chip8 *c8 = &((Emulator *)emu)->c8;
-	if( c8->timers.dt > 0 ) {
-		--c8->timers.dt;
+/* Feeds queued key events to the interpreter */
+static void _drainInput(Emulator *emu) {
+	InputQueue *queue = &emu->input;
+
+	const uint32_t HEAD = atomic_load(&queue->head);
+	uint32_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+	if( tail == HEAD ) {
+		return;
 	}
 
-	if( c8->timers.st > 0 ) {
-		--c8->timers.st;
+	const uint64_t NOW = _now();
+	for( ; tail != HEAD; ++tail ) {
+		const InputEvent *EV = &queue->events[tail & (INPUT_QUEUE_SIZE - 1)];
+
+		/* Every instance gets the keypad */
+		for( size_t n = 0; n < emu->count; ++n ) {
+			c8KeyEvent(&emu->c8[n], EV->key, EV->down);
+		}
+
+		emu->inputLatency = NOW - EV->time;
 	}
 
-	return interval;
+	atomic_store(&queue->tail, tail);
 }
 
-static int _run(Emulator *emu) {
-	bool run = true;
-	SDL_Event e;
+/* Checks if every instance is waiting on FX0A */
+static bool _allWaiting(const Emulator *emu) {
+	for( size_t n = 0; n < emu->count; ++n ) {
+		if( !emu->c8[n].waiting ) {
+			return false;
+		}
+	}
 
-	struct timespec start, end;
-	clock_gettime(CLOCK_MONOTONIC, &start);
+	return true;
+}
 
-	SDL_AddTimer(16, _updateTimers, emu);
+/* Checks if any instance has a timer running */
+static bool _timersRunning(const Emulator *emu) {
+	for( size_t n = 0; n < emu->count; ++n ) {
+		if( emu->c8[n].timers.dt > 0 || emu->c8[n].timers.st > 0 ) {
+			return true;
+		}
+	}
 
-	while( run ) {
-		while( SDL_PollEvent(&e) != 0 ) {
-			switch( e.type ) {
-			case SDL_QUIT:
-				run = false;
-				break;
-			case SDL_KEYDOWN:
-				emu->c8.keypad[_keyindex(e.key.keysym.sym)] = 1;
-				break;
-			case SDL_KEYUP:
-				emu->c8.keypad[_keyindex(e.key.keysym.sym)] = 0;
+	return false;
+}
+
+/* Sleeps while FX0A waits for a key, instead of spinning
+ *
+ * Running timers still need ticking and the GDB stub still needs pumping, so
+ * those only sleep for a while. Returns when an event arrives, or on quit
+ */
+static void _park(Emulator *emu) {
+	Uint32 timeout = 0;
+	if( _timersRunning(emu) ) {
+		timeout = NS_PER_TICK / 1000000;
+	} else if( emu->gdb ) {
+		timeout = 10;
+	}
+
+	SDL_LockMutex(emu->parkLock);
+	atomic_store(&emu->parked, true);
+
+	if( _inputEmpty(emu) && atomic_load(&emu->running) ) {
+		if( timeout > 0 ) {
+			SDL_CondWaitTimeout(emu->parkCond, emu->parkLock, timeout);
+		} else {
+			SDL_CondWait(emu->parkCond, emu->parkLock);
+		}
+	}
+
+	atomic_store(&emu->parked, false);
+	SDL_UnlockMutex(emu->parkLock);
+}
+
+/* Emulated time, kept in step with the host clock times the speed */
+typedef struct _Clock {
+	uint64_t emulated; /* Nanoseconds, one cycle is NS_PER_CYCLE */
+	uint64_t nextTick; /* Emulated time of the next timer tick */
+
+	/* Last sync point, and the speed since then */
+	uint64_t hostBase;
+	uint64_t emulatedBase;
+	int speed;
+} Clock;
+
+/* Restarts the clock from now, forgetting any lag */
+static void _sync(Clock *clock, int speed) {
+	clock->hostBase = _now();
+	clock->emulatedBase = clock->emulated;
+	clock->speed = speed;
+}
+
+/* Runs one cycle on every instance */
+static void _cycle(Emulator *emu) {
+	_drainInput(emu);
+
+	if( emu->gdb ) {
+		gdbCycle(emu->gdb);
+	} else {
+		c8Cycle(&emu->c8[0]);
+	}
+
+	for( size_t n = 1; n < emu->count; ++n ) {
+		c8Cycle(&emu->c8[n]);
+	}
+}
+
+/* Runs a frame on every instance, with the VIP timing model. Returns the
+ * instructions executed
+ */
+static uint64_t _vipFrame(Emulator *emu) {
+	_drainInput(emu);
+
+	uint64_t executed = 0;
+	size_t n = 0;
+
+	/* Halting in GDB ends the frame early */
+	if( emu->gdb ) {
+		Chip8 *c8 = &emu->c8[n++];
+		for( ; c8->vipCycles < VIP_CYCLES_PER_FRAME; ++executed ) {
+			if( !gdbCycle(emu->gdb) ) {
 				break;
 			}
 		}
 
-		clock_gettime(CLOCK_MONOTONIC, &end);
-		if( _getTimeDiff(start, end).tv_nsec < 1000000 ) {
-			continue;
+		c8EndVipFrame(c8);
+	}
+
+	for( ; n < emu->count; ++n ) {
+		executed += c8VipFrame(&emu->c8[n]);
+	}
+
+	return executed;
+}
+
+/* Ticks every timer, and collects the frame's drawing counters */
+static void _tick(Emulator *emu) {
+	uint64_t draws = 0;
+	uint64_t pixels = 0;
+
+	for( size_t n = 0; n < emu->count; ++n ) {
+		Chip8 *c8 = &emu->c8[n];
+
+		c8TickTimers(c8);
+
+		draws += c8->draws;
+		pixels += c8->pixels;
+		c8->draws = 0;
+		c8->pixels = 0;
+	}
+
+	if( emu->capture ) {
+		captureFrame(emu->capture, &emu->c8[0]);
+	}
+
+	statsAdd(&emu->stats.emu.frames, 1);
+	statsAdd(&emu->stats.emu.draws, draws);
+	statsAdd(&emu->stats.emu.pixels, pixels);
+}
+
+static bool _anyDirty(const Emulator *emu) {
+	for( size_t n = 0; n < emu->count; ++n ) {
+		if( emu->c8[n].dirty ) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/* Emulation thread: runs the interpreters, and nothing else
+ *
+ * Cycles are run in batches, as many as the speed allows since the last one
+ * (or TURBO_BATCH, uncapped). Timers tick on emulated time, so they speed up
+ * along with everything else. With the VIP timing, whole frames are run
+ * instead, each instance going through as many instructions as it can afford
+ */
+static int _emulate(void *data) {
+	Emulator *emu = data;
+
+	Clock clock = { .nextTick = NS_PER_TICK };
+	_sync(&clock, atomic_load(&emu->speed));
+
+	const bool VIP = emu->timing == C8_TIMING_VIP;
+	const uint64_t STEP = VIP ? NS_PER_TICK : NS_PER_CYCLE;
+
+	while( atomic_load_explicit(&emu->running, memory_order_relaxed) ) {
+		const bool TURBO
+			= atomic_load_explicit(&emu->turbo, memory_order_relaxed);
+		const int SPEED
+			= atomic_load_explicit(&emu->speed, memory_order_relaxed);
+
+		/* Uncapped, waiting timers are run out instead of slept through */
+		if( _allWaiting(emu) && _inputEmpty(emu)
+			&& !(TURBO && _timersRunning(emu)) ) {
+			_park(emu);
+		}
+
+		if( SPEED != clock.speed ) {
+			_sync(&clock, SPEED);
+		}
+
+		uint64_t target = clock.emulated + (uint64_t)TURBO_BATCH * NS_PER_CYCLE;
+		if( !TURBO ) {
+			target = clock.emulatedBase + (_now() - clock.hostBase) * SPEED;
+
+			/* Too far behind, after a long park or a stall */
+			if( target < clock.emulated
+				|| target - clock.emulated > (uint64_t)MAX_LAG * SPEED ) {
+				if( target > clock.emulated ) {
+					statsAdd(&emu->stats.emu.lostNs, target - clock.emulated);
+				}
+
+				_sync(&clock, SPEED);
+				continue;
+			}
+
+			if( target - clock.emulated < STEP ) {
+				SDL_Delay(1);
+				continue;
+			}
+		}
+
+		if( emu->gdb ) {
+			gdbPump(emu->gdb);
+		}
+
+		uint64_t cycles = 0;
+		if( VIP ) {
+			for( ; clock.nextTick <= target; clock.nextTick += NS_PER_TICK ) {
+				cycles += _vipFrame(emu);
+
+				clock.emulated = clock.nextTick;
+				_tick(emu);
+			}
+		} else {
+			for( ; clock.emulated + NS_PER_CYCLE <= target; ++cycles ) {
+				_cycle(emu);
+
+				clock.emulated += NS_PER_CYCLE;
+				if( clock.emulated >= clock.nextTick ) {
+					clock.nextTick += NS_PER_TICK;
+					_tick(emu);
+				}
+			}
+
+			cycles *= emu->count;
+		}
+
+		statsAdd(&emu->stats.emu.cycles, cycles);
+
+		audioPump(&emu->audio, &emu->c8[0]);
+
+		/* Only the last frame of a batch is ever seen */
+		if( _anyDirty(emu) ) {
+			_publish(emu);
+		}
+
+		/* Turbo returns to capped speed from wherever it got to */
+		if( TURBO ) {
+			_sync(&clock, SPEED);
 		}
+	}
+
+	return EXIT_SUCCESS;
+}
+
+/* Speed hotkeys. Returns true if the key was one */
+static bool _hotkey(Emulator *emu, SDL_Keycode key) {
+	const int SPEED = atomic_load(&emu->speed);
+
+	switch( key ) {
+	case SDLK_F1:
+		emuSetTurbo(emu, false);
+		emuSetSpeed(emu, 1);
+		return true;
+	case SDLK_F2:
+		emuSetSpeed(emu, SPEED > 1 ? SPEED / 2 : 1);
+		return true;
+	case SDLK_F3:
+		emuSetSpeed(emu, SPEED < EMU_SPEED_MAX ? SPEED * 2 : EMU_SPEED_MAX);
+		return true;
+	case SDLK_F4:
+		emuSetTurbo(emu, !atomic_load(&emu->turbo));
+		return true;
+	case SDLK_F5:
+		emuSetOverlay(emu, !emu->overlay);
+		return true;
+	case SDLK_F12:
+		_dumpTrace(emu);
+		return true;
+	default:
+		return false;
+	}
+}
 
-		clock_gettime(CLOCK_MONOTONIC, &start);
+/* Shows the speed and instructions per second in the window title */
+static void _showSpeed(Emulator *emu, const StatsReport *REPORT) {
+	char mode[16] = "";
+	if( atomic_load(&emu->turbo) ) {
+		snprintf(mode, sizeof(mode), " (turbo)");
+	} else if( atomic_load(&emu->speed) > 1 ) {
+		snprintf(mode, sizeof(mode), " (%dx)", atomic_load(&emu->speed));
+	}
+
+	char title[64];
+	snprintf(title, sizeof(title), "Chip-8 emulator%s - %.0f IPS", mode,
+		REPORT->ips);
+	SDL_SetWindowTitle(emu->window, title);
+}
+
+/* Reports the stats of the last second */
+static void _report(Emulator *emu, uint64_t NOW) {
+	StatsReport report;
+	statsReport(&emu->stats, NOW, &report);
+
+	report.underruns = atomic_load(&emu->audio.underruns);
+	report.overruns = atomic_load(&emu->audio.overruns);
+
+	_showSpeed(emu, &report);
+
+	if( emu->statsFile ) {
+		statsWrite(&report, emu->statsFile);
+		fflush(emu->statsFile);
+	}
+}
 
-		c8Cycle(&emu->c8);
+/* Time between refreshes of the window's display */
+static uint64_t _refreshInterval(Emulator *emu) {
+	SDL_DisplayMode mode;
 
-		if( emu->c8.dirty ) {
-			_draw(emu);
+	const int DISPLAY = SDL_GetWindowDisplayIndex(emu->window);
+	if( DISPLAY < 0 || SDL_GetCurrentDisplayMode(DISPLAY, &mode) != 0
+		|| mode.refresh_rate <= 0 ) {
+		return NS_PER_TICK;
+	}
+
+	return NS_PER_SECOND / mode.refresh_rate;
+}
+
+/* Render thread: handles events and presents frames, so waiting for vsync
+ * never holds the interpreter back
+ */
+static int _run(Emulator *emu) {
+	SDL_Event e;
+
+	emu->fb.back = 0;
+	emu->fb.front = 1;
+	atomic_init(&emu->fb.ready, 2);
+	statsInit(&emu->stats, _now());
+
+	atomic_store(&emu->running, true);
+	emu->thread = SDL_CreateThread(_emulate, "emulation", emu);
+	if( emu->thread == NULL ) {
+		fprintf(stderr, "ERR: Failed to create emulation thread: %s\n",
+			SDL_GetError());
+		return EXIT_FAILURE;
+	}
+
+	const uint64_t REFRESH = _refreshInterval(emu);
+	uint64_t lastPresent = 0;
+	uint64_t lastReport = _now();
+
+	bool run = true;
+	while( run ) {
+		/* Wakes up at least once per frame, to present it */
+		if( SDL_WaitEventTimeout(&e, 1) ) {
+			do {
+				switch( e.type ) {
+				case SDL_QUIT:
+					run = false;
+					break;
+				case SDL_KEYDOWN:
+					if( _hotkey(emu, e.key.keysym.sym) ) {
+						break;
+					}
+
+					if( !e.key.repeat ) {
+						_pushInput(emu, _keyindex(e.key.keysym.sym), true);
+					}
+					break;
+				case SDL_KEYUP:
+					_pushInput(emu, _keyindex(e.key.keysym.sym), false);
+					break;
+				}
+			} while( SDL_PollEvent(&e) != 0 );
+		}
+
+		const uint64_t NOW = _now();
+
+		/* At most one present per refresh. Frames published in between are
+		 * never taken, so they're never uploaded either
+		 */
+		if( NOW - lastPresent >= REFRESH && (_take(emu) || emu->redraw) ) {
+			_draw(emu, REFRESH);
+			lastPresent = NOW;
+			emu->redraw = false;
+		}
+
+		if( NOW - lastReport >= NS_PER_SECOND ) {
+			_report(emu, NOW);
+			lastReport = NOW;
 		}
 	}
 
+	atomic_store(&emu->running, false);
+
+	SDL_LockMutex(emu->parkLock);
+	SDL_CondSignal(emu->parkCond);
+	SDL_UnlockMutex(emu->parkLock);
+
+	SDL_WaitThread(emu->thread, NULL);
+	emu->thread = NULL;
+
 	return EXIT_SUCCESS;
 }
 
@@ -216,6 +733,38 @@ int emuNew(Emulator *emu) {
 	emu->window = NULL;
 	emu->renderer = NULL;
 	emu->tex = NULL;
+	emu->gdb = NULL;
+	emu->capture = NULL;
+	emu->thread = NULL;
+	emu->audio.device = 0;
+	emu->c8 = NULL;
+	emu->count = 0;
+	emu->columns = 0;
+	emu->atlas = NULL;
+	emu->shown = NULL;
+	emu->fb = (FrameBuffer) { 0 };
+	emu->inputLatency = 0;
+	atomic_init(&emu->input.head, 0);
+	atomic_init(&emu->input.tail, 0);
+	atomic_init(&emu->parked, false);
+	atomic_init(&emu->running, false);
+	atomic_init(&emu->speed, 1);
+	atomic_init(&emu->turbo, false);
+	emu->timing = C8_TIMING_FIXED;
+	emu->statsFile = NULL;
+	emu->overlay = false;
+	emu->redraw = false;
+
+	emu->parkLock = SDL_CreateMutex();
+	emu->parkCond = SDL_CreateCond();
+	if( emu->parkLock == NULL || emu->parkCond == NULL ) {
+		fprintf(stderr, "ERR: Failed to create mutex: %s\n", SDL_GetError());
+		return EXIT_FAILURE;
+	}
+
+	/* Tracing is cheap enough to leave on, it's only written out on demand */
+	emu->trace = traceNew();
+	emuSetTraceFile(emu, DEFAULT_TRACE_PATH);
 
 	if( SDL_Init(SDL_INIT_EVERYTHING) != 0 ) {
 		fprintf(stderr, "ERR: Failed to initialize SDL: %s\n", SDL_GetError());
@@ -236,47 +785,151 @@ int emuNew(Emulator *emu) {
 		return EXIT_FAILURE;
 	}
 
-	if( SDL_RenderSetLogicalSize(emu->renderer, SCR_WIDTH, SCR_HEIGHT) != 0 ) {
-		fprintf(stderr, "ERR: Failed to set size: %s\n", SDL_GetError());
+	SDL_SetWindowTitle(emu->window, "Chip-8 emulator");
+
+	/* Runs silently without a device */
+	audioNew(&emu->audio);
+
+	return emuSetGrid(emu, 1);
+}
+
+/* Frees the instances, and everything sized after them */
+static void _freeGrid(Emulator *emu) {
+	for( size_t n = 0; n < emu->count; ++n ) {
+		c8Free(&emu->c8[n]);
+	}
+
+	free(emu->c8);
+	emu->c8 = NULL;
+	emu->count = 0;
+
+	for( int i = 0; i < 3; ++i ) {
+		free(emu->fb.frames[i]);
+		emu->fb.frames[i] = NULL;
+	}
+
+	free(emu->atlas);
+	free(emu->shown);
+	emu->atlas = NULL;
+	emu->shown = NULL;
+
+	if( emu->tex ) {
+		SDL_DestroyTexture(emu->tex);
+		emu->tex = NULL;
+	}
+}
+
+int emuSetGrid(Emulator *emu, int columns) {
+	if( emu->gdb ) {
+		fprintf(stderr, "ERR: The grid must be set before serving GDB\n");
 		return EXIT_FAILURE;
 	}
 
-	if( SDL_RenderSetScale(
-			emu->renderer, DEFAULT_SCALE_FACTOR, DEFAULT_SCALE_FACTOR)
-		!= 0 ) {
-		fprintf(stderr, "ERR: Failed to set scale: %s\n", SDL_GetError());
+	if( columns < 1 || columns > EMU_GRID_MAX ) {
+		fprintf(stderr, "ERR: Grid must be 1 to %d instances wide\n",
+			EMU_GRID_MAX);
 		return EXIT_FAILURE;
 	}
 
-	SDL_SetWindowTitle(emu->window, "Chip-8 emulator");
+	_freeGrid(emu);
+
+	const size_t COUNT = (size_t)columns * columns;
+	const int WIDTH = columns * SCR_WIDTH;
+	const int HEIGHT = columns * SCR_HEIGHT;
+
+	emu->columns = columns;
+	emu->c8 = malloc(COUNT * sizeof(*emu->c8));
+	emu->atlas = calloc((size_t)WIDTH * HEIGHT, sizeof(*emu->atlas));
+	emu->shown = calloc(COUNT * SCR_HEIGHT, sizeof(*emu->shown));
+
+	bool allocated = emu->c8 && emu->atlas && emu->shown;
+	for( int i = 0; i < 3; ++i ) {
+		emu->fb.frames[i] = calloc(COUNT * SCR_HEIGHT, sizeof(uint64_t));
+		allocated &= emu->fb.frames[i] != NULL;
+	}
+
+	if( !allocated ) {
+		fprintf(stderr, "ERR: Couldn't allocate memory for %zu instances\n",
+			COUNT);
+		_freeGrid(emu);
+		return EXIT_FAILURE;
+	}
+
+	/* Faulting programs abort with a diagnostic, rather than freezing */
+	for( emu->count = 0; emu->count < COUNT; ++emu->count ) {
+		emu->c8[emu->count] = c8New();
+		emu->c8[emu->count].trap = true;
+	}
+
+	emu->c8[0].trace = emu->trace;
+
+	if( SDL_RenderSetLogicalSize(emu->renderer, WIDTH, HEIGHT) != 0 ) {
+		fprintf(stderr, "ERR: Failed to set size: %s\n", SDL_GetError());
+		return EXIT_FAILURE;
+	}
+
+	/* The default scale, shrunk so the whole grid fits in the window */
+	const float SCALE = fminf(DEFAULT_SCALE_FACTOR,
+		fminf((float)WINDOW_WIDTH / WIDTH, (float)WINDOW_HEIGHT / HEIGHT));
+	if( emuSetScaleFactor(emu, SCALE) == EXIT_FAILURE ) {
+		return EXIT_FAILURE;
+	}
 
 	emu->tex = SDL_CreateTexture(emu->renderer, SDL_PIXELFORMAT_RGB332,
-		SDL_TEXTUREACCESS_STREAMING, SCR_WIDTH, SCR_HEIGHT);
+		SDL_TEXTUREACCESS_STREAMING, WIDTH, HEIGHT);
 	if( emu->tex == NULL ) {
 		fprintf(stderr, "ERR: Failed to create texture: %s\n", SDL_GetError());
 		return EXIT_FAILURE;
 	}
 
-	emu->c8 = c8New();
-
 	return EXIT_SUCCESS;
 }
 
-int emuRun(Emulator *emu, uint8_t *program, size_t size) {
-	if( c8Load(&emu->c8, program, size) == EXIT_FAILURE ) {
-		fprintf(stderr, "ERR: c8Load failed!\n");
-		return EXIT_FAILURE;
+int emuRun(Emulator *emu, const uint8_t *program, size_t size) {
+	for( size_t n = 0; n < emu->count; ++n ) {
+		const C8LoadError ERROR = c8Load(&emu->c8[n], program, size);
+		if( ERROR != C8_LOAD_OK ) {
+			fprintf(stderr, "ERR: c8Load failed: %s\n",
+				c8LoadErrorString(ERROR));
+			return EXIT_FAILURE;
+		}
 	}
 
 	return _run(emu);
 }
 
 int emuRunFile(Emulator *emu, const char *PATH) {
-	if( c8LoadFile(&emu->c8, PATH) > 0 ) {
-		fprintf(stderr, "ERR: c8LoadFile failed!\n");
+	return emuRunFiles(emu, &PATH, 1);
+}
+
+int emuRunFiles(Emulator *emu, const char **PATHS, size_t count) {
+	if( count > emu->count ) {
+		fprintf(stderr, "ERR: %zu programs, but only %zu instances\n", count,
+			emu->count);
 		return EXIT_FAILURE;
 	}
 
+	/* Each file is mapped once, and copied into its instances */
+	for( size_t file = 0; file < count; ++file ) {
+		C8Rom rom;
+
+		C8LoadError error = c8RomOpen(&rom, PATHS[file]);
+		if( error == C8_LOAD_OK ) {
+			for( size_t n = file; error == C8_LOAD_OK && n < emu->count;
+				 n += count ) {
+				error = c8LoadRom(&emu->c8[n], &rom);
+			}
+
+			c8RomClose(&rom);
+		}
+
+		if( error != C8_LOAD_OK ) {
+			fprintf(stderr, "ERR: Couldn't load '%s': %s\n", PATHS[file],
+				c8LoadErrorString(error));
+			return EXIT_FAILURE;
+		}
+	}
+
 	return _run(emu);
 }
 
@@ -284,6 +937,55 @@ void emuSetDelay(Emulator *emu, const int delayms) {
 	emu->delay = delayms * 1000000;
 }
 
+int emuSetSpeed(Emulator *emu, int speed) {
+	if( speed < 1 || speed > EMU_SPEED_MAX ) {
+		fprintf(stderr, "ERR: Speed must be 1 to %d\n", EMU_SPEED_MAX);
+		return EXIT_FAILURE;
+	}
+
+	atomic_store(&emu->speed, speed);
+	return EXIT_SUCCESS;
+}
+
+void emuSetTurbo(Emulator *emu, bool turbo) {
+	atomic_store(&emu->turbo, turbo);
+}
+
+void emuSetTiming(Emulator *emu, C8Timing timing) {
+	emu->timing = timing;
+}
+
+int emuSetCapture(Emulator *emu, const char *PATH) {
+	emu->capture = malloc(sizeof(*emu->capture));
+	if( emu->capture == NULL ) {
+		fprintf(stderr, "ERR: Couldn't allocate memory for capture\n");
+		return EXIT_FAILURE;
+	}
+
+	if( captureNew(emu->capture, PATH) == EXIT_FAILURE ) {
+		free(emu->capture);
+		emu->capture = NULL;
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+int emuSetStatsFile(Emulator *emu, const char *PATH) {
+	emu->statsFile = fopen(PATH, "w");
+	if( emu->statsFile == NULL ) {
+		fprintf(stderr, "ERR: Couldn't open '%s' for stats\n", PATH);
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+void emuSetOverlay(Emulator *emu, bool overlay) {
+	emu->overlay = overlay;
+	emu->redraw = true;
+}
+
 int emuSetScaleFactor(Emulator *emu, const float SCALE) {
 	if( SDL_RenderSetScale(emu->renderer, SCALE, SCALE) != 0 ) {
 		fprintf(stderr, "ERR: Failed to set scale: %s\n", SDL_GetError());
@@ -293,11 +995,63 @@ int emuSetScaleFactor(Emulator *emu, const float SCALE) {
 	return EXIT_SUCCESS;
 }
 
+void emuSetTraceFile(Emulator *emu, const char *PATH) {
+	emu->tracePath = PATH;
+	traceDumpOnCrash(emu->trace, PATH);
+}
+
+int emuServeGdb(Emulator *emu, const char *PATH) {
+	emu->gdb = malloc(sizeof(*emu->gdb));
+	if( emu->gdb == NULL ) {
+		fprintf(stderr, "ERR: Couldn't allocate memory for GDB stub\n");
+		return EXIT_FAILURE;
+	}
+
+	if( gdbNew(emu->gdb, &emu->c8[0], PATH) == EXIT_FAILURE ) {
+		gdbFree(emu->gdb);
+		free(emu->gdb);
+		emu->gdb = NULL;
+		return EXIT_FAILURE;
+	}
+
+	/* Stopped on the fault, for the debugger to look into */
+	emu->c8[0].trap = false;
+	return EXIT_SUCCESS;
+}
+
 void emuQuit(Emulator *emu) {
-	if( emu->tex ) {
-		SDL_DestroyTexture(emu->tex);
+	if( emu->gdb ) {
+		gdbFree(emu->gdb);
+		free(emu->gdb);
+		emu->gdb = NULL;
+	}
+
+	audioFree(&emu->audio);
+	_freeGrid(emu);
+
+	if( emu->capture ) {
+		captureFree(emu->capture);
+		free(emu->capture);
+		emu->capture = NULL;
 	}
 
+	if( emu->statsFile ) {
+		fclose(emu->statsFile);
+		emu->statsFile = NULL;
+	}
+
+	if( emu->parkCond ) {
+		SDL_DestroyCond(emu->parkCond);
+	}
+
+	if( emu->parkLock ) {
+		SDL_DestroyMutex(emu->parkLock);
+	}
+
+	traceDumpOnCrash(NULL, NULL);
+	traceFree(emu->trace);
+	emu->trace = NULL;
+
 	if( emu->renderer ) {
 		SDL_DestroyRenderer(emu->renderer);
 	}
@@ -0,0 +1,674 @@
+/* Chip-8 GDB stub
+ *
+ * Serves a subset of the GDB remote serial protocol: registers, memory,
+ * breakpoints, watchpoints, stepping and continuing. Packets are read a byte
+ * at a time through a small state machine, so partial reads never block the
+ * emulator
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chip8.h"
+#include "debugger.h"
+#include "gdbstub.h"
+
+#if defined(_WIN32) || defined(WIN32)
+int gdbNew(GdbStub *stub, Chip8 *c8, const char *PATH) {
+	fprintf(stderr, "ERR: The GDB stub isn't supported on Windows\n");
+	return EXIT_FAILURE;
+}
+
+void gdbPump(GdbStub *stub) {
+}
+
+bool gdbCycle(GdbStub *stub) {
+	return false;
+}
+
+void gdbFree(GdbStub *stub) {
+}
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+/* Bytes read from the client at once */
+#define READ_SIZE 256
+
+static const char HEX[] = "0123456789abcdef";
+
+static int _hexValue(char c) {
+	if( c >= '0' && c <= '9' ) {
+		return c - '0';
+	} else if( c >= 'a' && c <= 'f' ) {
+		return c - 'a' + 10;
+	} else if( c >= 'A' && c <= 'F' ) {
+		return c - 'A' + 10;
+	}
+
+	return -1;
+}
+
+static int _nonblocking(int fd) {
+	const int FLAGS = fcntl(fd, F_GETFL, 0);
+	if( FLAGS < 0 || fcntl(fd, F_SETFL, FLAGS | O_NONBLOCK) < 0 ) {
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+static void _attach(GdbStub *stub, int in, int out) {
+	stub->in = in;
+	stub->out = out;
+
+	stub->halted = true;
+	stub->resuming = false;
+	stub->state = GDB_STATE_IDLE;
+}
+
+/* Lets the interpreter go, and forgets the client's breakpoints */
+static void _detach(GdbStub *stub) {
+	if( stub->server >= 0 && stub->in >= 0 ) {
+		close(stub->in);
+	}
+
+	/* On stdio, the client's end of stdout is a copy, see gdbNew */
+	if( stub->server < 0 && stub->out >= 0 ) {
+		close(stub->out);
+	}
+
+	stub->in = -1;
+	stub->out = -1;
+	stub->halted = false;
+	stub->pendingSize = 0;
+
+	dbgAttach(&stub->dbg, stub->dbg.c8, 0);
+}
+
+/* Sends as much of the pending replies as the client takes without blocking */
+static void _flush(GdbStub *stub) {
+	size_t sent = 0;
+	while( sent < stub->pendingSize && stub->out >= 0 ) {
+		const char *DATA = stub->pending + sent;
+		const size_t SIZE = stub->pendingSize - sent;
+		const ssize_t WRITTEN = stub->server >= 0
+			? send(stub->out, DATA, SIZE, MSG_NOSIGNAL)
+			: write(stub->out, DATA, SIZE);
+
+		if( WRITTEN < 0 && errno == EINTR ) {
+			continue;
+		} else if( WRITTEN < 0
+			&& (errno == EAGAIN || errno == EWOULDBLOCK) ) {
+			break;
+		} else if( WRITTEN < 0 ) {
+			_detach(stub);
+			return;
+		}
+
+		sent += WRITTEN;
+	}
+
+	memmove(stub->pending, stub->pending + sent, stub->pendingSize - sent);
+	stub->pendingSize -= sent;
+}
+
+/* Queues bytes for the client. Clients that stopped reading are dropped */
+static void _write(GdbStub *stub, const char *DATA, size_t size) {
+	if( stub->pendingSize + size > GDB_PENDING_SIZE ) {
+		_flush(stub);
+	}
+
+	if( stub->out < 0 ) {
+		return;
+	}
+
+	if( stub->pendingSize + size > GDB_PENDING_SIZE ) {
+		fprintf(stderr, "ERR: GDB client isn't reading replies, dropping it\n");
+		_detach(stub);
+		return;
+	}
+
+	memcpy(stub->pending + stub->pendingSize, DATA, size);
+	stub->pendingSize += size;
+}
+
+/* Sends a packet, framed and checksummed */
+static void _send(GdbStub *stub, const char *PAYLOAD) {
+	char packet[GDB_PACKET_SIZE + 4];
+	size_t size = 0;
+	uint8_t checksum = 0;
+
+	packet[size++] = '$';
+	for( const char *c = PAYLOAD; *c && size < GDB_PACKET_SIZE + 1; ++c ) {
+		packet[size++] = *c;
+		checksum += *c;
+	}
+
+	packet[size++] = '#';
+	packet[size++] = HEX[checksum >> 4];
+	packet[size++] = HEX[checksum & 0xF];
+
+	_write(stub, packet, size);
+}
+
+static void _sendStop(GdbStub *stub, DbgStop stop) {
+	char reply[32];
+	if( stop == DBG_STOP_WATCHPOINT ) {
+		snprintf(reply, sizeof(reply), "T05watch:%x;", stub->dbg.watched);
+	} else {
+		snprintf(reply, sizeof(reply), "S05");
+	}
+
+	_send(stub, reply);
+}
+
+/* Writes a register as little-endian hex. Returns the digits written */
+static size_t _readReg(const Chip8 *C8, int reg, char *out) {
+	uint16_t value;
+	size_t bytes = 1;
+
+	switch( reg ) {
+	case GDB_REG_I:
+		value = C8->i;
+		bytes = 2;
+		break;
+	case GDB_REG_PC:
+		value = C8->pc;
+		bytes = 2;
+		break;
+	case GDB_REG_SP:
+		value = C8->sp;
+		break;
+	case GDB_REG_DT:
+		value = C8->timers.dt;
+		break;
+	case GDB_REG_ST:
+		value = C8->timers.st;
+		break;
+	default:
+		value = C8->v[reg];
+		break;
+	}
+
+	for( size_t b = 0; b < bytes; ++b, value >>= 8 ) {
+		*out++ = HEX[(value >> 4) & 0xF];
+		*out++ = HEX[value & 0xF];
+	}
+
+	return bytes * 2;
+}
+
+/* Reads a register from little-endian hex. Returns the digits read, or 0 */
+static size_t _writeReg(Chip8 *c8, int reg, const char *IN) {
+	const size_t BYTES = reg == GDB_REG_I || reg == GDB_REG_PC ? 2 : 1;
+
+	uint16_t value = 0;
+	for( size_t b = 0; b < BYTES; ++b ) {
+		const int HIGH = _hexValue(IN[b * 2]);
+		const int LOW = HIGH < 0 ? -1 : _hexValue(IN[b * 2 + 1]);
+		if( LOW < 0 ) {
+			return 0;
+		}
+
+		value |= ((HIGH << 4) | LOW) << (b * 8);
+	}
+
+	switch( reg ) {
+	case GDB_REG_I:
+		c8->i = value;
+		break;
+	case GDB_REG_PC:
+		c8->pc = value;
+		break;
+	case GDB_REG_SP:
+		c8->sp = value & 0xF;
+		break;
+	case GDB_REG_DT:
+		c8->timers.dt = value;
+		break;
+	case GDB_REG_ST:
+		c8->timers.st = value;
+		break;
+	default:
+		c8->v[reg] = value;
+		break;
+	}
+
+	return BYTES * 2;
+}
+
+static void _readRegs(GdbStub *stub) {
+	char reply[GDB_REG_COUNT * 4 + 1];
+	size_t size = 0;
+
+	for( int reg = 0; reg < GDB_REG_COUNT; ++reg ) {
+		size += _readReg(stub->dbg.c8, reg, reply + size);
+	}
+
+	reply[size] = '\0';
+	_send(stub, reply);
+}
+
+static void _writeRegs(GdbStub *stub, const char *ARGS) {
+	for( int reg = 0; reg < GDB_REG_COUNT; ++reg ) {
+		const size_t READ = _writeReg(stub->dbg.c8, reg, ARGS);
+		if( READ == 0 ) {
+			_send(stub, "E01");
+			return;
+		}
+
+		ARGS += READ;
+	}
+
+	_send(stub, "OK");
+}
+
+static void _readOneReg(GdbStub *stub, const char *ARGS) {
+	char *end;
+	const unsigned long REG = strtoul(ARGS, &end, 16);
+	if( *end != '\0' || REG >= GDB_REG_COUNT ) {
+		_send(stub, "E01");
+		return;
+	}
+
+	char reply[8];
+	reply[_readReg(stub->dbg.c8, REG, reply)] = '\0';
+	_send(stub, reply);
+}
+
+static void _writeOneReg(GdbStub *stub, const char *ARGS) {
+	char *end;
+	const unsigned long REG = strtoul(ARGS, &end, 16);
+	if( *end != '=' || REG >= GDB_REG_COUNT
+		|| _writeReg(stub->dbg.c8, REG, end + 1) == 0 ) {
+		_send(stub, "E01");
+		return;
+	}
+
+	_send(stub, "OK");
+}
+
+/* Parses "addr,size", followed by END */
+static bool _range(const char *ARGS, char end, uint16_t *addr, size_t *size) {
+	char *next;
+	const unsigned long ADDR = strtoul(ARGS, &next, 16);
+	if( *next != ',' ) {
+		return false;
+	}
+
+	const unsigned long SIZE = strtoul(next + 1, &next, 16);
+	if( *next != end || ADDR >= MEM_SIZE || SIZE > MEM_SIZE ) {
+		return false;
+	}
+
+	*addr = ADDR;
+	*size = SIZE;
+	return true;
+}
+
+static void _readMem(GdbStub *stub, const char *ARGS) {
+	uint16_t addr;
+	size_t size;
+	if( !_range(ARGS, '\0', &addr, &size) ) {
+		_send(stub, "E01");
+		return;
+	}
+
+	if( size > GDB_PACKET_SIZE / 2 ) {
+		size = GDB_PACKET_SIZE / 2;
+	}
+
+	char reply[GDB_PACKET_SIZE + 1];
+	for( size_t n = 0; n < size; ++n ) {
+		const uint8_t BYTE = c8ReadByte(stub->dbg.c8, addr + n);
+		reply[n * 2] = HEX[BYTE >> 4];
+		reply[n * 2 + 1] = HEX[BYTE & 0xF];
+	}
+
+	reply[size * 2] = '\0';
+	_send(stub, reply);
+}
+
+static void _writeMem(GdbStub *stub, const char *ARGS) {
+	uint16_t addr;
+	size_t size;
+	if( !_range(ARGS, ':', &addr, &size) ) {
+		_send(stub, "E01");
+		return;
+	}
+
+	const char *DATA = strchr(ARGS, ':') + 1;
+	if( strlen(DATA) != size * 2 ) {
+		_send(stub, "E01");
+		return;
+	}
+
+	for( size_t n = 0; n < size; ++n ) {
+		const int HIGH = _hexValue(DATA[n * 2]);
+		const int LOW = _hexValue(DATA[n * 2 + 1]);
+		if( HIGH < 0 || LOW < 0 ) {
+			_send(stub, "E01");
+			return;
+		}
+
+		c8WriteByte(stub->dbg.c8, addr + n, (HIGH << 4) | LOW);
+	}
+
+	_send(stub, "OK");
+}
+
+/* Z/z packets: "type,addr,kind" */
+static void _point(GdbStub *stub, const char *ARGS, bool set) {
+	const char TYPE = ARGS[0];
+
+	uint16_t addr;
+	size_t size;
+	if( ARGS[1] != ',' || !_range(ARGS + 2, '\0', &addr, &size) ) {
+		_send(stub, "E01");
+		return;
+	}
+
+	switch( TYPE ) {
+	/* Software and hardware breakpoints are the same thing here */
+	case '0':
+	case '1':
+		if( set ) {
+			dbgSetBreakpoint(&stub->dbg, addr);
+		} else {
+			dbgClearBreakpoint(&stub->dbg, addr);
+		}
+		break;
+	/* Write watchpoints, the only kind the debugger has */
+	case '2':
+		if( set ) {
+			dbgSetWatchpoint(&stub->dbg, addr, size);
+		} else {
+			dbgClearWatchpoint(&stub->dbg, addr, size);
+		}
+		break;
+	default:
+		_send(stub, "");
+		return;
+	}
+
+	_send(stub, "OK");
+}
+
+static void _handle(GdbStub *stub) {
+	const char *ARGS = stub->packet + 1;
+
+	switch( stub->packet[0] ) {
+	case '?':
+		_sendStop(stub, DBG_STOP_STEP);
+		break;
+	case 'g':
+		_readRegs(stub);
+		break;
+	case 'G':
+		_writeRegs(stub, ARGS);
+		break;
+	case 'p':
+		_readOneReg(stub, ARGS);
+		break;
+	case 'P':
+		_writeOneReg(stub, ARGS);
+		break;
+	case 'm':
+		_readMem(stub, ARGS);
+		break;
+	case 'M':
+		_writeMem(stub, ARGS);
+		break;
+	case 'Z':
+	case 'z':
+		_point(stub, ARGS, stub->packet[0] == 'Z');
+		break;
+	case 'c':
+		if( *ARGS ) {
+			stub->dbg.c8->pc = strtoul(ARGS, NULL, 16);
+		}
+
+		/* Replies once it stops */
+		stub->halted = false;
+		stub->resuming = true;
+		break;
+	case 's':
+		if( *ARGS ) {
+			stub->dbg.c8->pc = strtoul(ARGS, NULL, 16);
+		}
+
+		_sendStop(stub, dbgStep(&stub->dbg, 1));
+		break;
+	case 'H':
+		_send(stub, "OK");
+		break;
+	case 'q':
+		if( strncmp(ARGS, "Supported", 9) == 0 ) {
+			char reply[32];
+			snprintf(reply, sizeof(reply), "PacketSize=%x", GDB_PACKET_SIZE);
+			_send(stub, reply);
+		} else if( strcmp(ARGS, "Attached") == 0 ) {
+			_send(stub, "1");
+		} else {
+			_send(stub, "");
+		}
+		break;
+	case 'D':
+		_send(stub, "OK");
+		_flush(stub);
+		_detach(stub);
+		break;
+	case 'k':
+		_detach(stub);
+		break;
+	default:
+		_send(stub, "");
+		break;
+	}
+}
+
+/* Feeds a byte to the packet reader */
+static void _feed(GdbStub *stub, char c) {
+	switch( stub->state ) {
+	case GDB_STATE_IDLE:
+		if( c == '$' ) {
+			stub->state = GDB_STATE_DATA;
+			stub->size = 0;
+			stub->checksum = 0;
+		} else if( c == 0x03 && !stub->halted ) {
+			/* Ctrl-C */
+			stub->halted = true;
+			_send(stub, "S02");
+		}
+
+		/* Acks are ignored, packets are never sent twice */
+		break;
+	case GDB_STATE_DATA:
+		if( c == '#' ) {
+			stub->state = GDB_STATE_CHECKSUM;
+			stub->receivedSize = 0;
+			break;
+		}
+
+		/* Oversized packets are counted, but not kept */
+		if( stub->size < GDB_PACKET_SIZE ) {
+			stub->packet[stub->size] = c;
+		}
+
+		++stub->size;
+		stub->checksum += c;
+		break;
+	case GDB_STATE_CHECKSUM:
+		stub->received[stub->receivedSize++] = c;
+		if( stub->receivedSize < 2 ) {
+			break;
+		}
+
+		stub->state = GDB_STATE_IDLE;
+
+		const int HIGH = _hexValue(stub->received[0]);
+		const int LOW = _hexValue(stub->received[1]);
+		if( HIGH < 0 || LOW < 0 || ((HIGH << 4) | LOW) != stub->checksum
+			|| stub->size > GDB_PACKET_SIZE ) {
+			_write(stub, "-", 1);
+			break;
+		}
+
+		_write(stub, "+", 1);
+
+		stub->packet[stub->size] = '\0';
+		_handle(stub);
+		break;
+	}
+}
+
+static int _listen(GdbStub *stub, const char *PATH) {
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	if( strlen(PATH) >= sizeof(addr.sun_path) ) {
+		fprintf(stderr, "ERR: Socket path '%s' is too long\n", PATH);
+		return EXIT_FAILURE;
+	}
+
+	strcpy(addr.sun_path, PATH);
+
+	/* Only replace stale sockets, never regular files */
+	struct stat st;
+	if( stat(PATH, &st) == 0 && S_ISSOCK(st.st_mode) ) {
+		unlink(PATH);
+	}
+
+	stub->server = socket(AF_UNIX, SOCK_STREAM, 0);
+	if( stub->server < 0 ) {
+		fprintf(stderr, "ERR: Couldn't create socket: %s\n", strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	if( bind(stub->server, (struct sockaddr *)&addr, sizeof(addr)) < 0
+		|| listen(stub->server, 1) < 0
+		|| _nonblocking(stub->server) == EXIT_FAILURE ) {
+		fprintf(stderr, "ERR: Couldn't listen on '%s': %s\n", PATH,
+			strerror(errno));
+		close(stub->server);
+		stub->server = -1;
+		return EXIT_FAILURE;
+	}
+
+	stub->PATH = PATH;
+	return EXIT_SUCCESS;
+}
+
+int gdbNew(GdbStub *stub, Chip8 *c8, const char *PATH) {
+	*stub = (GdbStub) {
+		.server = -1,
+		.in = -1,
+		.out = -1,
+	};
+
+	dbgAttach(&stub->dbg, c8, 0);
+
+	if( strcmp(PATH, "-") != 0 ) {
+		return _listen(stub, PATH);
+	}
+
+	if( _nonblocking(STDIN_FILENO) == EXIT_FAILURE ) {
+		fprintf(stderr, "ERR: Couldn't make stdin non-blocking\n");
+		return EXIT_FAILURE;
+	}
+
+	/* The client is whoever is on the other end of stdio. It gets stdout to
+	 * itself, so nothing printed gets mixed into its packets
+	 */
+	fflush(stdout);
+	const int OUT = dup(STDOUT_FILENO);
+	if( OUT < 0 || dup2(STDERR_FILENO, STDOUT_FILENO) < 0 ) {
+		fprintf(stderr, "ERR: Couldn't take over stdout: %s\n",
+			strerror(errno));
+		if( OUT >= 0 ) {
+			close(OUT);
+		}
+
+		return EXIT_FAILURE;
+	}
+
+	_attach(stub, STDIN_FILENO, OUT);
+	return EXIT_SUCCESS;
+}
+
+void gdbPump(GdbStub *stub) {
+	if( stub->in < 0 && stub->server >= 0 ) {
+		const int FD = accept(stub->server, NULL, NULL);
+		if( FD < 0 ) {
+			return;
+		}
+
+		if( _nonblocking(FD) == EXIT_FAILURE ) {
+			close(FD);
+			return;
+		}
+
+		_attach(stub, FD, FD);
+	}
+
+	char buffer[READ_SIZE];
+	while( stub->in >= 0 ) {
+		const ssize_t READ = read(stub->in, buffer, READ_SIZE);
+		if( READ < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) ) {
+			break;
+		}
+
+		if( READ <= 0 ) {
+			_detach(stub);
+			return;
+		}
+
+		for( ssize_t n = 0; n < READ && stub->in >= 0; ++n ) {
+			_feed(stub, buffer[n]);
+		}
+	}
+
+	/* Including stops from gdbCycle since the last pump */
+	_flush(stub);
+}
+
+bool gdbCycle(GdbStub *stub) {
+	if( stub->halted ) {
+		return false;
+	}
+
+	/* After continuing, the breakpoint it stopped at is stepped over */
+	const DbgStop STOP
+		= stub->resuming ? dbgStep(&stub->dbg, 1) : dbgCycle(&stub->dbg);
+	stub->resuming = false;
+
+	if( STOP == DBG_STOP_STEP ) {
+		return true;
+	}
+
+	stub->halted = true;
+	_sendStop(stub, STOP);
+
+	return STOP == DBG_STOP_WATCHPOINT;
+}
+
+void gdbFree(GdbStub *stub) {
+	_flush(stub);
+	_detach(stub);
+
+	if( stub->server >= 0 ) {
+		close(stub->server);
+		unlink(stub->PATH);
+		stub->server = -1;
+	}
+}
+#endif
@@ -0,0 +1,135 @@
+/* Headless runs, checked against golden display hashes
+ *
+ * Comparing hashes instead of screenshots keeps each check down to hashing
+ * 256 bytes, so thousands of them run every second
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "capture.h"
+#include "headless.h"
+#include "keytrace.h"
+
+static int _byFrame(const void *a, const void *b) {
+	const HeadlessCheck *A = a;
+	const HeadlessCheck *B = b;
+
+	return (A->frame > B->frame) - (A->frame < B->frame);
+}
+
+/* Checks every hash expected at this frame. Returns the number of failures */
+static size_t _check(const Chip8 *C8, const HeadlessOptions *OPTS,
+	size_t *next, int frame) {
+	const uint64_t HASH = c8DisplayHash(C8);
+	size_t failed = 0;
+
+	for( ; *next < OPTS->checkCount && OPTS->checks[*next].frame == frame;
+		 ++*next ) {
+		const HeadlessCheck *CHECK = &OPTS->checks[*next];
+
+		printf("frame %d: %016llx", frame, (unsigned long long)HASH);
+		if( !CHECK->expected ) {
+			printf("\n");
+		} else if( CHECK->hash == HASH ) {
+			printf(" ok\n");
+		} else {
+			printf(" FAILED, expected %016llx\n",
+				(unsigned long long)CHECK->hash);
+			++failed;
+		}
+	}
+
+	return failed;
+}
+
+int headlessRun(const C8Image *IMAGE, HeadlessOptions *opts) {
+	KeyTrace input = { 0 };
+	if( opts->INPUT && keytraceLoad(&input, opts->INPUT) == EXIT_FAILURE ) {
+		return EXIT_FAILURE;
+	}
+
+	/* Big enough to keep off the stack */
+	Capture *capture = NULL;
+	if( opts->CAPTURE ) {
+		capture = malloc(sizeof(*capture));
+		if( capture == NULL
+			|| captureNew(capture, opts->CAPTURE) == EXIT_FAILURE ) {
+			free(capture);
+			keytraceFree(&input);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if( opts->checkCount > 0 ) {
+		qsort(opts->checks, opts->checkCount, sizeof(*opts->checks),
+			_byFrame);
+	}
+
+	int frames = opts->frames;
+	if( opts->checkCount > 0 ) {
+		frames = opts->checks[opts->checkCount - 1].frame;
+	}
+
+	/* Same seed as the diff-core run */
+	Chip8 c8 = c8NewShared(IMAGE);
+	c8Seed(&c8, 1);
+
+	size_t nextEvent = 0, nextCheck = 0, failed = 0;
+	for( int frame = 0;; ++frame ) {
+		failed += _check(&c8, opts, &nextCheck, frame);
+		if( capture ) {
+			captureFrame(capture, &c8);
+		}
+
+		if( frame == frames ) {
+			break;
+		}
+
+		for( ; nextEvent < input.count
+			 && input.events[nextEvent].frame <= frame;
+			 ++nextEvent ) {
+			const KeyTraceEvent *EV = &input.events[nextEvent];
+			c8KeyEvent(&c8, EV->key, EV->down);
+		}
+
+		if( opts->timing == C8_TIMING_VIP ) {
+			c8VipFrame(&c8);
+		} else {
+			for( int cycle = 0; cycle < opts->cycles; ++cycle ) {
+				c8Cycle(&c8);
+			}
+		}
+
+		c8TickTimers(&c8);
+	}
+
+	size_t expected = 0;
+	for( size_t n = 0; n < opts->checkCount; ++n ) {
+		expected += opts->checks[n].expected;
+	}
+
+	/* Stack and memory errors leave the PC on the instruction, see c8Run */
+	if( c8.fault > C8_INVALID_OPCODE ) {
+		fprintf(stderr, "ERR: Program stopped at 0x%03X: %s\n", c8.pc,
+			c8StatusString(c8.fault));
+		++failed;
+	}
+
+	if( opts->checkCount == 0 ) {
+		printf("frame %d: %016llx\n", frames,
+			(unsigned long long)c8DisplayHash(&c8));
+	} else if( expected > 0 ) {
+		printf("%zu of %zu hashes matched\n", expected - failed, expected);
+	}
+
+	if( capture && captureFree(capture) == EXIT_FAILURE ) {
+		++failed;
+	}
+
+	free(capture);
+	c8Free(&c8);
+	keytraceFree(&input);
+
+	return failed > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,85 @@
+/* Keypad traces
+ *
+ * Recorded input for headless runs, so they can be replayed exactly
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "keytrace.h"
+
+#define LINE_SIZE 256
+
+/* Makes room for one more event */
+static int _grow(KeyTrace *trace, size_t *capacity) {
+	if( trace->count < *capacity ) {
+		return EXIT_SUCCESS;
+	}
+
+	*capacity = *capacity ? *capacity * 2 : 64;
+
+	KeyTraceEvent *events
+		= realloc(trace->events, *capacity * sizeof(*events));
+	if( events == NULL ) {
+		fprintf(stderr, "ERR: Couldn't allocate memory for input\n");
+		return EXIT_FAILURE;
+	}
+
+	trace->events = events;
+	return EXIT_SUCCESS;
+}
+
+int keytraceLoad(KeyTrace *trace, const char *PATH) {
+	*trace = (KeyTrace) { 0 };
+
+	FILE *file = fopen(PATH, "r");
+	if( file == NULL ) {
+		fprintf(stderr, "ERR: Couldn't open file '%s'\n", PATH);
+		return EXIT_FAILURE;
+	}
+
+	size_t capacity = 0;
+	int lineno = 0, last = 0;
+	char line[LINE_SIZE];
+
+	while( fgets(line, LINE_SIZE, file) ) {
+		++lineno;
+
+		int frame, down;
+		unsigned int key;
+		if( line[0] == '#' || line[strspn(line, " \t\r\n")] == '\0' ) {
+			continue;
+		}
+
+		if( sscanf(line, "%d %x %d", &frame, &key, &down) != 3 || key > 0xF
+			|| frame < last ) {
+			fprintf(stderr, "ERR: %s:%d: Invalid key event\n", PATH, lineno);
+			fclose(file);
+			keytraceFree(trace);
+			return EXIT_FAILURE;
+		}
+
+		if( _grow(trace, &capacity) == EXIT_FAILURE ) {
+			fclose(file);
+			keytraceFree(trace);
+			return EXIT_FAILURE;
+		}
+
+		trace->events[trace->count++] = (KeyTraceEvent) {
+			.frame = frame,
+			.key = key,
+			.down = down != 0,
+		};
+
+		last = frame;
+	}
+
+	fclose(file);
+	return EXIT_SUCCESS;
+}
+
+void keytraceFree(KeyTrace *trace) {
+	free(trace->events);
+	*trace = (KeyTrace) { 0 };
+}
@@ -0,0 +1,143 @@
+/* Emulator runtime statistics
+ *
+ * Counters are split by the thread writing them, so collecting never takes a
+ * lock, and can stay on all the time
+ */
+
+#include <string.h>
+
+#include "stats.h"
+
+#define NS_PER_SECOND 1e9
+#define NS_PER_MS 1e6
+
+void statsInit(Stats *stats, uint64_t NOW) {
+	memset(stats, 0, sizeof(*stats));
+	stats->lastTime = NOW;
+}
+
+void statsPresent(Stats *stats, uint64_t NOW, uint64_t uploadNs,
+	uint64_t presentNs) {
+	RenderCounters *render = &stats->render;
+
+	++render->presents;
+	render->presentNs += presentNs;
+	if( uploadNs > 0 ) {
+		++render->uploads;
+		render->uploadNs += uploadNs;
+	}
+
+	if( render->lastPresent > 0 ) {
+		const uint64_t FRAME = NOW - render->lastPresent;
+
+		uint64_t bucket = FRAME / STATS_BUCKET_NS;
+		if( bucket >= STATS_BUCKETS ) {
+			bucket = STATS_BUCKETS - 1;
+		}
+
+		++render->histogram[bucket];
+
+		render->history[render->historyHead] = FRAME;
+		render->historyHead = (render->historyHead + 1) % STATS_HISTORY;
+	}
+
+	render->lastPresent = NOW;
+}
+
+/* Upper bound of the bucket holding a fraction of the histogram, in ms */
+static double _percentile(const uint32_t *HISTOGRAM, uint64_t total,
+	double fraction) {
+	uint64_t rank = total * fraction;
+	if( rank >= total ) {
+		rank = total - 1;
+	}
+
+	uint64_t seen = 0;
+	for( int bucket = 0; bucket < STATS_BUCKETS; ++bucket ) {
+		seen += HISTOGRAM[bucket];
+		if( seen > rank ) {
+			return (double)(bucket + 1) * STATS_BUCKET_NS / NS_PER_MS;
+		}
+	}
+
+	return 0;
+}
+
+/* Loads a counter and its change since the last report */
+static uint64_t _delta(_Atomic uint64_t *counter, _Atomic uint64_t *last) {
+	const uint64_t NOW = atomic_load_explicit(counter, memory_order_relaxed);
+	const uint64_t DELTA
+		= NOW - atomic_load_explicit(last, memory_order_relaxed);
+
+	atomic_store_explicit(last, NOW, memory_order_relaxed);
+	return DELTA;
+}
+
+void statsReport(Stats *stats, uint64_t NOW, StatsReport *report) {
+	RenderCounters *render = &stats->render;
+	EmuCounters *emu = &stats->emu;
+	EmuCounters *last = &stats->last;
+
+	const double SECONDS = (NOW - stats->lastTime) / NS_PER_SECOND;
+	const uint64_t FRAMES = _delta(&emu->frames, &last->frames);
+
+	*report = (StatsReport) {
+		.seconds = SECONDS,
+		.ips = _delta(&emu->cycles, &last->cycles) / SECONDS,
+		.fps = render->presents / SECONDS,
+		.timerHz = FRAMES / SECONDS,
+		.driftMs = _delta(&emu->lostNs, &last->lostNs) / NS_PER_MS,
+	};
+
+	const uint64_t DRAWS = _delta(&emu->draws, &last->draws);
+	const uint64_t PIXELS = _delta(&emu->pixels, &last->pixels);
+	if( FRAMES > 0 ) {
+		report->drawsPerFrame = (double)DRAWS / FRAMES;
+		report->pixelsPerFrame = (double)PIXELS / FRAMES;
+	}
+
+	if( render->uploads > 0 ) {
+		report->uploadMs = render->uploadNs / NS_PER_MS / render->uploads;
+	}
+
+	if( render->presents > 0 ) {
+		report->presentMs = render->presentNs / NS_PER_MS / render->presents;
+	}
+
+	uint64_t total = 0;
+	for( int bucket = 0; bucket < STATS_BUCKETS; ++bucket ) {
+		total += render->histogram[bucket];
+	}
+
+	if( total > 0 ) {
+		report->frameMs[0] = _percentile(render->histogram, total, 0.5);
+		report->frameMs[1] = _percentile(render->histogram, total, 0.95);
+		report->frameMs[2] = _percentile(render->histogram, total, 0.99);
+		report->frameMs[3] = _percentile(render->histogram, total, 1);
+	}
+
+	/* The history and last present carry over into the next interval */
+	render->presents = 0;
+	render->uploads = 0;
+	render->uploadNs = 0;
+	render->presentNs = 0;
+	memset(render->histogram, 0, sizeof(render->histogram));
+
+	stats->lastTime = NOW;
+}
+
+void statsWrite(const StatsReport *REPORT, FILE *file) {
+	fprintf(file,
+		"{\"seconds\":%.3f,\"ips\":%.0f,\"fps\":%.1f,"
+		"\"frameMs\":{\"p50\":%.2f,\"p95\":%.2f,\"p99\":%.2f,\"max\":%.2f},"
+		"\"drawsPerFrame\":%.2f,\"pixelsPerFrame\":%.1f,"
+		"\"uploadMs\":%.3f,\"presentMs\":%.3f,"
+		"\"timerHz\":%.1f,\"driftMs\":%.1f,"
+		"\"audio\":{\"underruns\":%llu,\"overruns\":%llu}}\n",
+		REPORT->seconds, REPORT->ips, REPORT->fps, REPORT->frameMs[0],
+		REPORT->frameMs[1], REPORT->frameMs[2], REPORT->frameMs[3],
+		REPORT->drawsPerFrame, REPORT->pixelsPerFrame, REPORT->uploadMs,
+		REPORT->presentMs, REPORT->timerHz, REPORT->driftMs,
+		(unsigned long long)REPORT->underruns,
+		(unsigned long long)REPORT->overruns);
+}
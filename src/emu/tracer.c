@@ -0,0 +1,165 @@
+/* Chip-8 execution tracer
+ *
+ * Keeps the last instructions executed by a core in a ring, to be dumped to
+ * a file when something goes wrong. Dumps can be read with 'chip8 trace'.
+ */
+
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if !defined(_WIN32) && !defined(WIN32)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "tracer.h"
+
+#define PATH_SIZE 4096
+
+C8Trace *traceNew(void) {
+	C8Trace *trace = malloc(sizeof(*trace));
+	if( trace == NULL ) {
+		fprintf(stderr,
+			"ERR: Couldn't allocate memory (%zu bytes) for trace\n",
+			sizeof(*trace));
+		return NULL;
+	}
+
+	atomic_init(&trace->head, 0);
+	return trace;
+}
+
+void traceFree(C8Trace *trace) {
+	free(trace);
+}
+
+static TraceHeader _header(uint32_t count, uint64_t total) {
+	TraceHeader header = {
+		.version = TRACE_VERSION,
+		.entrySize = sizeof(TraceEntry),
+		.count = count,
+		.total = total,
+	};
+
+	memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+	return header;
+}
+
+int traceDump(const C8Trace *trace, const char *PATH) {
+	TraceEntry *copy = malloc(sizeof(trace->entries));
+	if( copy == NULL ) {
+		fprintf(stderr, "ERR: Couldn't allocate memory for trace dump\n");
+		return EXIT_FAILURE;
+	}
+
+	/* Copy first, then drop whatever the core overwrote while copying. The
+	 * fence keeps the copy from being read after the second head, and the
+	 * entry at AFTER may be half written, so it goes too
+	 */
+	const uint64_t HEAD = atomic_load_explicit(
+		(_Atomic uint64_t *)&trace->head, memory_order_acquire);
+	memcpy(copy, trace->entries, sizeof(trace->entries));
+	atomic_thread_fence(memory_order_acquire);
+	const uint64_t AFTER = atomic_load_explicit(
+		(_Atomic uint64_t *)&trace->head, memory_order_relaxed);
+
+	uint64_t first = HEAD > TRACE_SIZE ? HEAD - TRACE_SIZE : 0;
+	if( AFTER >= TRACE_SIZE && AFTER - TRACE_SIZE + 1 > first ) {
+		first = AFTER - TRACE_SIZE + 1;
+	}
+
+	/* Can happen if the core ran a whole ring while copying */
+	if( first > HEAD ) {
+		first = HEAD;
+	}
+
+	FILE *file = fopen(PATH, "wb");
+	if( file == NULL ) {
+		fprintf(stderr, "ERR: Couldn't open file '%s'\n", PATH);
+		free(copy);
+		return EXIT_FAILURE;
+	}
+
+	const TraceHeader HEADER = _header(HEAD - first, HEAD);
+	bool ok = fwrite(&HEADER, sizeof(HEADER), 1, file) == 1;
+
+	for( uint64_t n = first; ok && n < HEAD; ++n ) {
+		ok = fwrite(&copy[n & (TRACE_SIZE - 1)], sizeof(*copy), 1, file) == 1;
+	}
+
+	fclose(file);
+	free(copy);
+
+	if( !ok ) {
+		fprintf(stderr, "ERR: Couldn't write to '%s'\n", PATH);
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+#if defined(_WIN32) || defined(WIN32)
+void traceDumpOnCrash(const C8Trace *trace, const char *PATH) {
+	/* Not supported */
+	(void)trace;
+	(void)PATH;
+}
+#else
+static const C8Trace *_crashTrace = NULL;
+static char _crashPath[PATH_SIZE];
+
+static const int CRASH_SIGNALS[] = { SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT };
+#define CRASH_SIGNAL_COUNT (sizeof(CRASH_SIGNALS) / sizeof(*CRASH_SIGNALS))
+
+/* Only async-signal-safe calls in here */
+static void _onCrash(int sig) {
+	const C8Trace *TRACE = _crashTrace;
+
+	const int FD = TRACE ? open(_crashPath, O_WRONLY | O_CREAT | O_TRUNC, 0644)
+						 : -1;
+	if( FD >= 0 ) {
+		const uint64_t HEAD = atomic_load_explicit(
+			(_Atomic uint64_t *)&TRACE->head, memory_order_acquire);
+		const uint64_t COUNT = HEAD < TRACE_SIZE ? HEAD : TRACE_SIZE;
+		const size_t START = (HEAD - COUNT) & (TRACE_SIZE - 1);
+
+		const TraceHeader HEADER = _header(COUNT, HEAD);
+		ssize_t ignored = write(FD, &HEADER, sizeof(HEADER));
+
+		/* The ring, unwrapped */
+		const size_t FIRST
+			= COUNT < TRACE_SIZE - START ? COUNT : TRACE_SIZE - START;
+		ignored = write(
+			FD, &TRACE->entries[START], FIRST * sizeof(TraceEntry));
+		ignored = write(
+			FD, TRACE->entries, (COUNT - FIRST) * sizeof(TraceEntry));
+		(void)ignored;
+
+		close(FD);
+	}
+
+	signal(sig, SIG_DFL);
+	raise(sig);
+}
+
+void traceDumpOnCrash(const C8Trace *trace, const char *PATH) {
+	_crashTrace = NULL;
+	if( trace == NULL ) {
+		for( size_t i = 0; i < CRASH_SIGNAL_COUNT; ++i ) {
+			signal(CRASH_SIGNALS[i], SIG_DFL);
+		}
+
+		return;
+	}
+
+	snprintf(_crashPath, PATH_SIZE, "%s", PATH);
+	_crashTrace = trace;
+
+	for( size_t i = 0; i < CRASH_SIGNAL_COUNT; ++i ) {
+		signal(CRASH_SIGNALS[i], _onCrash);
+	}
+}
+#endif
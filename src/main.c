@@ -5,8 +5,14 @@
  * executables.
  */
 
+#include "analyse.h"
+#include "compile.h"
+#include "debug.h"
 #include "decompile.h"
+#include "explore.h"
 #include "run.h"
+#include "trace.h"
+#include "verify.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -17,7 +23,12 @@ static const char *HELP_STRING
 	  "program:\n"
 	  "    run......... runs a program\n"
 	  "    compile..... compiles cc8 source code into a program\n"
-	  "    decompile... decompiles a program\n\n"
+	  "    debug....... runs a program under a debugger\n"
+	  "    decompile... decompiles a program\n"
+	  "    analyse..... reports a program's call graph, stack depth and more\n"
+	  "    explore..... searches for every screen a program can reach\n"
+	  "    verify...... checks programs survive a decompile/compile round-trip\n"
+	  "    trace....... lists an execution trace dumped by 'run'\n\n"
 	  "use 'chip8 [program] help' to get the possible options\n";
 
 static int _usage(void) {
@@ -35,8 +46,19 @@ int main(int argc, char *argv[]) {
 	if( strcmp(*argv, "run") == 0 ) {
 		return runMain(--argc, ++argv);
 	} else if( strcmp(*argv, "compile") == 0 ) {
+		return compMain(--argc, ++argv);
+	} else if( strcmp(*argv, "debug") == 0 ) {
+		return debugMain(--argc, ++argv);
 	} else if( strcmp(*argv, "decompile") == 0 ) {
 		return decompMain(--argc, ++argv);
+	} else if( strcmp(*argv, "analyse") == 0 ) {
+		return analyseMain(--argc, ++argv);
+	} else if( strcmp(*argv, "explore") == 0 ) {
+		return exploreMain(--argc, ++argv);
+	} else if( strcmp(*argv, "verify") == 0 ) {
+		return verifyMain(--argc, ++argv);
+	} else if( strcmp(*argv, "trace") == 0 ) {
+		return traceMain(--argc, ++argv);
 	}
 
 	fprintf(stderr, "ERR: Unknown program '%s'!\n\n", *argv);
@@ -0,0 +1,177 @@
+/* Chip-8 static analysis report
+ *
+ * This subprogram reports what can be worked out about a program without
+ * running it: its call graph, how deep the stack gets, writes into its own
+ * code and bytes that never execute. Programs that never modify themselves
+ * and keep within the stack are safe to cache or recompile.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "analyse.h"
+#include "analyser.h"
+#include "chip8.h"
+
+static const char *HELP_STRING
+	= "usage: chip8 analyse [options] [file]\n\n"
+	  "options:\n"
+	  "    --strict............... Fails if the program isn't safe to cache\n"
+	  "                            or recompile\n";
+
+static int _usage() {
+	fprintf(stderr, "%s", HELP_STRING);
+	return EXIT_FAILURE;
+}
+
+static void _printCallGraph(const AnlReport *REPORT) {
+	printf("Call graph (subroutines: %zu):\n", REPORT->functions.size - 1);
+
+	for( size_t fn = 0; fn < REPORT->functions.size; ++fn ) {
+		const uint16_t ENTRY = REPORT->functions.list[fn];
+		printf("    0x%03X", ENTRY);
+
+		const char *separator = " -> ";
+		for( size_t n = 0; n < REPORT->calls.size; n += 2 ) {
+			if( REPORT->calls.list[n] == ENTRY ) {
+				printf("%s0x%03X", separator, REPORT->calls.list[n + 1]);
+				separator = ", ";
+			}
+		}
+
+		printf("\n");
+	}
+}
+
+static void _printStack(const AnlReport *REPORT) {
+	if( REPORT->maxDepth < 0 ) {
+		printf("Stack depth: unbounded, subroutines recurse\n");
+	} else {
+		printf("Stack depth: %d of %d%s\n", REPORT->maxDepth, C8_STACK_SIZE,
+			REPORT->maxDepth > C8_STACK_SIZE ? ", overflows" : "");
+	}
+}
+
+static void _printWrites(const AnlReport *REPORT, const uint8_t *ROM) {
+	printf("Writes into code:%s\n", REPORT->codeWrites.size ? "" : " none");
+	for( size_t n = 0; n < REPORT->codeWrites.size; n += 2 ) {
+		const uint16_t ORIGIN = REPORT->codeWrites.list[n];
+		const size_t OFFSET = ORIGIN - PROGRAM_START_ADDR;
+
+		printf("    0x%03X: F%X%02X writes 0x%03X\n", ORIGIN,
+			ROM[OFFSET] & 0xF, ROM[OFFSET + 1],
+			REPORT->codeWrites.list[n + 1]);
+	}
+
+	printf("Writes to unknown addresses:%s",
+		REPORT->unknownWrites.size ? "" : " none");
+	for( size_t n = 0; n < REPORT->unknownWrites.size; ++n ) {
+		printf("%s0x%03X", n % 8 ? ", " : "\n    ",
+			REPORT->unknownWrites.list[n]);
+	}
+
+	printf("\n");
+}
+
+static void _printUnreachable(const Analyser *ANL, const AnlReport *REPORT) {
+	printf("Unreachable: %zu bytes\n", REPORT->unreachable);
+
+	for( size_t offset = 0; offset < ANL->size; ) {
+		if( anlIsCode(ANL, offset) ) {
+			++offset;
+			continue;
+		}
+
+		const size_t START = offset;
+		while( offset < ANL->size && !anlIsCode(ANL, offset) ) {
+			++offset;
+		}
+
+		printf("    0x%03zX-0x%03zX (%zu bytes)\n", START + PROGRAM_START_ADDR,
+			offset - 1 + PROGRAM_START_ADDR, offset - START);
+	}
+}
+
+/* Prints the report. Returns whether the program is safe to cache */
+static bool _print(const char *PATH, const Analyser *ANL,
+	const AnlReport *REPORT) {
+	printf("Program: '%s' (%zu bytes)\n\n", PATH, ANL->size);
+
+	_printCallGraph(REPORT);
+	_printStack(REPORT);
+	_printWrites(REPORT, ANL->buffer);
+	_printUnreachable(ANL, REPORT);
+
+	if( ANL->indirect ) {
+		printf("Indirect jumps (BNNN): whatever they reach is missing\n");
+	}
+
+	const bool SAFE = !ANL->indirect && REPORT->codeWrites.size == 0
+		&& REPORT->unknownWrites.size == 0 && REPORT->maxDepth >= 0
+		&& REPORT->maxDepth <= C8_STACK_SIZE;
+
+	printf("\nSafe to cache or recompile: %s\n", SAFE ? "yes" : "no");
+	return SAFE;
+}
+
+static int _analyse(const char *PATH, bool strict) {
+	C8Rom rom;
+	const C8LoadError ERROR = c8RomOpen(&rom, PATH);
+	if( ERROR != C8_LOAD_OK ) {
+		fprintf(stderr, "ERR: Couldn't load '%s': %s\n", PATH,
+			c8LoadErrorString(ERROR));
+		return EXIT_FAILURE;
+	}
+
+	Analyser anl = anlInit(rom.map.data, rom.map.size);
+	AnlReport report;
+	if( anlReport(&anl, &report) == EXIT_FAILURE ) {
+		anlFree(&anl);
+		c8RomClose(&rom);
+		return EXIT_FAILURE;
+	}
+
+	const bool SAFE = _print(PATH, &anl, &report);
+
+	anlReportFree(&report);
+	anlFree(&anl);
+	c8RomClose(&rom);
+
+	return SAFE || !strict ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int analyseMain(int argc, char *argv[]) {
+	if( argc == 0 ) {
+		return _usage();
+	}
+
+	char *file = NULL;
+	bool strict = false;
+
+	while( *argv ) {
+		if( strcmp(*argv, "help") == 0 || strcmp(*argv, "--help") == 0 ) {
+			_usage();
+			return EXIT_SUCCESS;
+		} else if( strcmp(*argv, "--strict") == 0 ) {
+			strict = true;
+		} else if( *(argv + 1) ) {
+			fprintf(stderr, "ERR: Unknown option '%s'!\n\n", *argv);
+			return _usage();
+		} else {
+			file = *argv;
+			break;
+		}
+
+		++argv;
+	}
+
+	if( !file ) {
+		fprintf(stderr, "ERR: An input file must be provided!\n\n");
+		return _usage();
+	}
+
+	return _analyse(file, strict);
+}
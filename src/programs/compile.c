@@ -2,3 +2,240 @@
  *
  * This subprogram compiles cc8 assembly language code into a chip8 program.
  */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "assembler.h"
+#include "chip8.h"
+#include "compile.h"
+#include "optimiser.h"
+#include "util.h"
+
+#define PATH_SIZE 4096
+
+/* Length of the run used to estimate the cycles saved by the optimiser */
+#define BASELINE_FRAMES (60 * 60)
+#define CYCLES_PER_FRAME 16
+
+static bool _verbose = false;
+static bool _optimise = false;
+
+static double _seconds(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Swaps the source's extension (if any) for .ch8 */
+static void _defaultOutput(const char *PATH, char *out) {
+	snprintf(out, PATH_SIZE, "%s", PATH);
+
+	char *dot = strrchr(out, '.');
+	const char *SLASH = strrchr(out, '/');
+	if( dot && (!SLASH || dot > SLASH) ) {
+		*dot = '\0';
+	}
+
+	strncat(out, ".ch8", PATH_SIZE - strlen(out) - 1);
+}
+
+static int _write(const char *PATH, const uint8_t *DATA, size_t size) {
+	FILE *file = fopen(PATH, "wb");
+	if( file == NULL ) {
+		fprintf(stderr, "ERR: Couldn't open file '%s'\n", PATH);
+		return EXIT_FAILURE;
+	}
+
+	const bool OK = fwrite(DATA, 1, size, file) == size;
+	fclose(file);
+
+	if( !OK ) {
+		fprintf(stderr, "ERR: Couldn't write to '%s'\n", PATH);
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+/* Runs the program headless, counting how many times each instruction ran.
+ * Stops early if the program halts, waits for a key or faults, since nothing
+ * else would run
+ *
+ * Returns the number of cycles run
+ */
+static uint64_t _baseline(const Assembler *as, uint32_t *counts) {
+	C8Image image;
+	if( c8ImageNew(&image, as->output, as->size) != C8_LOAD_OK ) {
+		return 0;
+	}
+
+	Chip8 c8 = c8NewShared(&image);
+	c8Seed(&c8, 1);
+
+	uint64_t cycles = 0;
+	bool running = true;
+	for( int frame = 0; running && frame < BASELINE_FRAMES; ++frame ) {
+		for( int cycle = 0; running && cycle < CYCLES_PER_FRAME; ++cycle ) {
+			const size_t OFFSET = c8.pc - PROGRAM_START_ADDR;
+			if( c8.pc >= PROGRAM_START_ADDR && OFFSET < as->size ) {
+				++counts[OFFSET];
+			}
+
+			/* Invalid opcodes do nothing, so it carries on past them */
+			const C8RunResult RESULT = c8Run(&c8, 1);
+			cycles += RESULT.cycles;
+			running = RESULT.status == C8_RUNNING
+				|| RESULT.status == C8_INVALID_OPCODE;
+		}
+
+		c8TickTimers(&c8);
+	}
+
+	c8Free(&c8);
+
+	return cycles;
+}
+
+static int _optimiseProgram(Assembler *as) {
+	uint32_t *counts = calloc(PROGRAM_MAX_SIZE, sizeof(*counts));
+	if( counts == NULL ) {
+		fprintf(stderr, "ERR: Couldn't allocate memory for execution counts\n");
+		return EXIT_FAILURE;
+	}
+
+	const size_t SIZE = as->size;
+	const uint64_t CYCLES = _baseline(as, counts);
+
+	OptStats stats;
+	const int RESULT = optOptimise(as, counts, &stats);
+	free(counts);
+
+	if( RESULT == EXIT_FAILURE ) {
+		return EXIT_FAILURE;
+	}
+
+	printf("Optimised %zu -> %zu bytes: %zu folds, %zu threaded jumps, "
+		   "%zu tail calls, %zu dead bytes\n",
+		SIZE, as->size, stats.folded, stats.threaded, stats.tailCalls,
+		stats.removed);
+
+	if( CYCLES > 0 ) {
+		printf("Saved ~%llu of %llu cycles (%.2f%%, estimated over up to %d "
+			   "frames without input)\n",
+			(unsigned long long)stats.saved, (unsigned long long)CYCLES,
+			100.0 * stats.saved / CYCLES, BASELINE_FRAMES);
+	}
+
+	return EXIT_SUCCESS;
+}
+
+static int _compile(const char *PATH, const char *OUTPATH) {
+	UtilMap source;
+	if( utilMapFile(PATH, &source) == EXIT_FAILURE ) {
+		return EXIT_FAILURE;
+	}
+
+	Assembler *as = malloc(sizeof(*as));
+	if( as == NULL || asmNew(as) == EXIT_FAILURE ) {
+		fprintf(stderr, "ERR: Couldn't create assembler\n");
+		free(as);
+		utilUnmapFile(&source);
+		return EXIT_FAILURE;
+	}
+
+	const double START = _seconds();
+	int result = asmAssemble(as, (const char *)source.data, source.size);
+	const double ELAPSED = _seconds() - START;
+
+	if( result == EXIT_FAILURE ) {
+		fprintf(stderr, "ERR: %zu errors, no program was written\n",
+			as->errors);
+	} else if( _optimise ) {
+		result = _optimiseProgram(as);
+	}
+
+	if( result == EXIT_SUCCESS ) {
+		result = _write(OUTPATH, as->output, as->size);
+	}
+
+	if( result == EXIT_SUCCESS && _verbose ) {
+		printf("Assembled %zu instructions (%zu bytes, %zu labels) into '%s' "
+			   "in %.3fms\n",
+			as->instructions, as->size, as->symbols.count, OUTPATH,
+			ELAPSED * 1000);
+	}
+
+	asmFree(as);
+	free(as);
+	utilUnmapFile(&source);
+
+	return result;
+}
+
+static const char *HELP_STRING
+	= "usage: chip8 compile [options] [source]\n\n"
+	  "options:\n"
+	  "    -o, --out [file]... Outputs the program to a file (default: the\n"
+	  "                        source, with a .ch8 extension)\n"
+	  "    -v, --verbose...... Prints some statistics when done\n"
+	  "    -O, --optimise..... Runs peephole optimisations, and reports the\n"
+	  "                        cycles they saved on a baseline run\n";
+
+static int _usage() {
+	fprintf(stderr, "%s", HELP_STRING);
+	return EXIT_FAILURE;
+}
+
+int compMain(int argc, char *argv[]) {
+	if( argc == 0 ) {
+		return _usage();
+	}
+
+	char *file = NULL;
+	char *output = NULL;
+	while( *argv ) {
+		if( strcmp(*argv, "help") == 0 || strcmp(*argv, "--help") == 0 ) {
+			_usage();
+			return EXIT_SUCCESS;
+		} else if( strcmp(*argv, "-o") == 0 || strcmp(*argv, "--out") == 0 ) {
+			++argv;
+			if( !*argv ) {
+				return _usage();
+			}
+
+			output = *argv;
+		} else if( strcmp(*argv, "-v") == 0
+			|| strcmp(*argv, "--verbose") == 0 ) {
+			_verbose = true;
+		} else if( strcmp(*argv, "-O") == 0
+			|| strcmp(*argv, "--optimise") == 0 ) {
+			_optimise = true;
+		} else if( *(argv + 1) ) {
+			fprintf(stderr, "ERR: Unknown option '%s'!\n\n", *argv);
+			return _usage();
+		} else {
+			file = *argv;
+			break;
+		}
+
+		++argv;
+	}
+
+	if( !file ) {
+		fprintf(stderr, "ERR: An input file must be provided!\n\n");
+		return _usage();
+	}
+
+	char outpath[PATH_SIZE];
+	if( !output ) {
+		_defaultOutput(file, outpath);
+		output = outpath;
+	}
+
+	return _compile(file, output);
+}
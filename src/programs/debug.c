@@ -0,0 +1,531 @@
+/* Chip-8 debugger
+ *
+ * This subprogram runs a program headless under the debugger, reading
+ * commands from the standard input. It can be driven by hand, or scripted by
+ * piping commands into it.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chip8.h"
+#include "debug.h"
+#include "debugger.h"
+#include "printer.h"
+
+#define LINE_SIZE 256
+#define MAX_ARGS 8
+
+/* Frames 'continue', 'next' and 'finish' run for at most, by default */
+#define DEFAULT_BUDGET 3600
+
+static const char *HELP_STRING
+	= "usage: chip8 debug [options] [program]\n\n"
+	  "options:\n"
+	  "    -c, --cycles [num]..... Cycles per frame (default: 16)\n\n"
+	  "Commands are read from the standard input, type 'help' to list them\n";
+
+static const char *COMMANDS_STRING
+	= "commands (addresses and values are in hex):\n"
+	  "    b, break [addr] [if cond]. Sets a breakpoint, cond is 'REG OP NUM'\n"
+	  "                               with REG in V0-VF or I, and OP in\n"
+	  "                               == != < <= > >=\n"
+	  "    d, delete [addr].......... Removes a breakpoint\n"
+	  "    w, watch [addr] [size].... Stops after writes to memory\n"
+	  "    u, unwatch [addr] [size].. Stops watching memory\n"
+	  "    s, step [num]............. Executes num instructions (default: 1)\n"
+	  "    n, next................... Steps over subroutine calls\n"
+	  "    f, finish................. Runs until the subroutine returns\n"
+	  "    fr, frame [num]........... Runs num frames (default: 1)\n"
+	  "    c, continue [frames]...... Runs until a breakpoint or watchpoint\n"
+	  "    r, regs................... Shows the registers and stack\n"
+	  "    x, mem [addr] [size]...... Shows memory (default: I, 16 bytes)\n"
+	  "    l, list [addr] [num]...... Lists instructions (default: PC, 8)\n"
+	  "    p, screen................. Shows the screen\n"
+	  "    k, key [key] [0/1]........ Releases or presses a key\n"
+	  "    q, quit................... Quits\n";
+
+typedef struct _Session {
+	Chip8 c8;
+	Debugger dbg;
+	Printer prt;
+
+	bool quit;
+} Session;
+
+typedef void (*CommandFunc)(Session *ses, int argc, char *argv[]);
+
+typedef struct _Command {
+	const char *NAME;
+	const char *ALIAS;
+	CommandFunc func;
+} Command;
+
+static int _usage() {
+	fprintf(stderr, "%s", HELP_STRING);
+	return EXIT_FAILURE;
+}
+
+/* Parses a whole argument as a number */
+static bool _number(const char *ARG, int base, unsigned long *value) {
+	if( ARG == NULL || *ARG == '\0' ) {
+		return false;
+	}
+
+	char *end;
+	*value = strtoul(ARG, &end, base);
+	return *end == '\0';
+}
+
+static bool _address(const char *ARG, uint16_t *addr) {
+	unsigned long value;
+	if( !_number(ARG, 16, &value) || value >= MEM_SIZE ) {
+		printf("Invalid address '%s'\n", ARG ? ARG : "");
+		return false;
+	}
+
+	*addr = value;
+	return true;
+}
+
+/* Optional decimal argument */
+static bool _count(const char *ARG, unsigned long fallback, uint64_t *count) {
+	unsigned long value = fallback;
+	if( ARG && (!_number(ARG, 10, &value) || value == 0) ) {
+		printf("Invalid count '%s'\n", ARG);
+		return false;
+	}
+
+	*count = value;
+	return true;
+}
+
+/* Lists instructions, marking the PC and breakpoints */
+static void _list(Session *ses, uint16_t addr, uint64_t count) {
+	Printer *prt = &ses->prt;
+
+	for( uint64_t n = 0; n < count; ++n, addr += 2 ) {
+		addr &= MEM_SIZE - 1;
+
+		prtString(prt, addr == ses->c8.pc ? "-> " : "   ");
+		prtString(prt, dbgHasBreakpoint(&ses->dbg, addr) ? "* " : "  ");
+
+		const uint16_t OPCODE = (c8ReadByte(&ses->c8, addr) << 8)
+			| c8ReadByte(&ses->c8, addr + 1);
+		prtInstruction(prt, addr, c8ParseInstruction(OPCODE));
+	}
+
+	prtFlush(prt);
+}
+
+static void _stopped(Session *ses, DbgStop stop) {
+	switch( stop ) {
+	case DBG_STOP_STEP:
+		break;
+	case DBG_STOP_BREAKPOINT:
+		printf("Breakpoint at %03X\n", ses->c8.pc);
+		break;
+	case DBG_STOP_WATCHPOINT:
+		printf("Watchpoint at %03X, now %02X\n", ses->dbg.watched,
+			c8ReadByte(&ses->c8, ses->dbg.watched));
+		break;
+	case DBG_STOP_BUDGET:
+		printf("Nothing hit, stopped after %llu frames\n",
+			(unsigned long long)ses->dbg.frames);
+		break;
+	}
+
+	_list(ses, ses->c8.pc, 1);
+}
+
+static bool _condition(int argc, char *argv[], DbgCondition *cond) {
+	static const struct {
+		const char *NAME;
+		DbgCmp cmp;
+	} OPS[] = {
+		{ "==", DBG_CMP_EQ },
+		{ "!=", DBG_CMP_NE },
+		{ "<=", DBG_CMP_LE },
+		{ ">=", DBG_CMP_GE },
+		{ "<", DBG_CMP_LT },
+		{ ">", DBG_CMP_GT },
+	};
+
+	if( argc != 3 ) {
+		return false;
+	}
+
+	const char *REG = argv[0];
+	if( (REG[0] == 'I' || REG[0] == 'i') && REG[1] == '\0' ) {
+		cond->reg = DBG_REG_I;
+	} else if( (REG[0] == 'V' || REG[0] == 'v') && REG[1] != '\0'
+		&& REG[2] == '\0' ) {
+		unsigned long value;
+		if( !_number(REG + 1, 16, &value) ) {
+			return false;
+		}
+
+		cond->reg = value;
+	} else {
+		return false;
+	}
+
+	size_t op = 0;
+	while( op < sizeof(OPS) / sizeof(*OPS)
+		&& strcmp(argv[1], OPS[op].NAME) != 0 ) {
+		++op;
+	}
+
+	unsigned long value;
+	if( op == sizeof(OPS) / sizeof(*OPS) || !_number(argv[2], 16, &value)
+		|| value > 0xFFFF ) {
+		return false;
+	}
+
+	cond->cmp = OPS[op].cmp;
+	cond->value = value;
+	return true;
+}
+
+static void _break(Session *ses, int argc, char *argv[]) {
+	uint16_t addr;
+	if( !_address(argv[0], &addr) ) {
+		return;
+	}
+
+	if( argc == 1 ) {
+		dbgSetBreakpoint(&ses->dbg, addr);
+		printf("Breakpoint at %03X\n", addr);
+		return;
+	}
+
+	DbgCondition cond;
+	if( strcmp(argv[1], "if") != 0 || !_condition(argc - 2, argv + 2, &cond) ) {
+		printf("Invalid condition, expected 'if REG OP VALUE'\n");
+		return;
+	}
+
+	if( dbgSetCondition(&ses->dbg, addr, cond) == EXIT_FAILURE ) {
+		printf("Too many conditions, at most %d can be set\n",
+			DBG_MAX_CONDITIONS);
+		return;
+	}
+
+	printf("Conditional breakpoint at %03X\n", addr);
+}
+
+static void _delete(Session *ses, int argc, char *argv[]) {
+	uint16_t addr;
+	if( _address(argv[0], &addr) ) {
+		dbgClearBreakpoint(&ses->dbg, addr);
+	}
+}
+
+static bool _range(int argc, char *argv[], uint16_t *addr, uint64_t *size) {
+	return _address(argv[0], addr)
+		&& _count(argc > 1 ? argv[1] : NULL, 1, size);
+}
+
+static void _watch(Session *ses, int argc, char *argv[]) {
+	uint16_t addr;
+	uint64_t size;
+	if( _range(argc, argv, &addr, &size) ) {
+		dbgSetWatchpoint(&ses->dbg, addr, size);
+	}
+}
+
+static void _unwatch(Session *ses, int argc, char *argv[]) {
+	uint16_t addr;
+	uint64_t size;
+	if( _range(argc, argv, &addr, &size) ) {
+		dbgClearWatchpoint(&ses->dbg, addr, size);
+	}
+}
+
+static void _step(Session *ses, int argc, char *argv[]) {
+	uint64_t count;
+	if( _count(argv[0], 1, &count) ) {
+		_stopped(ses, dbgStep(&ses->dbg, count));
+	}
+}
+
+static uint64_t _budget(const Session *ses, uint64_t frames) {
+	return frames * ses->dbg.cyclesPerFrame;
+}
+
+static void _next(Session *ses, int argc, char *argv[]) {
+	_stopped(ses, dbgStepOver(&ses->dbg, _budget(ses, DEFAULT_BUDGET)));
+}
+
+static void _finish(Session *ses, int argc, char *argv[]) {
+	if( ses->c8.sp == 0 ) {
+		printf("Not in a subroutine\n");
+		return;
+	}
+
+	_stopped(ses, dbgStepOut(&ses->dbg, _budget(ses, DEFAULT_BUDGET)));
+}
+
+static void _frame(Session *ses, int argc, char *argv[]) {
+	uint64_t count;
+	if( _count(argv[0], 1, &count) ) {
+		_stopped(ses, dbgStepFrame(&ses->dbg, count));
+	}
+}
+
+static void _continue(Session *ses, int argc, char *argv[]) {
+	uint64_t frames;
+	if( _count(argv[0], DEFAULT_BUDGET, &frames) ) {
+		_stopped(ses, dbgContinue(&ses->dbg, _budget(ses, frames)));
+	}
+}
+
+static void _regs(Session *ses, int argc, char *argv[]) {
+	const Chip8 *C8 = &ses->c8;
+
+	printf("PC=%04X I=%04X SP=%X DT=%02X ST=%02X\n", C8->pc, C8->i, C8->sp,
+		C8->timers.dt, C8->timers.st);
+
+	for( int reg = 0; reg < 16; ++reg ) {
+		printf("V%X=%02X%c", reg, C8->v[reg], reg % 8 == 7 ? '\n' : ' ');
+	}
+
+	printf("Stack:");
+	for( int level = 0; level < C8->sp; ++level ) {
+		printf(" %04X", C8->stack[level]);
+	}
+
+	printf("\nExecuted %llu instructions, %llu frames\n",
+		(unsigned long long)ses->dbg.executed,
+		(unsigned long long)ses->dbg.frames);
+}
+
+static void _mem(Session *ses, int argc, char *argv[]) {
+	uint16_t addr = ses->c8.i & (MEM_SIZE - 1);
+	uint64_t size = 16;
+
+	if( (argv[0] && !_address(argv[0], &addr))
+		|| !_count(argv[0] ? argv[1] : NULL, 16, &size) ) {
+		return;
+	}
+
+	for( uint64_t n = 0; n < size; ++n ) {
+		const uint16_t ADDR = (addr + n) & (MEM_SIZE - 1);
+		if( n % 16 == 0 ) {
+			printf("%s%03X:", n > 0 ? "\n" : "", ADDR);
+		}
+
+		printf(" %02X", c8ReadByte(&ses->c8, ADDR));
+	}
+
+	printf("\n");
+}
+
+static void _listCommand(Session *ses, int argc, char *argv[]) {
+	uint16_t addr = ses->c8.pc;
+	uint64_t count = 8;
+
+	if( (argv[0] && !_address(argv[0], &addr))
+		|| !_count(argv[0] ? argv[1] : NULL, 8, &count) ) {
+		return;
+	}
+
+	_list(ses, addr, count);
+}
+
+static void _screen(Session *ses, int argc, char *argv[]) {
+	char row[SCR_WIDTH + 1] = { 0 };
+
+	for( int y = 0; y < SCR_HEIGHT; ++y ) {
+		for( int x = 0; x < SCR_WIDTH; ++x ) {
+			row[x] = c8GetPixel(&ses->c8, x, y) ? '#' : '.';
+		}
+
+		printf("%s\n", row);
+	}
+}
+
+static void _key(Session *ses, int argc, char *argv[]) {
+	unsigned long key, state;
+	if( argc != 2 || !_number(argv[0], 16, &key) || key > 0xF
+		|| !_number(argv[1], 10, &state) || state > 1 ) {
+		printf("Expected 'key [0-F] [0/1]'\n");
+		return;
+	}
+
+	c8KeyEvent(&ses->c8, key, state);
+}
+
+static void _quit(Session *ses, int argc, char *argv[]) {
+	ses->quit = true;
+}
+
+static void _help(Session *ses, int argc, char *argv[]) {
+	printf("%s", COMMANDS_STRING);
+}
+
+static const Command COMMANDS[] = {
+	{ "break", "b", _break },
+	{ "delete", "d", _delete },
+	{ "watch", "w", _watch },
+	{ "unwatch", "u", _unwatch },
+	{ "step", "s", _step },
+	{ "next", "n", _next },
+	{ "finish", "f", _finish },
+	{ "frame", "fr", _frame },
+	{ "continue", "c", _continue },
+	{ "regs", "r", _regs },
+	{ "mem", "x", _mem },
+	{ "list", "l", _listCommand },
+	{ "screen", "p", _screen },
+	{ "key", "k", _key },
+	{ "quit", "q", _quit },
+	{ "help", "h", _help },
+};
+
+#define COMMAND_COUNT (sizeof(COMMANDS) / sizeof(*COMMANDS))
+
+/* Commands that need an argument */
+static bool _needsArgument(CommandFunc func) {
+	return func == _break || func == _delete || func == _watch
+		|| func == _unwatch || func == _key;
+}
+
+static void _execute(Session *ses, char *line) {
+	char *argv[MAX_ARGS + 1] = { 0 };
+	int argc = 0;
+
+	for( char *arg = strtok(line, " \t\r\n"); arg && argc < MAX_ARGS;
+		arg = strtok(NULL, " \t\r\n") ) {
+		argv[argc++] = arg;
+	}
+
+	if( argc == 0 ) {
+		return;
+	}
+
+	for( size_t n = 0; n < COMMAND_COUNT; ++n ) {
+		const Command *CMD = &COMMANDS[n];
+		if( strcmp(argv[0], CMD->NAME) != 0
+			&& strcmp(argv[0], CMD->ALIAS) != 0 ) {
+			continue;
+		}
+
+		if( argc == 1 && _needsArgument(CMD->func) ) {
+			printf("'%s' needs an argument, see 'help'\n", CMD->NAME);
+			return;
+		}
+
+		CMD->func(ses, argc - 1, argv + 1);
+		return;
+	}
+
+	printf("Unknown command '%s', see 'help'\n", argv[0]);
+}
+
+static int _debug(const char *PATH, int cycles) {
+	C8Image *image = malloc(sizeof(*image));
+	if( image == NULL ) {
+		fprintf(stderr, "ERR: Couldn't allocate memory for program\n");
+		return EXIT_FAILURE;
+	}
+
+	C8Rom rom;
+	C8LoadError error = c8RomOpen(&rom, PATH);
+	if( error == C8_LOAD_OK ) {
+		error = c8ImageNew(image, rom.map.data, rom.map.size);
+		c8RomClose(&rom);
+	}
+
+	if( error != C8_LOAD_OK ) {
+		fprintf(stderr, "ERR: Couldn't load '%s': %s\n", PATH,
+			c8LoadErrorString(error));
+		free(image);
+		return EXIT_FAILURE;
+	}
+
+	Session *ses = malloc(sizeof(*ses));
+	if( ses == NULL || prtNew(&ses->prt, stdout, PRT_FORMAT_TEXT, false)
+		== EXIT_FAILURE ) {
+		fprintf(stderr, "ERR: Couldn't allocate memory for debugger\n");
+		free(ses);
+		free(image);
+		return EXIT_FAILURE;
+	}
+
+	/* Same seed as the other headless tools, so runs can be compared */
+	ses->c8 = c8NewShared(image);
+	c8Seed(&ses->c8, 1);
+	dbgAttach(&ses->dbg, &ses->c8, cycles);
+	ses->quit = false;
+
+	_list(ses, ses->c8.pc, 1);
+
+	char line[LINE_SIZE];
+	while( !ses->quit ) {
+		printf("(chip8) ");
+		fflush(stdout);
+
+		if( fgets(line, LINE_SIZE, stdin) == NULL ) {
+			printf("\n");
+			break;
+		}
+
+		_execute(ses, line);
+		fflush(stdout);
+	}
+
+	prtFree(&ses->prt);
+	c8Free(&ses->c8);
+	free(ses);
+	free(image);
+
+	return EXIT_SUCCESS;
+}
+
+int debugMain(int argc, char *argv[]) {
+	if( argc == 0 ) {
+		return _usage();
+	}
+
+	char *file = NULL;
+	int cycles = 16;
+
+	while( *argv ) {
+		if( strcmp(*argv, "help") == 0 || strcmp(*argv, "--help") == 0 ) {
+			_usage();
+			return EXIT_SUCCESS;
+		} else if( strcmp(*argv, "-c") == 0
+			|| strcmp(*argv, "--cycles") == 0 ) {
+			++argv;
+			if( !*argv ) {
+				return _usage();
+			}
+
+			cycles = atoi(*argv);
+		} else if( *(argv + 1) ) {
+			fprintf(stderr, "ERR: Unknown option '%s'!\n\n", *argv);
+			return _usage();
+		} else {
+			file = *argv;
+			break;
+		}
+
+		++argv;
+	}
+
+	if( !file ) {
+		fprintf(stderr, "ERR: An input file must be provided!\n\n");
+		return _usage();
+	}
+
+	if( cycles < 1 ) {
+		fprintf(stderr, "ERR: Options must be positive numbers!\n\n");
+		return _usage();
+	}
+
+	return _debug(file, cycles);
+}
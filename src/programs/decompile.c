@@ -10,241 +10,270 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <sys/stat.h>
+
+#include "analyser.h"
 #include "chip8.h"
 #include "util.h"
 #include "decompile.h"
+#include "printer.h"
 
 static bool _verbose = false;
+static PrtFormat _format = PRT_FORMAT_TEXT;
 
-static uint16_t _getraw(const Instr OP) {
-	return (OP.op << 12) | OP.nnn;
-}
+#define PATH_SIZE 4096
 
-#define PRINTOP(S, ...)                                                        \
-	(fprintf(                                                                  \
-		file, "0x%04X: %04X " S "\n", 0x0200 + i, _getraw(OP), ##__VA_ARGS__))
+/* A single program in a bulk decompilation */
+typedef struct _Job {
+	char *name;
+	size_t size;
 
-#define VPRINT(Y, N) (_verbose ? Y : N)
+	/* Analysis results */
+	size_t calls;
+	size_t jumps;
+	size_t skips;
 
-static void _op0(int i, const Instr OP, FILE *file) {
-	switch( OP.nn ) {
-	case 0xE0:
-		VPRINT(PRINTOP("Clear the screen"), PRINTOP("CLS"));
-		break;
-	case 0xEE:
-		VPRINT(PRINTOP("Return from subroutine"), PRINTOP("RET"));
-		break;
-	default:
-		VPRINT(PRINTOP("Run assembly @ %04X (might be data)", OP.nnn),
-			PRINTOP("SYS %04X", OP.nnn));
+	bool ok;
+} Job;
+
+typedef struct _Bulk {
+	const char *INDIR;
+	const char *OUTDIR;
+
+	Job *jobs;
+	size_t count;
+
+	Printer *printers; /* One per worker */
+} Bulk;
+
+static int _getOutfile(const char *PATH, FILE **out) {
+	*out = fopen(PATH, "w");
+	if( *out == NULL ) {
+		fprintf(stderr, "ERR: Couldn't open file '%s'\n", PATH);
+		return EXIT_FAILURE;
 	}
-}
 
-static void _op1(int i, const Instr OP, FILE *file) {
-	VPRINT(PRINTOP("Jump to %04X", OP.nnn), PRINTOP("JP %04X", OP.nnn));
+	return EXIT_SUCCESS;
 }
 
-static void _op2(int i, const Instr OP, FILE *file) {
-	VPRINT(PRINTOP("Call subroutine @ %04X", OP.nnn),
-		PRINTOP("CALL %04X", OP.nnn));
+static const char *_extension(void) {
+	switch( _format ) {
+	case PRT_FORMAT_JSON:
+		return "json";
+	case PRT_FORMAT_ASM:
+		return "asm";
+	default:
+		return "txt";
+	}
 }
 
-static void _op3(int i, const Instr OP, FILE *file) {
-	VPRINT(PRINTOP("Skip next if V%X == %X", OP.x, OP.nn),
-		PRINTOP("SE V%X, %X", OP.x, OP.nn));
-}
+static int _getFormat(const char *NAME, PrtFormat *format) {
+	if( strcmp(NAME, "text") == 0 ) {
+		*format = PRT_FORMAT_TEXT;
+	} else if( strcmp(NAME, "json") == 0 ) {
+		*format = PRT_FORMAT_JSON;
+	} else if( strcmp(NAME, "asm") == 0 ) {
+		*format = PRT_FORMAT_ASM;
+	} else {
+		fprintf(stderr, "ERR: Unknown format '%s'!\n\n", NAME);
+		return EXIT_FAILURE;
+	}
 
-static void _op4(int i, const Instr OP, FILE *file) {
-	VPRINT(PRINTOP("Skip next if V%X != %X", OP.x, OP.nn),
-		PRINTOP("SNE V%X, %X", OP.x, OP.nn));
+	return EXIT_SUCCESS;
 }
 
-static void _op5(int i, const Instr OP, FILE *file) {
-	VPRINT(PRINTOP("Skip next if V%X == V%X", OP.x, OP.y),
-		PRINTOP("SE V%X, V%X", OP.x, OP.y));
-}
+static int _decompileFile(const char *PATH, const char *OUTPATH) {
+	UtilMap rom;
+	if( utilMapFile(PATH, &rom) == EXIT_FAILURE ) {
+		return EXIT_FAILURE;
+	}
 
-static void _op6(int i, const Instr OP, FILE *file) {
-	VPRINT(PRINTOP("Set V%X to %X", OP.x, OP.nn),
-		PRINTOP("LD V%X, %X", OP.x, OP.nn));
-}
+	FILE *output = stdout;
+	if( OUTPATH && _getOutfile(OUTPATH, &output) == EXIT_FAILURE ) {
+		utilUnmapFile(&rom);
+		return EXIT_FAILURE;
+	}
 
-static void _op7(int i, const Instr OP, FILE *file) {
-	VPRINT(PRINTOP("Add %X to V%x", OP.nn, OP.x),
-		PRINTOP("ADD V%X, %X", OP.x, OP.nn));
-}
+	Printer prt;
+	if( prtNew(&prt, output, _format, _verbose) == EXIT_FAILURE ) {
+		utilUnmapFile(&rom);
+		if( OUTPATH ) {
+			fclose(output);
+		}
 
-static void _op8(int i, const Instr OP, FILE *file) {
-	switch( OP.n ) {
-	case 0x0:
-		VPRINT(PRINTOP("Set V%X to V%X", OP.x, OP.y),
-			PRINTOP("LD V%X, V%X", OP.x, OP.y));
-		break;
-	case 0x1:
-		VPRINT(PRINTOP("OR V%X with V%X", OP.x, OP.y),
-			PRINTOP("OR V%X, V%X", OP.x, OP.y));
-		break;
-	case 0x2:
-		VPRINT(PRINTOP("AND V%X with V%X", OP.x, OP.y),
-			PRINTOP("AND V%X, V%X", OP.x, OP.y));
-		break;
-	case 0x3:
-		VPRINT(PRINTOP("XOR V%X with V%X", OP.x, OP.y),
-			PRINTOP("XOR V%X, V%X", OP.x, OP.y));
-		break;
-	case 0x4:
-		VPRINT(PRINTOP("Add V%X to V%X", OP.y, OP.x),
-			PRINTOP("ADD V%X, V%X", OP.x, OP.y));
-		break;
-	case 0x5:
-		VPRINT(PRINTOP("Subtract V%X from V%X", OP.y, OP.x),
-			PRINTOP("SUB V%X, V%X", OP.x, OP.y));
-		break;
-	case 0x6:
-		VPRINT(PRINTOP("Set V%X to V%X >> 1", OP.x, OP.y),
-			PRINTOP("SHR V%X, V%X", OP.x, OP.y));
-		break;
-	case 0x7:
-		VPRINT(PRINTOP("Subtract V%X from V%X, store in V%X", OP.x, OP.y, OP.x),
-			PRINTOP("SUBN V%X, V%X", OP.x, OP.y));
-		break;
-	case 0xE:
-		VPRINT(PRINTOP("Set V%X to V%X << 1", OP.x, OP.y),
-			PRINTOP("SHL V%X, V%X", OP.x, OP.y));
-		break;
-	default:
-		VPRINT(PRINTOP("Unknown instruction (might be data)"), PRINTOP("???"));
+		return EXIT_FAILURE;
 	}
-}
 
-static void _op9(int i, const Instr OP, FILE *file) {
-	VPRINT(PRINTOP("Skip next if V%X != V%X", OP.x, OP.y),
-		PRINTOP("SNE V%X, V%X", OP.x, OP.y));
-}
+	prtProgram(&prt, PATH, rom.data, rom.size);
+	prtFree(&prt);
 
-static void _opA(int i, const Instr OP, FILE *file) {
-	VPRINT(PRINTOP("Set I to %04X", OP.nnn), PRINTOP("LD I, %04X", OP.nnn));
-}
+	utilUnmapFile(&rom);
 
-static void _opB(int i, const Instr OP, FILE *file) {
-	VPRINT(
-		PRINTOP("Jump to V0 + %04X", OP.nnn), PRINTOP("JP V0, %04X", OP.nnn));
-}
+	if( OUTPATH ) {
+		fclose(output);
+	}
 
-static void _opC(int i, const Instr OP, FILE *file) {
-	VPRINT(PRINTOP("Set V%X to random byte w/ mask %X", OP.x, OP.nn),
-		PRINTOP("RND V%X, %X", OP.x, OP.nn));
+	return EXIT_SUCCESS;
 }
 
-static void _opD(int i, const Instr OP, FILE *file) {
-	VPRINT(PRINTOP("Draw %X-byte long sprite to (V%X, V%X)", OP.n, OP.x, OP.y),
-		PRINTOP("DRAW V%X, V%X, %X", OP.x, OP.y, OP.n));
-}
+/* Decompiles and analyses a single program of a bulk job */
+static void _bulkTask(void *ctx, size_t index, int worker) {
+	Bulk *bulk = ctx;
+	Job *job = &bulk->jobs[index];
+	Printer *prt = &bulk->printers[worker];
 
-static void _opE(int i, const Instr OP, FILE *file) {
-	switch( OP.nn ) {
-	case 0x9E:
-		VPRINT(PRINTOP("Skip next if key %X is pressed", OP.x),
-			PRINTOP("SKP V%X", OP.x));
-		break;
-	case 0xA1:
-		VPRINT(PRINTOP("Skip next if key %X is not pressed", OP.x),
-			PRINTOP("SKNP V%X", OP.x));
-		break;
-	default:
-		VPRINT(PRINTOP("Unknown instruction (might be data)"), PRINTOP("???"));
+	char inpath[PATH_SIZE], outpath[PATH_SIZE];
+	snprintf(inpath, PATH_SIZE, "%s/%s", bulk->INDIR, job->name);
+	snprintf(outpath, PATH_SIZE, "%s/%s.%s", bulk->OUTDIR, job->name,
+		_extension());
+
+	UtilMap rom;
+	if( utilMapFile(inpath, &rom) == EXIT_FAILURE ) {
+		return;
 	}
-}
 
-static void _opF(int i, const Instr OP, FILE *file) {
-	switch( OP.nn ) {
-	case 0x07:
-		VPRINT(PRINTOP("Load delay timer into V%X", OP.x),
-			PRINTOP("LD V%X, DT", OP.x));
-		break;
-	case 0x0A:
-		VPRINT(PRINTOP("Wait for key, store in V%X", OP.x),
-			PRINTOP("LD V%X, K", OP.x));
-		break;
-	case 0x15:
-		VPRINT(PRINTOP("Set delay timer to V%X", OP.x),
-			PRINTOP("LD DT, V%X", OP.x));
-		break;
-	case 0x18:
-		VPRINT(PRINTOP("Set sound timer to V%X", OP.x),
-			PRINTOP("LD ST, V%X", OP.x));
-		break;
-	case 0x1E:
-		VPRINT(PRINTOP("Add V%X to I", OP.x), PRINTOP("ADD I, V%X", OP.x));
-		break;
-	case 0x29:
-		VPRINT(PRINTOP("Load digit V%X address into I", OP.x),
-			PRINTOP("LD F, V%X", OP.x));
-		break;
-	case 0x33:
-		VPRINT(PRINTOP("Store BCD of V%X into I...I+2", OP.x),
-			PRINTOP("LD B, V%X", OP.x));
-		break;
-	case 0x55:
-		VPRINT(PRINTOP("Store V0...V%X starting at I", OP.x),
-			PRINTOP("LD [I], V%X", OP.x));
-		break;
-	case 0x65:
-		VPRINT(PRINTOP("Read V0...V%X starting at I", OP.x),
-			PRINTOP("LD V%X, [I]", OP.x));
-		break;
-	default:
-		VPRINT(PRINTOP("Unknown instruction (might be data)"), PRINTOP("???"));
+	FILE *output;
+	if( _getOutfile(outpath, &output) == EXIT_FAILURE ) {
+		utilUnmapFile(&rom);
+		return;
 	}
+
+	prtReset(prt, output);
+	prtProgram(prt, inpath, rom.data, rom.size);
+	prtFlush(prt);
+
+	fclose(output);
+
+	Analyser anl = anlInit(rom.data, rom.size);
+	if( anlAnalyse(&anl) == EXIT_SUCCESS ) {
+		job->calls = anl.subroutines.size / 2;
+		job->jumps = anl.jumps.size / 2;
+		job->skips = anl.skips.size;
+		job->ok = true;
+	}
+
+	anlFree(&anl);
+
+	job->size = rom.size;
+	utilUnmapFile(&rom);
 }
 
-typedef void (*decompFunc)(int, Instr, FILE *);
-
-static const decompFunc opTable[] = {
-	_op0,
-	_op1,
-	_op2,
-	_op3,
-	_op4,
-	_op5,
-	_op6,
-	_op7,
-	_op8,
-	_op9,
-	_opA,
-	_opB,
-	_opC,
-	_opD,
-	_opE,
-	_opF,
-};
-
-static int _getInfile(const char *PATH, FILE **out) {
-	*out = fopen(PATH, "w");
-	if( *out == NULL ) {
-		fprintf(stderr, "ERR: Couldn't open file '%s'\n", PATH);
+/* Creates a job for every file in the directory */
+static int _listDirectory(Bulk *bulk) {
+	char **names;
+	if( utilListFiles(bulk->INDIR, &names, &bulk->count) == EXIT_FAILURE ) {
 		return EXIT_FAILURE;
 	}
 
+	bulk->jobs = calloc(bulk->count, sizeof(*bulk->jobs));
+	if( bulk->count > 0 && bulk->jobs == NULL ) {
+		fprintf(stderr, "ERR: Couldn't allocate memory for job list\n");
+		utilFreeList(names, bulk->count);
+		bulk->count = 0;
+		return EXIT_FAILURE;
+	}
+
+	/* The jobs take over the names */
+	for( size_t i = 0; i < bulk->count; ++i ) {
+		bulk->jobs[i].name = names[i];
+	}
+
+	free(names);
+
 	return EXIT_SUCCESS;
 }
 
-static void _output(int i, const Instr INSTR, FILE *file) {
-	opTable[INSTR.op](i, INSTR, file);
+static int _writeIndex(Bulk *bulk) {
+	char path[PATH_SIZE];
+	snprintf(path, PATH_SIZE, "%s/index.txt", bulk->OUTDIR);
+
+	FILE *index;
+	if( _getOutfile(path, &index) == EXIT_FAILURE ) {
+		return EXIT_FAILURE;
+	}
+
+	size_t failed = 0;
+	fprintf(index, "name\tbytes\tcalls\tjumps\tskips\n");
+	for( size_t i = 0; i < bulk->count; ++i ) {
+		const Job *JOB = &bulk->jobs[i];
+		if( !JOB->ok ) {
+			fprintf(index, "%s\tFAILED\n", JOB->name);
+			++failed;
+			continue;
+		}
+
+		fprintf(index, "%s\t%zu\t%zu\t%zu\t%zu\n", JOB->name, JOB->size,
+			JOB->calls, JOB->jumps, JOB->skips);
+	}
+
+	fclose(index);
+
+	printf("Decompiled %zu programs into '%s' (%zu failed)\n",
+		bulk->count - failed, bulk->OUTDIR, failed);
+
+	return failed > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
 }
 
-static void _decompile(uint8_t *buffer, const size_t SIZE, FILE *file) {
-	for( size_t i = 0; i < SIZE; i += 2 ) {
-		const uint16_t INSTR = (buffer[i] << 8) | (buffer[i + 1]);
-		_output(i, c8ParseInstruction(INSTR), file);
+static int _decompileDirectory(const char *INDIR, const char *OUTDIR, int jobs) {
+	if( OUTDIR == NULL ) {
+		fprintf(stderr,
+			"ERR: An output directory (-o) must be provided when decompiling "
+			"a directory!\n\n");
+		return EXIT_FAILURE;
+	}
+
+	if( mkdir(OUTDIR, 0755) != 0 && !utilIsDirectory(OUTDIR) ) {
+		fprintf(stderr, "ERR: Couldn't create directory '%s'\n", OUTDIR);
+		return EXIT_FAILURE;
+	}
+
+	Bulk bulk = { .INDIR = INDIR, .OUTDIR = OUTDIR };
+	int result = _listDirectory(&bulk);
+
+	if( result == EXIT_SUCCESS ) {
+		bulk.printers = calloc(jobs, sizeof(*bulk.printers));
+		if( bulk.printers == NULL ) {
+			fprintf(stderr, "ERR: Couldn't allocate memory for printers\n");
+			result = EXIT_FAILURE;
+		}
+	}
+
+	int ready = 0;
+	for( ; result == EXIT_SUCCESS && ready < jobs; ++ready ) {
+		result = prtNew(&bulk.printers[ready], NULL, _format, _verbose);
 	}
+
+	if( result == EXIT_SUCCESS ) {
+		result = utilParallelFor(bulk.count, jobs, _bulkTask, &bulk);
+	}
+
+	if( result == EXIT_SUCCESS ) {
+		result = _writeIndex(&bulk);
+	}
+
+	for( int i = 0; i < ready; ++i ) {
+		prtFree(&bulk.printers[i]);
+	}
+
+	for( size_t i = 0; i < bulk.count; ++i ) {
+		free(bulk.jobs[i].name);
+	}
+
+	free(bulk.printers);
+	free(bulk.jobs);
+
+	return result;
 }
 
 static const char *HELP_STRING
-	= "usage: chip8 decompile [options] [program]\n\n"
+	= "usage: chip8 decompile [options] [program or directory]\n\n"
 	  "options:\n"
-	  "    -o, --out [file]... Outputs the result to a file\n"
-	  "    -v, --verbose...... Outputs plain english instead of assembly\n";
+	  "    -o, --out [file]....... Outputs the result to a file (or directory)\n"
+	  "    -v, --verbose.......... Outputs plain english instead of assembly\n"
+	  "    -f, --format [fmt]..... Output format, 'text' (default), 'json' or\n"
+	  "                            'asm' (can be compiled back)\n"
+	  "    -j, --jobs [num]....... Programs decompiled at once, when given a\n"
+	  "                            directory (default: one per core)\n";
 
 static int _usage() {
 	fprintf(stderr, "%s", HELP_STRING);
@@ -257,19 +286,38 @@ int decompMain(int argc, char *argv[]) {
 	}
 
 	char *file = NULL;
-	FILE *output = NULL;
+	char *output = NULL;
+	int jobs = 0;
 	while( *argv ) {
 		if( strcmp(*argv, "help") == 0 || strcmp(*argv, "--help") == 0 ) {
 			_usage();
 			return EXIT_SUCCESS;
 		} else if( strcmp(*argv, "-o") == 0 || strcmp(*argv, "--out") == 0 ) {
 			++argv;
-			if( _getInfile(*argv, &output) == EXIT_FAILURE ) {
-				return EXIT_FAILURE;
+			if( !*argv ) {
+				return _usage();
 			}
+
+			output = *argv;
 		} else if( strcmp(*argv, "-v") == 0
 			|| strcmp(*argv, "--verbose") == 0 ) {
 			_verbose = true;
+		} else if( strncmp(*argv, "--format=", 9) == 0 ) {
+			if( _getFormat(*argv + 9, &_format) == EXIT_FAILURE ) {
+				return _usage();
+			}
+		} else if( strcmp(*argv, "-f") == 0
+			|| strcmp(*argv, "--format") == 0 ) {
+			++argv;
+			if( !*argv || _getFormat(*argv, &_format) == EXIT_FAILURE ) {
+				return _usage();
+			}
+		} else if( strcmp(*argv, "-j") == 0 || strcmp(*argv, "--jobs") == 0 ) {
+			++argv;
+			if( !*argv || (jobs = atoi(*argv)) < 1 ) {
+				fprintf(stderr, "ERR: Invalid number of jobs!\n\n");
+				return _usage();
+			}
 		} else if( *(argv + 1) ) {
 			fprintf(stderr, "ERR: Unknown option '%s'!\n\n", *argv);
 			return _usage();
@@ -283,30 +331,18 @@ int decompMain(int argc, char *argv[]) {
 
 	if( !file ) {
 		fprintf(stderr, "ERR: An input file must be provided!\n\n");
-		if( output ) {
-			fclose(output);
-		}
-
 		return _usage();
 	}
-	uint8_t *buffer = NULL;
-	const size_t BYTES_READ = utilLoadBinaryFile(file, &buffer);
 
-	if( BYTES_READ == -1 ) {
-		return EXIT_FAILURE;
+	if( utilIsDirectory(file) ) {
+		return _decompileDirectory(file, output,
+			jobs > 0 ? jobs : utilCPUCount());
 	}
 
-	if( output ) {
-		fprintf(output, "%s, %zu bytes long\n\n", file, BYTES_READ);
-		_decompile(buffer, BYTES_READ, output);
-	} else {
-		printf("%s, %zu bytes long\n\n", file, BYTES_READ);
-		_decompile(buffer, BYTES_READ, stdout);
-	}
-
-	if( output ) {
-		fclose(output);
+	if( jobs > 0 ) {
+		fprintf(stderr, "ERR: --jobs needs a directory of programs!\n\n");
+		return _usage();
 	}
 
-	return EXIT_SUCCESS;
+	return _decompileFile(file, output);
 }
@@ -0,0 +1,454 @@
+/* Chip-8 program explorer
+ *
+ * This subprogram runs a program headless, feeding it generated keypad
+ * sequences and looking for every distinct state (and screen) it can reach.
+ * Sequences that lead to an already-visited state are pruned. Useful for
+ * finding screens a tester would never get to by hand.
+ */
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "chip8.h"
+#include "explore.h"
+#include "util.h"
+
+/* Each step either presses nothing, or one of the 16 keys */
+#define KEY_CHOICES 17
+
+/* A state waiting to be expanded */
+typedef struct _Node {
+	Chip8 c8;
+	int depth;
+
+	struct _Node *next;
+} Node;
+
+/* A screen seen for the first time */
+typedef struct _Screen {
+	uint64_t hash;
+	uint64_t display[SCR_HEIGHT];
+	int depth;
+
+	struct _Screen *next;
+} Screen;
+
+typedef struct _Explorer {
+	C8Image image;
+
+	int maxDepth; /* Longest keypad sequence */
+	int frames; /* Frames per step of a sequence */
+	int cycles; /* Cycles per frame */
+
+	UtilHashSet states;
+	UtilHashSet screens;
+	atomic_bool full; /* Set once the state set fills up */
+
+	/* States waiting to be expanded */
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+	Node *stack;
+	int busy; /* Workers currently expanding a state */
+	bool done;
+
+	/* Per-worker results, so workers never contend on them */
+	Screen **found;
+	size_t *runs;
+} Explorer;
+
+static void _push(Explorer *ex, Node *node) {
+	pthread_mutex_lock(&ex->lock);
+
+	node->next = ex->stack;
+	ex->stack = node;
+
+	pthread_cond_signal(&ex->wake);
+	pthread_mutex_unlock(&ex->lock);
+}
+
+/* Takes a state to expand. Returns NULL once there's no work left */
+static Node *_pop(Explorer *ex) {
+	pthread_mutex_lock(&ex->lock);
+
+	while( !ex->stack && ex->busy > 0 && !ex->done ) {
+		pthread_cond_wait(&ex->wake, &ex->lock);
+	}
+
+	Node *node = ex->stack;
+	if( node ) {
+		ex->stack = node->next;
+		++ex->busy;
+	} else {
+		ex->done = true;
+		pthread_cond_broadcast(&ex->wake);
+	}
+
+	pthread_mutex_unlock(&ex->lock);
+	return node;
+}
+
+static void _finish(Explorer *ex) {
+	pthread_mutex_lock(&ex->lock);
+
+	if( --ex->busy == 0 && !ex->stack ) {
+		ex->done = true;
+		pthread_cond_broadcast(&ex->wake);
+	}
+
+	pthread_mutex_unlock(&ex->lock);
+}
+
+static void _freeNode(Node *node) {
+	c8Free(&node->c8);
+	free(node);
+}
+
+/* Runs one step of a sequence. The key is held for the first half, or the
+ * first frame if that's shorter. Both edges go through c8KeyEvent, so FX0A
+ * sees a press even if it's released within the frame
+ */
+static void _step(const Explorer *EX, Chip8 *c8, int choice) {
+	const int HOLD = EX->frames > 1 ? EX->frames / 2 : 1;
+	const uint8_t KEY = choice - 1;
+
+	if( choice > 0 ) {
+		c8KeyEvent(c8, KEY, true);
+	}
+
+	for( int frame = 0; frame < EX->frames; ++frame ) {
+		if( frame == HOLD && choice > 0 ) {
+			c8KeyEvent(c8, KEY, false);
+		}
+
+		/* Halted, waiting or stuck programs sit still until the next frame,
+		 * so their cycles are skipped. Unknown opcodes don't stop them
+		 */
+		for( uint32_t left = EX->cycles; left > 0; ) {
+			const C8RunResult RESULT = c8Run(c8, left);
+			if( RESULT.status != C8_INVALID_OPCODE ) {
+				break;
+			}
+
+			left -= RESULT.cycles;
+		}
+
+		c8TickTimers(c8);
+	}
+
+	if( EX->frames <= HOLD && choice > 0 ) {
+		c8KeyEvent(c8, KEY, false);
+	}
+}
+
+static void _recordScreen(Explorer *ex, const Node *NODE, int worker) {
+	const uint64_t HASH
+		= utilHash64(NODE->c8.display, sizeof(NODE->c8.display), 0);
+
+	if( utilHashSetInsert(&ex->screens, HASH) != 1 ) {
+		return;
+	}
+
+	Screen *screen = malloc(sizeof(*screen));
+	if( screen == NULL ) {
+		return;
+	}
+
+	screen->hash = HASH;
+	screen->depth = NODE->depth;
+	memcpy(screen->display, NODE->c8.display, sizeof(screen->display));
+
+	screen->next = ex->found[worker];
+	ex->found[worker] = screen;
+}
+
+/* Expands a state into all of its children */
+static void _expand(Explorer *ex, const Node *NODE, int worker) {
+	for( int choice = 0; choice < KEY_CHOICES; ++choice ) {
+		Node *child = malloc(sizeof(*child));
+		if( child == NULL || c8Clone(&child->c8, &NODE->c8) == EXIT_FAILURE ) {
+			free(child);
+			return;
+		}
+
+		child->depth = NODE->depth + 1;
+		_step(ex, &child->c8, choice);
+		++ex->runs[worker];
+
+		const int INSERTED
+			= utilHashSetInsert(&ex->states, c8StateHash(&child->c8));
+		if( INSERTED == -1 ) {
+			atomic_store(&ex->full, true);
+		}
+
+		if( INSERTED != 1 ) {
+			_freeNode(child);
+			continue;
+		}
+
+		_recordScreen(ex, child, worker);
+
+		if( child->depth < ex->maxDepth ) {
+			_push(ex, child);
+		} else {
+			_freeNode(child);
+		}
+	}
+}
+
+static void _worker(void *ctx, size_t index, int worker) {
+	Explorer *ex = ctx;
+
+	Node *node;
+	while( (node = _pop(ex)) != NULL ) {
+		_expand(ex, node, worker);
+		_freeNode(node);
+		_finish(ex);
+	}
+}
+
+static int _writeScreens(Explorer *ex, int jobs, const char *PATH) {
+	FILE *file = fopen(PATH, "w");
+	if( file == NULL ) {
+		fprintf(stderr, "ERR: Couldn't open file '%s'\n", PATH);
+		return EXIT_FAILURE;
+	}
+
+	for( int worker = 0; worker < jobs; ++worker ) {
+		for( Screen *s = ex->found[worker]; s; s = s->next ) {
+			fprintf(file, "screen %016llX, %d steps in\n",
+				(unsigned long long)s->hash, s->depth);
+
+			for( int y = 0; y < SCR_HEIGHT; ++y ) {
+				char line[SCR_WIDTH + 2];
+				for( int x = 0; x < SCR_WIDTH; ++x ) {
+					const bool SET = (s->display[y] >> (SCR_WIDTH - 1 - x)) & 1;
+					line[x] = SET ? '#' : '.';
+				}
+
+				line[SCR_WIDTH] = '\n';
+				line[SCR_WIDTH + 1] = '\0';
+				fputs(line, file);
+			}
+
+			fputc('\n', file);
+		}
+	}
+
+	fclose(file);
+	return EXIT_SUCCESS;
+}
+
+static double _seconds(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int _explore(Explorer *ex, int jobs, const char *OUTPATH) {
+	Node *root = malloc(sizeof(*root));
+	if( root == NULL ) {
+		fprintf(stderr, "ERR: Couldn't allocate memory for initial state\n");
+		return EXIT_FAILURE;
+	}
+
+	root->c8 = c8NewShared(&ex->image);
+	root->depth = 0;
+	c8Seed(&root->c8, 1);
+
+	utilHashSetInsert(&ex->states, c8StateHash(&root->c8));
+	_recordScreen(ex, root, 0);
+	_push(ex, root);
+
+	const double START = _seconds();
+	int result = utilParallelFor(jobs, jobs, _worker, ex);
+	const double ELAPSED = _seconds() - START;
+
+	size_t runs = 0;
+	for( int worker = 0; worker < jobs; ++worker ) {
+		runs += ex->runs[worker];
+	}
+
+	printf("Ran %zu keypad steps in %.2fs, %d workers\n", runs, ELAPSED, jobs);
+	printf("Distinct states: %zu\n", atomic_load(&ex->states.size));
+	printf("Distinct screens: %zu\n", atomic_load(&ex->screens.size));
+
+	if( atomic_load(&ex->full) ) {
+		fprintf(stderr,
+			"WARN: State set filled up, some states were pruned early. Use "
+			"--states to make it bigger\n");
+	}
+
+	if( result == EXIT_SUCCESS && OUTPATH ) {
+		result = _writeScreens(ex, jobs, OUTPATH);
+	}
+
+	/* Drop whatever is left if the workers bailed out */
+	while( ex->stack ) {
+		Node *next = ex->stack->next;
+		_freeNode(ex->stack);
+		ex->stack = next;
+	}
+
+	return result;
+}
+
+static const char *HELP_STRING
+	= "usage: chip8 explore [options] [program]\n\n"
+	  "options:\n"
+	  "    -o, --out [file]...... Writes every distinct screen to a file\n"
+	  "    -d, --depth [num]..... Longest keypad sequence (default: 8)\n"
+	  "    -f, --frames [num].... Frames each key is given (default: 10)\n"
+	  "    -c, --cycles [num].... Cycles per frame (default: 16)\n"
+	  "    -s, --states [num].... Capacity of the state set (default: 4M)\n"
+	  "    -j, --jobs [num]...... Worker threads (default: one per core)\n";
+
+static int _usage() {
+	fprintf(stderr, "%s", HELP_STRING);
+	return EXIT_FAILURE;
+}
+
+int exploreMain(int argc, char *argv[]) {
+	if( argc == 0 ) {
+		return _usage();
+	}
+
+	char *file = NULL;
+	char *output = NULL;
+	int depth = 8, frames = 10, cycles = 16;
+	int jobs = utilCPUCount();
+	size_t states = 4 * 1024 * 1024;
+
+	while( *argv ) {
+		if( strcmp(*argv, "help") == 0 || strcmp(*argv, "--help") == 0 ) {
+			_usage();
+			return EXIT_SUCCESS;
+		} else if( strcmp(*argv, "-o") == 0 || strcmp(*argv, "--out") == 0 ) {
+			++argv;
+			if( !*argv ) {
+				return _usage();
+			}
+
+			output = *argv;
+		} else if( strcmp(*argv, "-d") == 0 || strcmp(*argv, "--depth") == 0 ) {
+			++argv;
+			if( !*argv ) {
+				return _usage();
+			}
+
+			depth = atoi(*argv);
+		} else if( strcmp(*argv, "-f") == 0
+			|| strcmp(*argv, "--frames") == 0 ) {
+			++argv;
+			if( !*argv ) {
+				return _usage();
+			}
+
+			frames = atoi(*argv);
+		} else if( strcmp(*argv, "-c") == 0
+			|| strcmp(*argv, "--cycles") == 0 ) {
+			++argv;
+			if( !*argv ) {
+				return _usage();
+			}
+
+			cycles = atoi(*argv);
+		} else if( strcmp(*argv, "-s") == 0
+			|| strcmp(*argv, "--states") == 0 ) {
+			++argv;
+			if( !*argv ) {
+				return _usage();
+			}
+
+			states = strtoull(*argv, NULL, 10);
+		} else if( strcmp(*argv, "-j") == 0 || strcmp(*argv, "--jobs") == 0 ) {
+			++argv;
+			if( !*argv ) {
+				return _usage();
+			}
+
+			jobs = atoi(*argv);
+		} else if( *(argv + 1) ) {
+			fprintf(stderr, "ERR: Unknown option '%s'!\n\n", *argv);
+			return _usage();
+		} else {
+			file = *argv;
+			break;
+		}
+
+		++argv;
+	}
+
+	if( !file ) {
+		fprintf(stderr, "ERR: An input file must be provided!\n\n");
+		return _usage();
+	}
+
+	if( depth < 1 || frames < 1 || cycles < 1 || jobs < 1 || states < 1 ) {
+		fprintf(stderr, "ERR: Options must be positive numbers!\n\n");
+		return _usage();
+	}
+
+	Explorer *ex = calloc(1, sizeof(*ex));
+	if( ex == NULL ) {
+		fprintf(stderr, "ERR: Couldn't allocate memory for explorer\n");
+		return EXIT_FAILURE;
+	}
+
+	C8Rom rom;
+	C8LoadError error = c8RomOpen(&rom, file);
+	if( error == C8_LOAD_OK ) {
+		error = c8ImageNew(&ex->image, rom.map.data, rom.map.size);
+		c8RomClose(&rom);
+	}
+
+	if( error != C8_LOAD_OK ) {
+		fprintf(stderr, "ERR: Couldn't load '%s': %s\n", file,
+			c8LoadErrorString(error));
+		free(ex);
+		return EXIT_FAILURE;
+	}
+
+	ex->maxDepth = depth;
+	ex->frames = frames;
+	ex->cycles = cycles;
+	atomic_init(&ex->full, false);
+	pthread_mutex_init(&ex->lock, NULL);
+	pthread_cond_init(&ex->wake, NULL);
+
+	int result = EXIT_FAILURE;
+	ex->found = calloc(jobs, sizeof(*ex->found));
+	ex->runs = calloc(jobs, sizeof(*ex->runs));
+
+	if( ex->found && ex->runs
+		&& utilHashSetNew(&ex->states, states) == EXIT_SUCCESS ) {
+		if( utilHashSetNew(&ex->screens, states) == EXIT_SUCCESS ) {
+			result = _explore(ex, jobs, output);
+			utilHashSetFree(&ex->screens);
+		}
+
+		utilHashSetFree(&ex->states);
+	}
+
+	for( int worker = 0; ex->found && worker < jobs; ++worker ) {
+		while( ex->found[worker] ) {
+			Screen *next = ex->found[worker]->next;
+			free(ex->found[worker]);
+			ex->found[worker] = next;
+		}
+	}
+
+	pthread_mutex_destroy(&ex->lock);
+	pthread_cond_destroy(&ex->wake);
+
+	free(ex->found);
+	free(ex->runs);
+	free(ex);
+
+	return result;
+}
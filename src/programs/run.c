@@ -4,70 +4,416 @@
  * It supports most known extensions, such as the SCHIP and XO-CHIP.
  */
 
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
+#include "chip8.h"
+#include "diffcore.h"
 #include "emulator.h"
+#include "headless.h"
 #include "run.h"
 
 static const char *HELP_STRING
-	= "usage: chip8 run [options] [program]\n\n"
+	= "usage: chip8 run [options] [program...]\n\n"
 	  "options:\n"
-	  "    -d, --delay [num]... Sets the cycle delay, in milliseconds\n"
-	  "    -s, --scale [num]... Sets the scaling factor of the window\n";
+	  "    -d, --delay [num]...... Sets the cycle delay, in milliseconds\n"
+	  "    -s, --scale [num]...... Sets the scaling factor of the window\n"
+	  "    -g, --grid [num]....... Runs num x num instances in one window,\n"
+	  "                            going through the programs in turn\n"
+	  "    --speed [num].......... Runs num times faster (F2/F3 while\n"
+	  "                            running, F1 goes back to normal)\n"
+	  "    --turbo................ Runs as fast as possible (F4)\n"
+	  "    --timing [model]....... Instructions per frame: 'fixed' (default)\n"
+	  "                            or 'vip', like a COSMAC VIP. Also headless\n"
+	  "    --stats-file [file].... Appends stats to a file every second, as\n"
+	  "                            JSON lines\n"
+	  "    --overlay.............. Shows a frame time graph (F5)\n"
+	  "    --capture [file]....... Records every frame, as a video if file\n"
+	  "                            ends in .c8v, or as numbered PNGs\n"
+	  "    --trace-file [file].... Where the execution trace is dumped to, on\n"
+	  "                            F12 or on a crash (default: chip8.trace)\n"
+	  "    --gdb [socket]......... Serves the GDB remote protocol on a Unix\n"
+	  "                            socket, or on stdio with '-'\n\n"
+	  "core testing (headless):\n"
+	  "    --headless............. Runs without a window, printing the hash\n"
+	  "                            of the last frame's display\n"
+	  "    --expect-hash [f[:h]].. Checks the display hash at frame f is h,\n"
+	  "                            or prints it. Can be repeated\n"
+	  "    --diff-core............ Runs c8Cycle and the batch engine side by\n"
+	  "                            side, stopping where they diverge\n"
+	  "    --diff-every [num]..... Compares full state every instruction (1,\n"
+	  "                            default), or hashes every num instructions\n"
+	  "    --frames [num]......... Frames to run for (default: 600)\n"
+	  "    --cycles [num]......... Cycles per frame (default: 16)\n"
+	  "    --input [file]......... Keypad trace, with 'FRAME KEY STATE' lines\n";
 
 static int _usage() {
 	fprintf(stderr, "%s", HELP_STRING);
 	return EXIT_FAILURE;
 }
 
-int runMain(int argc, char *argv[]) {
-	if( argc == 0 ) {
+/* Loads a program into a new image. Returns NULL if it fails */
+static C8Image *_loadImage(const char *PATH) {
+	C8Image *image = malloc(sizeof(*image));
+	if( image == NULL ) {
+		fprintf(stderr, "ERR: Couldn't allocate memory for program\n");
+		return NULL;
+	}
+
+	C8Rom rom;
+	C8LoadError error = c8RomOpen(&rom, PATH);
+	if( error == C8_LOAD_OK ) {
+		error = c8ImageNew(image, rom.map.data, rom.map.size);
+		c8RomClose(&rom);
+	}
+
+	if( error != C8_LOAD_OK ) {
+		fprintf(stderr, "ERR: Couldn't load '%s': %s\n", PATH,
+			c8LoadErrorString(error));
+		free(image);
+		return NULL;
+	}
+
+	return image;
+}
+
+static int _diffCore(const char *PATH, const DiffOptions *OPTS) {
+	if( OPTS->frames < 1 || OPTS->cycles < 1 || OPTS->every < 1 ) {
+		fprintf(stderr, "ERR: Options must be positive numbers!\n\n");
 		return _usage();
 	}
 
-	Emulator emu;
-	if( emuNew(&emu) == EXIT_FAILURE ) {
-		fprintf(stderr, "emuNew() failed! Exiting...\n");
+	C8Image *image = _loadImage(PATH);
+	if( image == NULL ) {
+		return EXIT_FAILURE;
+	}
+
+	const int RESULT = diffRun(image, OPTS);
+	free(image);
+
+	return RESULT;
+}
+
+static int _headless(const char *PATH, HeadlessOptions *opts) {
+	if( opts->frames < 1 || opts->cycles < 1 ) {
+		fprintf(stderr, "ERR: Options must be positive numbers!\n\n");
+		return _usage();
+	}
+
+	C8Image *image = _loadImage(PATH);
+	if( image == NULL ) {
 		return EXIT_FAILURE;
 	}
 
-	char *file = NULL;
+	const int RESULT = headlessRun(image, opts);
+	free(image);
+
+	return RESULT;
+}
+
+/* Parses "FRAME" or "FRAME:HASH". Returns false if it's invalid */
+static bool _parseCheck(const char *ARG, HeadlessCheck *check) {
+	char *end;
+
+	check->frame = strtol(ARG, &end, 10);
+	check->expected = *end == ':';
+	if( end == ARG || check->frame < 0 || (*end && !check->expected) ) {
+		return false;
+	}
+
+	if( check->expected ) {
+		const char *HASH = end + 1;
+		check->hash = strtoull(HASH, &end, 16);
+		return end != HASH && *end == '\0';
+	}
+
+	return true;
+}
+
+/* Adds a check, from "FRAME" or "FRAME:HASH". Returns false if it's invalid,
+ * or if it fails
+ */
+static bool _addCheck(HeadlessOptions *opts, const char *ARG) {
+	HeadlessCheck check;
+	if( ARG == NULL || !_parseCheck(ARG, &check) ) {
+		fprintf(stderr, "ERR: Invalid hash check '%s'!\n\n", ARG ? ARG : "");
+		return false;
+	}
+
+	HeadlessCheck *checks = realloc(
+		opts->checks, (opts->checkCount + 1) * sizeof(*opts->checks));
+	if( checks == NULL ) {
+		fprintf(stderr, "ERR: Couldn't allocate memory for checks\n");
+		return false;
+	}
+
+	opts->checks = checks;
+	opts->checks[opts->checkCount++] = check;
+
+	return true;
+}
+
+int runMain(int argc, char *argv[]) {
+	if( argc == 0 ) {
+		return _usage();
+	}
+
+	const char **files = NULL;
+	size_t fileCount = 0;
+	int grid = 1;
+	int speed = 1;
+	bool turbo = false;
+	C8Timing timing = C8_TIMING_FIXED;
+	const char *statsPath = NULL;
+	const char *capturePath = NULL;
+	bool overlay = false;
+	int delay = -1;
+	float scale = 0;
+	const char *tracePath = NULL;
+	const char *gdbPath = NULL;
+
+	bool diffCore = false;
+	bool headless = false;
+	HeadlessOptions checks = { 0 };
+	DiffOptions diff = {
+		.frames = 600,
+		.cycles = 16,
+		.every = 1,
+	};
+
+	/* Options missing their value stop it early, with no program given */
 	while( *argv ) {
 		if( strcmp(*argv, "help") == 0 || strcmp(*argv, "--help") == 0 ) {
+			free(checks.checks);
 			_usage();
 			return EXIT_SUCCESS;
 		} else if( strcmp(*argv, "-d") == 0 || strcmp(*argv, "--delay") == 0 ) {
 			++argv;
-			emuSetDelay(&emu, atoi(*argv));
+			if( !*argv ) {
+				break;
+			}
+
+			delay = atoi(*argv);
 		} else if( strcmp(*argv, "-s") == 0 || strcmp(*argv, "--scale") == 0 ) {
 			++argv;
-			if( emuSetScaleFactor(&emu, atof(*argv)) == EXIT_FAILURE ) {
-				emuQuit(&emu);
-				return EXIT_FAILURE;
+			if( !*argv ) {
+				break;
 			}
-		} else if( strcmp(*argv, "-d") == 0 || strcmp(*argv, "--delay") == 0 ) {
-		} else if( strcmp(*argv, "-d") == 0 || strcmp(*argv, "--delay") == 0 ) {
-		} else if( strcmp(*argv, "-d") == 0 || strcmp(*argv, "--delay") == 0 ) {
-		} else if( *(argv + 1) ) {
+
+			scale = atof(*argv);
+		} else if( strcmp(*argv, "-g") == 0 || strcmp(*argv, "--grid") == 0 ) {
+			++argv;
+			if( !*argv ) {
+				break;
+			}
+
+			grid = atoi(*argv);
+		} else if( strcmp(*argv, "--speed") == 0 ) {
+			++argv;
+			if( !*argv ) {
+				break;
+			}
+
+			speed = atoi(*argv);
+		} else if( strcmp(*argv, "--turbo") == 0 ) {
+			turbo = true;
+		} else if( strcmp(*argv, "--timing") == 0 ) {
+			++argv;
+			if( *argv && strcmp(*argv, "vip") == 0 ) {
+				timing = C8_TIMING_VIP;
+			} else if( !*argv || strcmp(*argv, "fixed") != 0 ) {
+				fprintf(stderr, "ERR: Timing must be 'fixed' or 'vip'!\n\n");
+				free(checks.checks);
+				return _usage();
+			}
+		} else if( strcmp(*argv, "--stats-file") == 0 ) {
+			++argv;
+			if( !*argv ) {
+				break;
+			}
+
+			statsPath = *argv;
+		} else if( strcmp(*argv, "--capture") == 0 ) {
+			++argv;
+			if( !*argv ) {
+				break;
+			}
+
+			capturePath = *argv;
+		} else if( strcmp(*argv, "--overlay") == 0 ) {
+			overlay = true;
+		} else if( strcmp(*argv, "--trace-file") == 0 ) {
+			++argv;
+			if( !*argv ) {
+				break;
+			}
+
+			tracePath = *argv;
+		} else if( strcmp(*argv, "--gdb") == 0 ) {
+			++argv;
+			if( !*argv ) {
+				break;
+			}
+
+			gdbPath = *argv;
+		} else if( strcmp(*argv, "--headless") == 0 ) {
+			headless = true;
+		} else if( strcmp(*argv, "--expect-hash") == 0 ) {
+			++argv;
+			if( !_addCheck(&checks, *argv) ) {
+				free(checks.checks);
+				return _usage();
+			}
+		} else if( strcmp(*argv, "--diff-core") == 0 ) {
+			diffCore = true;
+		} else if( strcmp(*argv, "--diff-every") == 0 ) {
+			++argv;
+			if( !*argv ) {
+				break;
+			}
+
+			diff.every = atoi(*argv);
+		} else if( strcmp(*argv, "--frames") == 0 ) {
+			++argv;
+			if( !*argv ) {
+				break;
+			}
+
+			diff.frames = atoi(*argv);
+		} else if( strcmp(*argv, "--cycles") == 0 ) {
+			++argv;
+			if( !*argv ) {
+				break;
+			}
+
+			diff.cycles = atoi(*argv);
+		} else if( strcmp(*argv, "--input") == 0 ) {
+			++argv;
+			if( !*argv ) {
+				break;
+			}
+
+			diff.INPUT = *argv;
+		} else if( **argv == '-' && *(argv + 1) ) {
 			fprintf(stderr, "ERR: Unknown option '%s'!\n\n", *argv);
+			free(checks.checks);
 			return _usage();
 		} else {
-			file = *argv;
+			/* Everything left is a program */
+			files = (const char **)argv;
+			while( argv[fileCount] ) {
+				++fileCount;
+			}
 			break;
 		}
 
 		++argv;
 	}
 
-	if( !file ) {
+	if( fileCount == 0 ) {
 		fprintf(stderr, "ERR: An input file must be provided!\n\n");
-		emuQuit(&emu);
+		free(checks.checks);
+		return _usage();
+	}
+
+	if( diffCore && headless ) {
+		fprintf(stderr, "ERR: --diff-core and --headless don't mix!\n\n");
+		free(checks.checks);
+		return _usage();
+	}
+
+	if( diffCore && timing != C8_TIMING_FIXED ) {
+		fprintf(stderr, "ERR: --diff-core only runs fixed timing!\n\n");
+		free(checks.checks);
+		return _usage();
+	}
+
+	if( diffCore ) {
+		free(checks.checks);
+		return _diffCore(files[0], &diff);
+	}
+
+	if( headless ) {
+		checks.frames = diff.frames;
+		checks.cycles = diff.cycles;
+		checks.timing = timing;
+		checks.INPUT = diff.INPUT;
+		checks.CAPTURE = capturePath;
+
+		const int RESULT = _headless(files[0], &checks);
+		free(checks.checks);
+		return RESULT;
+	}
+
+	if( checks.checkCount > 0 ) {
+		fprintf(stderr, "ERR: --expect-hash needs --headless!\n\n");
+		free(checks.checks);
+		return _usage();
+	}
+
+	if( grid < 1 || grid > EMU_GRID_MAX ) {
+		fprintf(stderr, "ERR: Grid must be 1 to %d wide!\n\n", EMU_GRID_MAX);
+		return _usage();
+	}
+
+	if( fileCount > (size_t)grid * grid ) {
+		fprintf(stderr, "ERR: %zu programs need a larger --grid!\n\n",
+			fileCount);
 		return _usage();
 	}
 
-	if( emuRunFile(&emu, file) == EXIT_FAILURE ) {
-		fprintf(stderr, "emuRunFile() failed! Exiting...\n");
+	Emulator emu;
+	if( emuNew(&emu) == EXIT_FAILURE ) {
+		fprintf(stderr, "emuNew() failed! Exiting...\n");
+		return EXIT_FAILURE;
+	}
+
+	if( delay >= 0 ) {
+		emuSetDelay(&emu, delay);
+	}
+
+	if( grid != 1 && emuSetGrid(&emu, grid) == EXIT_FAILURE ) {
+		emuQuit(&emu);
+		return EXIT_FAILURE;
+	}
+
+	if( emuSetSpeed(&emu, speed) == EXIT_FAILURE ) {
+		emuQuit(&emu);
+		return EXIT_FAILURE;
+	}
+
+	emuSetTurbo(&emu, turbo);
+	emuSetTiming(&emu, timing);
+	emuSetOverlay(&emu, overlay);
+
+	if( capturePath && emuSetCapture(&emu, capturePath) == EXIT_FAILURE ) {
+		emuQuit(&emu);
+		return EXIT_FAILURE;
+	}
+
+	if( statsPath && emuSetStatsFile(&emu, statsPath) == EXIT_FAILURE ) {
+		emuQuit(&emu);
+		return EXIT_FAILURE;
+	}
+
+	if( tracePath ) {
+		emuSetTraceFile(&emu, tracePath);
+	}
+
+	if( gdbPath && emuServeGdb(&emu, gdbPath) == EXIT_FAILURE ) {
+		emuQuit(&emu);
+		return EXIT_FAILURE;
+	}
+
+	if( scale > 0 && emuSetScaleFactor(&emu, scale) == EXIT_FAILURE ) {
+		emuQuit(&emu);
+		return EXIT_FAILURE;
+	}
+
+	if( emuRunFiles(&emu, files, fileCount) == EXIT_FAILURE ) {
+		fprintf(stderr, "emuRunFiles() failed! Exiting...\n");
 		emuQuit(&emu);
 		return EXIT_FAILURE;
 	}
@@ -0,0 +1,153 @@
+/* Chip-8 trace viewer
+ *
+ * This subprogram lists the instructions in a trace dumped by 'chip8 run',
+ * along with the registers they left behind.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chip8.h"
+#include "printer.h"
+#include "trace.h"
+#include "tracer.h"
+#include "util.h"
+
+static const char *HELP_STRING
+	= "usage: chip8 trace [options] [file]\n\n"
+	  "options:\n"
+	  "    -n, --last [num]....... Only shows the last num instructions\n"
+	  "    -v, --verbose.......... Prints instructions in plain english\n";
+
+static int _usage() {
+	fprintf(stderr, "%s", HELP_STRING);
+	return EXIT_FAILURE;
+}
+
+/* Checks the header, and that the file holds as many entries as it says */
+static bool _isValid(const UtilMap *MAP, const TraceHeader *HEADER) {
+	return MAP->size >= sizeof(*HEADER)
+		&& memcmp(HEADER->magic, TRACE_MAGIC, sizeof(HEADER->magic)) == 0
+		&& HEADER->version == TRACE_VERSION
+		&& HEADER->entrySize == sizeof(TraceEntry)
+		&& HEADER->count <= HEADER->total
+		&& MAP->size - sizeof(*HEADER)
+		>= (size_t)HEADER->count * sizeof(TraceEntry);
+}
+
+static void _printEntry(Printer *prt, uint64_t index, const TraceEntry *ENTRY) {
+	const Instr INSTR = c8ParseInstruction(ENTRY->opcode);
+
+	prtChar(prt, '#');
+	prtDecimal(prt, index);
+	prtString(prt, " 0x");
+	prtHex(prt, ENTRY->pc, 4);
+	prtString(prt, ": ");
+	prtHex(prt, ENTRY->opcode, 4);
+	prtString(prt, " [I=");
+	prtHex(prt, ENTRY->i, 4);
+	prtString(prt, " VX=");
+	prtHex(prt, ENTRY->vx, 2);
+	prtString(prt, " VF=");
+	prtHex(prt, ENTRY->vf, 2);
+	prtString(prt, "] ");
+	prtMnemonic(prt, INSTR);
+	prtChar(prt, '\n');
+}
+
+static int _view(const char *PATH, size_t last, bool verbose) {
+	UtilMap map;
+	if( utilMapFile(PATH, &map) == EXIT_FAILURE ) {
+		return EXIT_FAILURE;
+	}
+
+	TraceHeader header;
+	if( map.size >= sizeof(header) ) {
+		memcpy(&header, map.data, sizeof(header));
+	}
+
+	if( !_isValid(&map, &header) ) {
+		fprintf(stderr, "ERR: '%s' isn't a valid trace\n", PATH);
+		utilUnmapFile(&map);
+		return EXIT_FAILURE;
+	}
+
+	Printer prt;
+	if( prtNew(&prt, stdout, PRT_FORMAT_TEXT, verbose) == EXIT_FAILURE ) {
+		utilUnmapFile(&map);
+		return EXIT_FAILURE;
+	}
+
+	const TraceEntry *ENTRIES
+		= (const TraceEntry *)(map.data + sizeof(header));
+	const size_t SKIP
+		= last > 0 && last < header.count ? header.count - last : 0;
+
+	/* The first entry in the file isn't necessarily the first one executed */
+	const uint64_t FIRST = header.total - header.count;
+
+	prtString(&prt, "; ");
+	prtDecimal(&prt, header.count - SKIP);
+	prtString(&prt, " of ");
+	prtDecimal(&prt, header.total);
+	prtString(&prt, " instructions\n");
+
+	for( size_t n = SKIP; n < header.count; ++n ) {
+		_printEntry(&prt, FIRST + n, &ENTRIES[n]);
+	}
+
+	prtFree(&prt);
+	utilUnmapFile(&map);
+
+	return EXIT_SUCCESS;
+}
+
+int traceMain(int argc, char *argv[]) {
+	if( argc == 0 ) {
+		return _usage();
+	}
+
+	char *file = NULL;
+	int last = 0;
+	bool verbose = false;
+
+	while( *argv ) {
+		if( strcmp(*argv, "help") == 0 || strcmp(*argv, "--help") == 0 ) {
+			_usage();
+			return EXIT_SUCCESS;
+		} else if( strcmp(*argv, "-n") == 0 || strcmp(*argv, "--last") == 0 ) {
+			++argv;
+			if( !*argv ) {
+				return _usage();
+			}
+
+			last = atoi(*argv);
+		} else if( strcmp(*argv, "-v") == 0
+			|| strcmp(*argv, "--verbose") == 0 ) {
+			verbose = true;
+		} else if( *(argv + 1) ) {
+			fprintf(stderr, "ERR: Unknown option '%s'!\n\n", *argv);
+			return _usage();
+		} else {
+			file = *argv;
+			break;
+		}
+
+		++argv;
+	}
+
+	if( last < 0 ) {
+		fprintf(stderr, "ERR: -n must be a positive number!\n\n");
+		return _usage();
+	}
+
+	if( !file ) {
+		fprintf(stderr, "ERR: An input file must be provided!\n\n");
+		return _usage();
+	}
+
+	return _view(file, last, verbose);
+}
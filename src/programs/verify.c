@@ -0,0 +1,445 @@
+/* Decompiler/compiler round-trip checker
+ *
+ * This subprogram decompiles every program in a directory, assembles the
+ * listing back and runs both programs headless side by side, comparing their
+ * screens every frame. Programs that passed before are remembered (by hash)
+ * in a cache file, so only new programs are checked again.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "assembler.h"
+#include "chip8.h"
+#include "printer.h"
+#include "util.h"
+#include "verify.h"
+#include "version.h"
+
+#define PATH_SIZE 4096
+#define REASON_SIZE 128
+
+/* Bumped whenever the checks change, so old caches aren't trusted. Caches
+ * from other builds aren't either, see C8_BUILD_ID
+ */
+#define CACHE_VERSION 1
+#define CACHE_NAME ".chip8-verify"
+
+typedef enum _Status {
+	STATUS_PASSED,
+	STATUS_CACHED, /* Passed on a previous run */
+	STATUS_FAILED,
+	STATUS_SKIPPED, /* Not a loadable program */
+} Status;
+
+typedef struct _Check {
+	char *name;
+	uint64_t hash;
+
+	Status status;
+	char reason[REASON_SIZE];
+} Check;
+
+typedef struct _Verifier {
+	const char *DIR;
+
+	int frames;
+	int cycles; /* Per frame */
+	uint64_t seed; /* Mixes the build and settings into every program's hash */
+
+	Check *checks;
+	size_t count;
+
+	/* Hashes of programs that passed before, sorted */
+	uint64_t *cache;
+	size_t cacheSize;
+
+	/* One of each per worker */
+	Printer *printers;
+	Assembler **assemblers;
+} Verifier;
+
+static double _seconds(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int _compareHashes(const void *a, const void *b) {
+	const uint64_t A = *(const uint64_t *)a, B = *(const uint64_t *)b;
+	return (A > B) - (A < B);
+}
+
+static bool _isCached(const Verifier *VER, uint64_t hash) {
+	return VER->cacheSize > 0
+		&& bsearch(&hash, VER->cache, VER->cacheSize, sizeof(hash),
+			   _compareHashes);
+}
+
+/* Reads the cache. A missing cache is just empty */
+static int _loadCache(Verifier *ver, const char *PATH) {
+	FILE *file = fopen(PATH, "r");
+	if( file == NULL ) {
+		return EXIT_SUCCESS;
+	}
+
+	size_t capacity = 0;
+	unsigned long long hash;
+	while( fscanf(file, "%llx", &hash) == 1 ) {
+		if( ver->cacheSize == capacity ) {
+			capacity = capacity ? capacity * 2 : 256;
+
+			uint64_t *cache = realloc(ver->cache, capacity * sizeof(*cache));
+			if( cache == NULL ) {
+				fprintf(stderr, "ERR: Couldn't allocate memory for cache\n");
+				fclose(file);
+				return EXIT_FAILURE;
+			}
+
+			ver->cache = cache;
+		}
+
+		ver->cache[ver->cacheSize++] = hash;
+	}
+
+	fclose(file);
+
+	qsort(ver->cache, ver->cacheSize, sizeof(*ver->cache), _compareHashes);
+
+	return EXIT_SUCCESS;
+}
+
+/* Writes every program that passed, this time or before, to the cache */
+static int _saveCache(const Verifier *VER, const char *PATH) {
+	FILE *file = fopen(PATH, "w");
+	if( file == NULL ) {
+		fprintf(stderr, "ERR: Couldn't open file '%s'\n", PATH);
+		return EXIT_FAILURE;
+	}
+
+	for( size_t i = 0; i < VER->count; ++i ) {
+		const Check *CHECK = &VER->checks[i];
+		if( CHECK->status == STATUS_PASSED || CHECK->status == STATUS_CACHED ) {
+			fprintf(file, "%016llx\n", (unsigned long long)CHECK->hash);
+		}
+	}
+
+	fclose(file);
+	return EXIT_SUCCESS;
+}
+
+/* Runs both programs side by side, comparing their screens every frame
+ *
+ * Returns the first frame that differs, or -1 if none did
+ */
+static int _compareRuns(
+	const Verifier *VER, const C8Image *ORIGINAL, const C8Image *ROUNDTRIP) {
+	Chip8 a = c8NewShared(ORIGINAL);
+	Chip8 b = c8NewShared(ROUNDTRIP);
+	c8Seed(&a, 1);
+	c8Seed(&b, 1);
+
+	int diverged = -1;
+	for( int frame = 0; frame < VER->frames && diverged < 0; ++frame ) {
+		for( int cycle = 0; cycle < VER->cycles; ++cycle ) {
+			c8Cycle(&a);
+			c8Cycle(&b);
+		}
+
+		c8TickTimers(&a);
+		c8TickTimers(&b);
+
+		if( utilHash64(a.display, sizeof(a.display), 0)
+			!= utilHash64(b.display, sizeof(b.display), 0) ) {
+			diverged = frame;
+		}
+	}
+
+	c8Free(&a);
+	c8Free(&b);
+
+	return diverged;
+}
+
+/* Decompiles, reassembles and runs a program */
+static void _roundTrip(Verifier *ver, Check *check, const uint8_t *program,
+	size_t size, int worker) {
+	Printer *prt = &ver->printers[worker];
+	Assembler *as = ver->assemblers[worker];
+
+	prtReset(prt, NULL);
+	prtProgram(prt, check->name, program, size);
+
+	if( asmNew(as) == EXIT_FAILURE ) {
+		snprintf(check->reason, REASON_SIZE, "couldn't create assembler");
+		return;
+	}
+
+	if( asmAssemble(as, prt->buffer, prt->size) == EXIT_FAILURE ) {
+		snprintf(check->reason, REASON_SIZE,
+			"listing doesn't assemble (%zu errors)", as->errors);
+		asmFree(as);
+		return;
+	}
+
+	asmFree(as);
+
+	/* Both are checked, a program could differ but still run the same */
+	size_t offset = 0;
+	while( offset < size && offset < as->size
+		&& program[offset] == as->output[offset] ) {
+		++offset;
+	}
+
+	C8Image original, roundTrip;
+	c8ImageNew(&original, program, size);
+	if( c8ImageNew(&roundTrip, as->output, as->size) != C8_LOAD_OK ) {
+		snprintf(check->reason, REASON_SIZE, "reassembled program is empty");
+		return;
+	}
+
+	const int FRAME = _compareRuns(ver, &original, &roundTrip);
+	if( FRAME >= 0 ) {
+		snprintf(check->reason, REASON_SIZE, "screens differ at frame %d",
+			FRAME);
+	} else if( offset < size || as->size != size ) {
+		snprintf(check->reason, REASON_SIZE,
+			"reassembled program differs at 0x%04zX",
+			PROGRAM_START_ADDR + offset);
+	} else {
+		check->status = STATUS_PASSED;
+	}
+}
+
+static void _verifyTask(void *ctx, size_t index, int worker) {
+	Verifier *ver = ctx;
+	Check *check = &ver->checks[index];
+
+	char path[PATH_SIZE];
+	snprintf(path, PATH_SIZE, "%s/%s", ver->DIR, check->name);
+
+	check->status = STATUS_SKIPPED;
+
+	C8Rom rom;
+	C8LoadError error = c8RomOpen(&rom, path);
+	if( error != C8_LOAD_OK ) {
+		snprintf(check->reason, REASON_SIZE, "%s", c8LoadErrorString(error));
+		return;
+	}
+
+	check->hash = utilHash64(rom.map.data, rom.map.size, ver->seed);
+
+	if( _isCached(ver, check->hash) ) {
+		check->status = STATUS_CACHED;
+	} else {
+		check->status = STATUS_FAILED;
+		_roundTrip(ver, check, rom.map.data, rom.map.size, worker);
+	}
+
+	c8RomClose(&rom);
+}
+
+/* Prints every failure, and a summary */
+static int _report(const Verifier *VER, double elapsed) {
+	size_t counts[STATUS_SKIPPED + 1] = { 0 };
+
+	for( size_t i = 0; i < VER->count; ++i ) {
+		const Check *CHECK = &VER->checks[i];
+		++counts[CHECK->status];
+
+		if( CHECK->status == STATUS_FAILED ) {
+			printf("FAIL %s: %s\n", CHECK->name, CHECK->reason);
+		} else if( CHECK->status == STATUS_SKIPPED ) {
+			printf("SKIP %s: %s\n", CHECK->name, CHECK->reason);
+		}
+	}
+
+	printf("Verified %zu programs in %.2fs: %zu passed, %zu cached, "
+		   "%zu failed, %zu skipped\n",
+		VER->count, elapsed, counts[STATUS_PASSED], counts[STATUS_CACHED],
+		counts[STATUS_FAILED], counts[STATUS_SKIPPED]);
+
+	return counts[STATUS_FAILED] > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+static int _verify(Verifier *ver, int jobs, const char *CACHEPATH) {
+	char **names;
+	if( utilListFiles(ver->DIR, &names, &ver->count) == EXIT_FAILURE ) {
+		return EXIT_FAILURE;
+	}
+
+	ver->checks = calloc(ver->count, sizeof(*ver->checks));
+	ver->printers = calloc(jobs, sizeof(*ver->printers));
+	ver->assemblers = calloc(jobs, sizeof(*ver->assemblers));
+
+	int result = EXIT_SUCCESS;
+	if( (ver->count > 0 && !ver->checks) || !ver->printers
+		|| !ver->assemblers ) {
+		fprintf(stderr, "ERR: Couldn't allocate memory for verifier\n");
+		result = EXIT_FAILURE;
+	}
+
+	for( size_t i = 0; result == EXIT_SUCCESS && i < ver->count; ++i ) {
+		ver->checks[i].name = names[i];
+	}
+
+	int ready = 0;
+	for( ; result == EXIT_SUCCESS && ready < jobs; ++ready ) {
+		ver->assemblers[ready] = malloc(sizeof(**ver->assemblers));
+		if( ver->assemblers[ready] == NULL ) {
+			fprintf(stderr, "ERR: Couldn't allocate memory for assembler\n");
+			result = EXIT_FAILURE;
+			break;
+		}
+
+		result = prtNew(
+			&ver->printers[ready], NULL, PRT_FORMAT_ASM, false);
+	}
+
+	if( result == EXIT_SUCCESS ) {
+		const double START = _seconds();
+		result = utilParallelFor(ver->count, jobs, _verifyTask, ver);
+		const double ELAPSED = _seconds() - START;
+
+		if( result == EXIT_SUCCESS && CACHEPATH ) {
+			result = _saveCache(ver, CACHEPATH);
+		}
+
+		if( result == EXIT_SUCCESS ) {
+			result = _report(ver, ELAPSED);
+		}
+	}
+
+	for( int i = 0; i < jobs && ver->assemblers; ++i ) {
+		if( i < ready ) {
+			prtFree(&ver->printers[i]);
+		}
+
+		free(ver->assemblers[i]);
+	}
+
+	free(ver->printers);
+	free(ver->assemblers);
+	free(ver->checks);
+
+	utilFreeList(names, ver->count);
+
+	return result;
+}
+
+static const char *HELP_STRING
+	= "usage: chip8 verify [options] [directory]\n\n"
+	  "Decompiles every program in a directory, compiles it back and checks\n"
+	  "both run the same.\n\n"
+	  "options:\n"
+	  "    -f, --frames [num].... Frames each program is run for (default: "
+	  "600)\n"
+	  "    -c, --cycles [num].... Cycles per frame (default: 16)\n"
+	  "    -j, --jobs [num]...... Worker threads (default: one per core)\n"
+	  "    --cache [file]........ Cache of programs that passed (default:\n"
+	  "                           " CACHE_NAME " in the directory)\n"
+	  "    --no-cache............ Checks every program, and keeps no cache\n";
+
+static int _usage() {
+	fprintf(stderr, "%s", HELP_STRING);
+	return EXIT_FAILURE;
+}
+
+int verifyMain(int argc, char *argv[]) {
+	if( argc == 0 ) {
+		return _usage();
+	}
+
+	char *dir = NULL;
+	char *cache = NULL;
+	bool useCache = true;
+	int frames = 600, cycles = 16;
+	int jobs = utilCPUCount();
+
+	while( *argv ) {
+		if( strcmp(*argv, "help") == 0 || strcmp(*argv, "--help") == 0 ) {
+			_usage();
+			return EXIT_SUCCESS;
+		} else if( strcmp(*argv, "-f") == 0
+			|| strcmp(*argv, "--frames") == 0 ) {
+			++argv;
+			if( !*argv ) {
+				return _usage();
+			}
+
+			frames = atoi(*argv);
+		} else if( strcmp(*argv, "-c") == 0
+			|| strcmp(*argv, "--cycles") == 0 ) {
+			++argv;
+			if( !*argv ) {
+				return _usage();
+			}
+
+			cycles = atoi(*argv);
+		} else if( strcmp(*argv, "-j") == 0 || strcmp(*argv, "--jobs") == 0 ) {
+			++argv;
+			if( !*argv ) {
+				return _usage();
+			}
+
+			jobs = atoi(*argv);
+		} else if( strcmp(*argv, "--cache") == 0 ) {
+			++argv;
+			if( !*argv ) {
+				return _usage();
+			}
+
+			cache = *argv;
+		} else if( strcmp(*argv, "--no-cache") == 0 ) {
+			useCache = false;
+		} else if( *(argv + 1) ) {
+			fprintf(stderr, "ERR: Unknown option '%s'!\n\n", *argv);
+			return _usage();
+		} else {
+			dir = *argv;
+			break;
+		}
+
+		++argv;
+	}
+
+	if( !dir || !utilIsDirectory(dir) ) {
+		fprintf(stderr, "ERR: A directory of programs must be provided!\n\n");
+		return _usage();
+	}
+
+	if( frames < 1 || cycles < 1 || jobs < 1 ) {
+		fprintf(stderr, "ERR: Options must be positive numbers!\n\n");
+		return _usage();
+	}
+
+	char cachepath[PATH_SIZE];
+	if( !cache ) {
+		snprintf(cachepath, PATH_SIZE, "%s/" CACHE_NAME, dir);
+		cache = cachepath;
+	}
+
+	const uint64_t SETTINGS = ((uint64_t)CACHE_VERSION << 48)
+		^ ((uint64_t)frames << 16) ^ cycles;
+
+	Verifier ver = {
+		.DIR = dir,
+		.frames = frames,
+		.cycles = cycles,
+		.seed = utilHash64(C8_BUILD_ID, strlen(C8_BUILD_ID), SETTINGS),
+	};
+
+	int result = useCache ? _loadCache(&ver, cache) : EXIT_SUCCESS;
+	if( result == EXIT_SUCCESS ) {
+		result = _verify(&ver, jobs, useCache ? cache : NULL);
+	}
+
+	free(ver.cache);
+
+	return result;
+}
@@ -2,7 +2,22 @@
  *
  */
 
+#include <stdatomic.h>
 #include <stdio.h>
+#include <string.h>
+
+#include <pthread.h>
+
+#if defined(_WIN32) || defined(WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include <dirent.h>
+#include <sys/stat.h>
 
 #include "util.h"
 
@@ -24,15 +39,20 @@ size_t utilLoadBinaryFile(const char *PATH, uint8_t **buffer) {
 		fprintf(stderr,
 			"ERR: Couldn't allocate memory (%zu bytes) for program\n",
 			FILESIZE + 1);
+		fclose(file);
 		return -1;
 	}
 
 	const size_t BYTES_READ = fread(*buffer, 1, FILESIZE, file);
+	fclose(file);
+
 	if( BYTES_READ < FILESIZE ) {
 		fprintf(stderr,
 			"ERR: Couldn't fully read file (read %zu bytes, file is %zu bytes "
 			"long)\n",
 			BYTES_READ, FILESIZE);
+		free(*buffer);
+		*buffer = NULL;
 		return -1;
 	}
 
@@ -40,3 +60,378 @@ size_t utilLoadBinaryFile(const char *PATH, uint8_t **buffer) {
 
 	return BYTES_READ;
 }
+
+#if defined(_WIN32) || defined(WIN32)
+int utilMapFile(const char *PATH, UtilMap *map) {
+	map->mapped = 0;
+	map->size = utilLoadBinaryFile(PATH, &map->data);
+
+	return map->size == (size_t)-1 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+void utilUnmapFile(UtilMap *map) {
+	free(map->data);
+	map->data = NULL;
+}
+
+int utilCPUCount(void) {
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+
+	return info.dwNumberOfProcessors > 0 ? info.dwNumberOfProcessors : 1;
+}
+#else
+int utilMapFile(const char *PATH, UtilMap *map) {
+	map->data = NULL;
+	map->size = 0;
+	map->mapped = 0;
+
+	const int FD = open(PATH, O_RDONLY);
+	if( FD < 0 ) {
+		fprintf(stderr, "ERR: Couldn't open file '%s'\n", PATH);
+		return EXIT_FAILURE;
+	}
+
+	struct stat st;
+	if( fstat(FD, &st) != 0 || !S_ISREG(st.st_mode) ) {
+		fprintf(stderr, "ERR: '%s' isn't a regular file\n", PATH);
+		close(FD);
+		return EXIT_FAILURE;
+	}
+
+	/* Empty files can't be mapped, but they're still valid */
+	if( st.st_size == 0 ) {
+		close(FD);
+		return EXIT_SUCCESS;
+	}
+
+	void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, FD, 0);
+	close(FD);
+
+	if( data == MAP_FAILED ) {
+		fprintf(stderr, "ERR: Couldn't map file '%s'\n", PATH);
+		return EXIT_FAILURE;
+	}
+
+	map->data = data;
+	map->size = st.st_size;
+	map->mapped = 1;
+
+	return EXIT_SUCCESS;
+}
+
+void utilUnmapFile(UtilMap *map) {
+	if( map->mapped ) {
+		munmap(map->data, map->size);
+	}
+
+	map->data = NULL;
+	map->size = 0;
+	map->mapped = 0;
+}
+
+int utilCPUCount(void) {
+	const long COUNT = sysconf(_SC_NPROCESSORS_ONLN);
+	return COUNT > 0 ? COUNT : 1;
+}
+#endif
+
+bool utilIsDirectory(const char *PATH) {
+	struct stat st;
+	return stat(PATH, &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+static int _compareNames(const void *a, const void *b) {
+	return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+int utilListFiles(const char *PATH, char ***names, size_t *count) {
+	*names = NULL;
+	*count = 0;
+
+	DIR *dir = opendir(PATH);
+	if( dir == NULL ) {
+		fprintf(stderr, "ERR: Couldn't open directory '%s'\n", PATH);
+		return EXIT_FAILURE;
+	}
+
+	size_t capacity = 0;
+	struct dirent *entry;
+	while( (entry = readdir(dir)) != NULL ) {
+		char path[4096];
+		struct stat st;
+
+		if( entry->d_name[0] == '.' ) {
+			continue;
+		}
+
+		snprintf(path, sizeof(path), "%s/%s", PATH, entry->d_name);
+		if( stat(path, &st) != 0 || !S_ISREG(st.st_mode) ) {
+			continue;
+		}
+
+		if( *count == capacity ) {
+			capacity = capacity ? capacity * 2 : 256;
+
+			char **list = realloc(*names, capacity * sizeof(*list));
+			if( list == NULL ) {
+				break;
+			}
+
+			*names = list;
+		}
+
+		char *name = strdup(entry->d_name);
+		if( name == NULL ) {
+			break;
+		}
+
+		(*names)[(*count)++] = name;
+	}
+
+	/* Only stops early when out of memory */
+	if( entry != NULL ) {
+		fprintf(stderr, "ERR: Couldn't allocate memory for file list\n");
+		closedir(dir);
+		utilFreeList(*names, *count);
+		*names = NULL;
+		*count = 0;
+		return EXIT_FAILURE;
+	}
+
+	closedir(dir);
+
+	/* Keeps listings stable between runs */
+	qsort(*names, *count, sizeof(**names), _compareNames);
+
+	return EXIT_SUCCESS;
+}
+
+void utilFreeList(char **names, size_t count) {
+	for( size_t i = 0; i < count; ++i ) {
+		free(names[i]);
+	}
+
+	free(names);
+}
+
+typedef struct _ParallelFor {
+	atomic_size_t next; /* Next index to hand out */
+	size_t count;
+
+	UtilTask task;
+	void *ctx;
+} ParallelFor;
+
+typedef struct _Worker {
+	ParallelFor *pf;
+	int id;
+} Worker;
+
+static void *_worker(void *arg) {
+	Worker *worker = arg;
+	ParallelFor *pf = worker->pf;
+
+	for( ;; ) {
+		const size_t INDEX = atomic_fetch_add(&pf->next, 1);
+		if( INDEX >= pf->count ) {
+			break;
+		}
+
+		pf->task(pf->ctx, INDEX, worker->id);
+	}
+
+	return NULL;
+}
+
+int utilParallelFor(size_t count, int jobs, UtilTask task, void *ctx) {
+	if( jobs < 1 ) {
+		jobs = 1;
+	}
+
+	if( (size_t)jobs > count ) {
+		jobs = count > 0 ? count : 1;
+	}
+
+	ParallelFor pf = { .count = count, .task = task, .ctx = ctx };
+	atomic_init(&pf.next, 0);
+
+	/* No point in spinning up threads for a single worker */
+	if( jobs == 1 ) {
+		Worker worker = { .pf = &pf, .id = 0 };
+		_worker(&worker);
+		return EXIT_SUCCESS;
+	}
+
+	pthread_t *threads = malloc(jobs * sizeof(*threads));
+	Worker *workers = malloc(jobs * sizeof(*workers));
+	if( threads == NULL || workers == NULL ) {
+		fprintf(stderr, "ERR: Couldn't allocate memory for %d workers\n", jobs);
+		free(threads);
+		free(workers);
+		return EXIT_FAILURE;
+	}
+
+	int started = 0;
+	for( ; started < jobs; ++started ) {
+		workers[started] = (Worker) { .pf = &pf, .id = started };
+		if( pthread_create(&threads[started], NULL, _worker, &workers[started])
+			!= 0 ) {
+			fprintf(stderr, "ERR: Couldn't start worker thread %d\n", started);
+			break;
+		}
+	}
+
+	/* Whoever did start will still go through every index */
+	for( int i = 0; i < started; ++i ) {
+		pthread_join(threads[i], NULL);
+	}
+
+	free(threads);
+	free(workers);
+
+	return started > 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+#define XXH_PRIME1 0x9E3779B185EBCA87ULL
+#define XXH_PRIME2 0xC2B2AE3D27D4EB4FULL
+#define XXH_PRIME3 0x165667B19E3779F9ULL
+#define XXH_PRIME4 0x85EBCA77C2B2AE63ULL
+#define XXH_PRIME5 0x27D4EB2F165667C5ULL
+
+static uint64_t _rotl64(uint64_t value, int bits) {
+	return (value << bits) | (value >> (64 - bits));
+}
+
+static uint64_t _read64(const uint8_t *p) {
+	uint64_t value = 0;
+	for( int i = 7; i >= 0; --i ) {
+		value = (value << 8) | p[i];
+	}
+
+	return value;
+}
+
+static uint32_t _read32(const uint8_t *p) {
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint64_t _xxhRound(uint64_t acc, uint64_t input) {
+	acc += input * XXH_PRIME2;
+	return _rotl64(acc, 31) * XXH_PRIME1;
+}
+
+static uint64_t _xxhMerge(uint64_t acc, uint64_t value) {
+	acc ^= _xxhRound(0, value);
+	return acc * XXH_PRIME1 + XXH_PRIME4;
+}
+
+uint64_t utilHash64(const void *data, size_t size, uint64_t seed) {
+	const uint8_t *p = data;
+	const uint8_t *END = p + size;
+	uint64_t hash;
+
+	if( size >= 32 ) {
+		uint64_t v1 = seed + XXH_PRIME1 + XXH_PRIME2;
+		uint64_t v2 = seed + XXH_PRIME2;
+		uint64_t v3 = seed;
+		uint64_t v4 = seed - XXH_PRIME1;
+
+		for( ; p + 32 <= END; p += 32 ) {
+			v1 = _xxhRound(v1, _read64(p));
+			v2 = _xxhRound(v2, _read64(p + 8));
+			v3 = _xxhRound(v3, _read64(p + 16));
+			v4 = _xxhRound(v4, _read64(p + 24));
+		}
+
+		hash = _rotl64(v1, 1) + _rotl64(v2, 7) + _rotl64(v3, 12)
+			+ _rotl64(v4, 18);
+		hash = _xxhMerge(hash, v1);
+		hash = _xxhMerge(hash, v2);
+		hash = _xxhMerge(hash, v3);
+		hash = _xxhMerge(hash, v4);
+	} else {
+		hash = seed + XXH_PRIME5;
+	}
+
+	hash += size;
+
+	for( ; p + 8 <= END; p += 8 ) {
+		hash ^= _xxhRound(0, _read64(p));
+		hash = _rotl64(hash, 27) * XXH_PRIME1 + XXH_PRIME4;
+	}
+
+	if( p + 4 <= END ) {
+		hash ^= _read32(p) * XXH_PRIME1;
+		hash = _rotl64(hash, 23) * XXH_PRIME2 + XXH_PRIME3;
+		p += 4;
+	}
+
+	for( ; p < END; ++p ) {
+		hash ^= *p * XXH_PRIME5;
+		hash = _rotl64(hash, 11) * XXH_PRIME1;
+	}
+
+	hash ^= hash >> 33;
+	hash *= XXH_PRIME2;
+	hash ^= hash >> 29;
+	hash *= XXH_PRIME3;
+	hash ^= hash >> 32;
+
+	return hash;
+}
+
+int utilHashSetNew(UtilHashSet *set, size_t capacity) {
+	size_t slots = 16;
+	while( slots < capacity ) {
+		slots <<= 1;
+	}
+
+	set->slots = calloc(slots, sizeof(*set->slots));
+	if( set->slots == NULL ) {
+		fprintf(stderr,
+			"ERR: Couldn't allocate memory (%zu bytes) for hash set\n",
+			slots * sizeof(*set->slots));
+		return EXIT_FAILURE;
+	}
+
+	set->mask = slots - 1;
+	atomic_init(&set->size, 0);
+
+	return EXIT_SUCCESS;
+}
+
+int utilHashSetInsert(UtilHashSet *set, uint64_t hash) {
+	/* 0 marks empty slots */
+	if( hash == 0 ) {
+		hash = 1;
+	}
+
+	/* Open addressing with linear probing. Slots are only ever claimed with
+	 * a CAS, so nothing has to be locked
+	 */
+	for( size_t probe = 0; probe <= set->mask; ++probe ) {
+		_Atomic uint64_t *slot = &set->slots[(hash + probe) & set->mask];
+
+		uint64_t current = atomic_load_explicit(slot, memory_order_relaxed);
+		if( current == 0 ) {
+			if( atomic_compare_exchange_strong(slot, &current, hash) ) {
+				atomic_fetch_add_explicit(&set->size, 1, memory_order_relaxed);
+				return 1;
+			}
+
+			/* Someone else claimed it, current holds their hash */
+		}
+
+		if( current == hash ) {
+			return 0;
+		}
+	}
+
+	return -1;
+}
+
+void utilHashSetFree(UtilHashSet *set) {
+	free(set->slots);
+	set->slots = NULL;
+}